@@ -0,0 +1,701 @@
+/*****************************************************************************
+ *
+ *                       batch.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM batch mode (./um -B MANIFEST). The manifest lists one
+ *               job per line, as three paths:
+ *
+ *                 PROGRAM INPUT OUTPUT
+ *
+ *               where INPUT may be - for none; blank lines and lines
+ *               starting with # are skipped. Every job runs its program as
+ *               a libum machine (libum.h) on its input, writing its output
+ *               to OUTPUT, and the jobs run on a pool of worker threads,
+ *               one per core unless -t says otherwise.
+ *
+ *               Each worker has a queue of started jobs. It runs the job
+ *               at the front for one quota of dispatches (-q), drains its
+ *               output, and puts it at the back, so a long job takes turns
+ *               with short ones rather than holding the worker. A worker
+ *               with fewer than BATCH_LIVE_JOBS jobs starts the next job
+ *               from the manifest; one with more starts one after every
+ *               full turn of its queue, so the jobs still waiting in the
+ *               manifest take a turn like one more job and are never held
+ *               up until a long job ends. A worker with nothing to do
+ *               steals a job from the back of another worker's queue.
+ *               With -p each worker is pinned to a core of its own.
+ *
+ *               Each program file is mapped once and loaded into every
+ *               machine that runs it. At the end the batch reports jobs
+ *               per second and percentiles of job latency, from the start
+ *               of the batch (when every job is submitted) to its Halt,
+ *               and of the wait before its first slice, on stderr.
+ *
+ ****************************************************************************/
+#define _GNU_SOURCE /* pthread_setaffinity_np */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "batch.h"
+#include "libum.h"
+#include "load.h"
+
+/* bytes of output drained at a time */
+#define DRAIN_BYTES ((size_t) 64 * 1024)
+
+/* how long a worker with nothing to run or steal waits before it looks
+ * again */
+#define IDLE_NS 100000
+
+/* Batch program struct
+ *
+ * Purpose: one program named in the manifest, mapped once for all of its
+ *          jobs
+ * Members:
+ *      - const char *path: its file
+ *      - program_image image: the mapping (load.h)
+ *      - bool mapped: it could be mapped
+ */
+typedef struct batch_program {
+        const char *path;
+        program_image image;
+        bool mapped;
+} batch_program;
+
+/* Batch job struct
+ *
+ * Purpose: one line of the manifest, and the machine running it
+ * Members:
+ *      - size_t line: its line in the manifest, for reports
+ *      - batch_program *program: program to run
+ *      - const char *input, *output: its input file (NULL for none) and
+ *        output file
+ *      - um_vm_t vm: its machine, once started
+ *      - program_image in: its input, mapped
+ *      - size_t in_fed: bytes of in fed to the machine
+ *      - FILE *out: its output file, once started
+ *      - uint64_t start_ns, end_ns: when its first slice started and when
+ *        it finished, both from the start of the batch
+ *      - bool failed: it could not be run, or its output not written
+ */
+typedef struct batch_job {
+        size_t line;
+        batch_program *program;
+        const char *input, *output;
+        um_vm_t vm;
+        program_image in;
+        size_t in_fed;
+        FILE *out;
+        uint64_t start_ns, end_ns;
+        bool failed;
+} batch_job;
+
+/* Job queue struct
+ *
+ * Purpose: a worker's started jobs, oldest at the front
+ * Members:
+ *      - pthread_mutex_t lock: held by the owner or a thief using it
+ *      - batch_job **ring: the jobs, len of them from ring[first]
+ *        (wrapping), in cap slots
+ */
+typedef struct job_queue {
+        pthread_mutex_t lock;
+        batch_job **ring;
+        size_t first, len, cap;
+} job_queue;
+
+struct batch;
+
+/* Worker struct
+ *
+ * Purpose: one thread of the pool
+ * Members:
+ *      - struct batch *batch: the batch it works on
+ *      - unsigned index: its place in the pool, and its core if pinned
+ *      - pthread_t thread: the thread
+ *      - job_queue queue: its started jobs
+ *      - size_t turns: slices it has run since it last started a job
+ *      - uint8_t *drained: buffer output is drained through
+ */
+typedef struct worker {
+        struct batch *batch;
+        unsigned index;
+        pthread_t thread;
+        job_queue queue;
+        size_t turns;
+        uint8_t *drained;
+} worker;
+
+/* Batch struct
+ *
+ * Purpose: everything the workers share
+ * Members:
+ *      - batch_job *jobs: every job, in manifest order, num_jobs of them
+ *      - size_t next_job: index of the next job to start
+ *      - size_t remaining: jobs not yet finished
+ *      - worker *workers: the pool, num_workers of them
+ *      - uint64_t quota: dispatches per slice
+ *      - bool pin: pin each worker to a core
+ *      - uint64_t slices, steals: slices run, and jobs stolen
+ *      - uint64_t start_ns: when the batch started
+ */
+typedef struct batch {
+        batch_job *jobs;
+        size_t num_jobs;
+        size_t next_job;
+        size_t remaining;
+        worker *workers;
+        unsigned num_workers;
+        uint64_t quota;
+        bool pin;
+        uint64_t slices, steals;
+        uint64_t start_ns;
+} batch;
+
+static char *read_manifest(const char *path, batch *b,
+                           batch_program **programs, size_t *num_programs);
+static void *work(void *arg);
+static batch_job *next_job(worker *self);
+static bool start_job(batch_job *job);
+static bool run_slice(worker *self, batch_job *job);
+static void finish_job(worker *self, batch_job *job);
+static void drain_output(worker *self, batch_job *job);
+static void queue_push(job_queue *queue, batch_job *job);
+static batch_job *queue_take(job_queue *queue, bool front);
+static size_t queue_length(job_queue *queue);
+static void report_batch(FILE *out, batch *b, uint64_t elapsed_ns);
+static void report_percentiles(FILE *out, const char *label,
+                               uint64_t *values, size_t n);
+static size_t rank(size_t n, unsigned percent);
+static int compare_u64(const void *a, const void *b);
+static uint64_t now_ns(void);
+
+/**********run_batch**********************************************************
+ *
+ * Purpose:
+ *      Runs every job of a manifest on a pool of worker threads, and
+ *      reports how fast they went
+ * Parameters:
+ *      const char *manifest: the manifest file
+ *      unsigned workers: threads in the pool, or 0 for one per core
+ *      uint64_t quota: dispatches a job runs before it takes its turn
+ *      bool pin: pin each worker to a core
+ * Returns:
+ *      0 if every job ran, else 1 (each failure is reported on stderr)
+ * Expects:
+ *      manifest to be non-NULL and quota > 0
+ * Notes:
+ *      The report goes to stderr
+ ****************************************************************************/
+int run_batch(const char *manifest, unsigned workers, uint64_t quota,
+              bool pin)
+{
+        assert(manifest != NULL && quota > 0);
+        batch b;
+        memset(&b, 0, sizeof(b));
+        batch_program *programs = NULL;
+        size_t num_programs = 0;
+        char *text = read_manifest(manifest, &b, &programs, &num_programs);
+        if (text == NULL) {
+                return 1;
+        }
+        if (workers == 0) {
+                long cores = sysconf(_SC_NPROCESSORS_ONLN);
+                workers = (cores > 0) ? cores : 1;
+        }
+        b.remaining = b.num_jobs;
+        b.num_workers = workers;
+        b.quota = quota;
+        b.pin = pin;
+        b.workers = calloc(workers, sizeof(*b.workers));
+        assert(b.workers != NULL);
+
+        b.start_ns = now_ns();
+        for (unsigned i = 0; i < workers; i++) {
+                worker *w = &b.workers[i];
+                w->batch = &b;
+                w->index = i;
+                pthread_mutex_init(&w->queue.lock, NULL);
+                w->drained = malloc(DRAIN_BYTES);
+                assert(w->drained != NULL);
+                int err = pthread_create(&w->thread, NULL, work, w);
+                assert(err == 0);
+                (void) err;
+        }
+        for (unsigned i = 0; i < workers; i++) {
+                pthread_join(b.workers[i].thread, NULL);
+        }
+        report_batch(stderr, &b, now_ns() - b.start_ns);
+
+        int status = 0;
+        for (size_t i = 0; i < b.num_jobs; i++) {
+                status |= b.jobs[i].failed;
+        }
+        for (unsigned i = 0; i < workers; i++) {
+                pthread_mutex_destroy(&b.workers[i].queue.lock);
+                free(b.workers[i].queue.ring);
+                free(b.workers[i].drained);
+        }
+        for (size_t i = 0; i < num_programs; i++) {
+                if (programs[i].mapped) {
+                        unmap_program(&programs[i].image);
+                }
+        }
+        free(b.workers);
+        free(b.jobs);
+        free(programs);
+        free(text);
+        return status;
+}
+
+/**********read_manifest******************************************************
+ *
+ * Purpose:
+ *      Reads a manifest into jobs, and maps each program it names once
+ * Parameters:
+ *      const char *path: the manifest
+ *      batch *b: jobs and num_jobs are filled in
+ *      batch_program **programs: set to the distinct programs
+ *      size_t *num_programs: set to how many there are
+ * Returns:
+ *      The manifest's text, which the jobs' paths point into (the caller
+ *      frees it), or NULL if it could not be read or has a bad line
+ * Expects:
+ *      all arguments to be non-NULL
+ * Notes:
+ *      A program that cannot be mapped fails its jobs when they start,
+ *      not the batch
+ ****************************************************************************/
+static char *read_manifest(const char *path, batch *b,
+                           batch_program **programs, size_t *num_programs)
+{
+        program_image image;
+        if (!map_program(path, &image)) {
+                fprintf(stderr, "um: could not read manifest %s\n", path);
+                return NULL;
+        }
+        char *text = malloc(image.size + 1);
+        assert(text != NULL);
+        memcpy(text, image.bytes, image.size);
+        text[image.size] = '\0';
+        unmap_program(&image);
+
+        size_t jobs_cap = 0, programs_cap = 0;
+        char *line = text;
+        for (size_t line_no = 1; line != NULL; line_no++) {
+                char *end = strchr(line, '\n');
+                if (end != NULL) {
+                        *end = '\0';
+                }
+                char *save;
+                char *fields[4];
+                int num_fields = 0;
+                for (char *field = strtok_r(line, " \t\r", &save);
+                     field != NULL && num_fields < 4;
+                     field = strtok_r(NULL, " \t\r", &save)) {
+                        fields[num_fields++] = field;
+                }
+                line = (end != NULL) ? end + 1 : NULL;
+                if (num_fields == 0 || fields[0][0] == '#') {
+                        continue;
+                }
+                if (num_fields != 3) {
+                        fprintf(stderr, "um: manifest line %zu: expected "
+                                "PROGRAM INPUT OUTPUT\n", line_no);
+                        free(b->jobs);
+                        free(*programs);
+                        free(text);
+                        return NULL;
+                }
+
+                size_t p = 0;
+                while (p < *num_programs &&
+                       strcmp((*programs)[p].path, fields[0]) != 0) {
+                        p++;
+                }
+                if (p == *num_programs) {
+                        if (p == programs_cap) {
+                                programs_cap = 2 * programs_cap + 1;
+                                *programs = realloc(*programs, programs_cap *
+                                                    sizeof(**programs));
+                                assert(*programs != NULL);
+                        }
+                        batch_program *program = &(*programs)[p];
+                        program->path = fields[0];
+                        program->mapped = map_program(fields[0],
+                                                      &program->image);
+                        (*num_programs)++;
+                }
+                if (b->num_jobs == jobs_cap) {
+                        jobs_cap = 2 * jobs_cap + 1;
+                        b->jobs = realloc(b->jobs,
+                                          jobs_cap * sizeof(*b->jobs));
+                        assert(b->jobs != NULL);
+                }
+                batch_job *job = &b->jobs[b->num_jobs++];
+                memset(job, 0, sizeof(*job));
+                job->line = line_no;
+                job->program = (batch_program *) (uintptr_t) p;
+                job->input = strcmp(fields[1], "-") == 0 ? NULL : fields[1];
+                job->output = fields[2];
+        }
+        /* programs may have moved as they grew: index them only now */
+        for (size_t i = 0; i < b->num_jobs; i++) {
+                b->jobs[i].program = &(*programs)[(uintptr_t)
+                                                  b->jobs[i].program];
+        }
+        return text;
+}
+
+/**********work***************************************************************
+ *
+ * Purpose:
+ *      A worker thread: runs slices of jobs until every job is finished
+ * Parameters:
+ *      void *arg: the worker
+ * Returns:
+ *      NULL
+ * Expects:
+ *      arg to be a worker of a batch
+ * Notes:
+ *      A worker that cannot be pinned runs unpinned
+ ****************************************************************************/
+static void *work(void *arg)
+{
+        worker *self = arg;
+        batch *b = self->batch;
+        if (b->pin) {
+                long cores = sysconf(_SC_NPROCESSORS_ONLN);
+                cpu_set_t cpus;
+                CPU_ZERO(&cpus);
+                CPU_SET(self->index % (cores > 0 ? cores : 1), &cpus);
+                pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        }
+        while (__atomic_load_n(&b->remaining, __ATOMIC_ACQUIRE) > 0) {
+                batch_job *job = next_job(self);
+                if (job == NULL) {
+                        struct timespec idle = { 0, IDLE_NS };
+                        nanosleep(&idle, NULL);
+                        continue;
+                }
+                __atomic_fetch_add(&b->slices, 1, __ATOMIC_RELAXED);
+                if (run_slice(self, job)) {
+                        finish_job(self, job);
+                } else {
+                        queue_push(&self->queue, job);
+                }
+        }
+        return NULL;
+}
+
+/**********next_job***********************************************************
+ *
+ * Purpose:
+ *      Picks the job a worker runs next
+ * Parameters:
+ *      worker *self: the worker
+ * Returns:
+ *      A new job from the manifest if the worker has room for one or its
+ *      queue has had a full turn since it last started one, else the
+ *      front of its queue, else a job stolen from the back of another
+ *      worker's queue; NULL if there is none
+ * Expects:
+ *      self to be non-NULL
+ * Notes:
+ *      A new job is started here; one that cannot be is finished at once
+ *      and the search goes on. Past BATCH_LIVE_JOBS a worker starts one
+ *      job per turn of its queue, a rate that slows as the queue grows,
+ *      so waiting jobs start soon without every job being live at once
+ ****************************************************************************/
+static batch_job *next_job(worker *self)
+{
+        batch *b = self->batch;
+        size_t len;
+        while ((len = queue_length(&self->queue)) < BATCH_LIVE_JOBS ||
+               self->turns >= len) {
+                size_t i = __atomic_fetch_add(&b->next_job, 1,
+                                              __ATOMIC_RELAXED);
+                if (i >= b->num_jobs) {
+                        break;
+                }
+                self->turns = 0;
+                if (start_job(&b->jobs[i])) {
+                        return &b->jobs[i];
+                }
+                finish_job(self, &b->jobs[i]);
+        }
+        self->turns++;
+        batch_job *job = queue_take(&self->queue, true);
+        for (unsigned i = 1; job == NULL && i < b->num_workers; i++) {
+                worker *victim = &b->workers[(self->index + i) %
+                                             b->num_workers];
+                job = queue_take(&victim->queue, false);
+                if (job != NULL) {
+                        __atomic_fetch_add(&b->steals, 1, __ATOMIC_RELAXED);
+                }
+        }
+        return job;
+}
+
+/**********start_job**********************************************************
+ *
+ * Purpose:
+ *      Makes a job's machine, loads its program, and opens its input and
+ *      output
+ * Parameters:
+ *      batch_job *job: a job not yet started
+ * Returns:
+ *      true, or false if any of it failed (reported on stderr, and the
+ *      job marked failed)
+ * Expects:
+ *      job to be non-NULL
+ * Notes:
+ *      As much input as fits is fed at once; the rest when it is read
+ ****************************************************************************/
+static bool start_job(batch_job *job)
+{
+        job->start_ns = now_ns();
+        job->vm = new_um_vm();
+        const char *failed = NULL;
+        if (!job->program->mapped ||
+            !um_vm_load(job->vm, job->program->image.bytes,
+                        job->program->image.size)) {
+                failed = job->program->path;
+        } else if (job->input != NULL && !map_program(job->input, &job->in)) {
+                failed = job->input;
+        } else if ((job->out = fopen(job->output, "wb")) == NULL) {
+                failed = job->output;
+        }
+        if (failed != NULL) {
+                fprintf(stderr, "um: manifest line %zu: could not open %s\n",
+                        job->line, failed);
+                job->failed = true;
+                return false;
+        }
+        if (job->input == NULL) {
+                um_vm_end_input(job->vm);
+        } else {
+                job->in_fed = um_vm_feed(job->vm, job->in.bytes,
+                                         job->in.size);
+        }
+        return true;
+}
+
+/**********run_slice**********************************************************
+ *
+ * Purpose:
+ *      Runs a started job for one quota, and passes output and input
+ *      between its machine and its files
+ * Parameters:
+ *      worker *self: the worker running it
+ *      batch_job *job: the job
+ * Returns:
+ *      true if the job is done: its program halted
+ * Expects:
+ *      self and job to be non-NULL
+ * Notes:
+ *      A job waiting on input is given more, or end of file, and takes
+ *      its turn like one that used its quota
+ ****************************************************************************/
+static bool run_slice(worker *self, batch_job *job)
+{
+        um_vm_status status = um_vm_run(job->vm, self->batch->quota);
+        drain_output(self, job);
+        if (status == UM_VM_INPUT) {
+                if (job->input != NULL && job->in_fed < job->in.size) {
+                        job->in_fed += um_vm_feed(job->vm,
+                                                  job->in.bytes +
+                                                  job->in_fed,
+                                                  job->in.size -
+                                                  job->in_fed);
+                } else {
+                        um_vm_end_input(job->vm);
+                }
+        }
+        return status == UM_VM_HALTED;
+}
+
+/**********finish_job*********************************************************
+ *
+ * Purpose:
+ *      Writes the rest of a job's output and frees its machine and files
+ * Parameters:
+ *      worker *self: the worker that ran it last
+ *      batch_job *job: a halted or failed job
+ * Returns:
+ *      None
+ * Expects:
+ *      self and job to be non-NULL
+ * Notes:
+ *      A job whose output could not be written is reported and marked
+ *      failed
+ ****************************************************************************/
+static void finish_job(worker *self, batch_job *job)
+{
+        if (job->out != NULL) {
+                drain_output(self, job);
+                if (fclose(job->out) != 0 && !job->failed) {
+                        fprintf(stderr, "um: manifest line %zu: could not "
+                                "write %s\n", job->line, job->output);
+                        job->failed = true;
+                }
+                job->out = NULL;
+        }
+        unmap_program(&job->in);
+        free_um_vm(&job->vm);
+        job->end_ns = now_ns();
+        __atomic_fetch_sub(&self->batch->remaining, 1, __ATOMIC_RELEASE);
+}
+
+/* writes all output a job's machine has to its file */
+static void drain_output(worker *self, batch_job *job)
+{
+        size_t n;
+        while ((n = um_vm_drain(job->vm, self->drained, DRAIN_BYTES)) > 0) {
+                if (fwrite(self->drained, 1, n, job->out) != n &&
+                    !job->failed) {
+                        fprintf(stderr, "um: manifest line %zu: could not "
+                                "write %s\n", job->line, job->output);
+                        job->failed = true;
+                }
+        }
+}
+
+/* puts a job at the back of a queue */
+static void queue_push(job_queue *queue, batch_job *job)
+{
+        pthread_mutex_lock(&queue->lock);
+        if (queue->len == queue->cap) {
+                size_t cap = 2 * queue->cap + BATCH_LIVE_JOBS;
+                batch_job **ring = malloc(cap * sizeof(*ring));
+                assert(ring != NULL);
+                for (size_t i = 0; i < queue->len; i++) {
+                        ring[i] = queue->ring[(queue->first + i) %
+                                              queue->cap];
+                }
+                free(queue->ring);
+                queue->ring = ring;
+                queue->first = 0;
+                queue->cap = cap;
+        }
+        queue->ring[(queue->first + queue->len) % queue->cap] = job;
+        queue->len++;
+        pthread_mutex_unlock(&queue->lock);
+}
+
+/* takes the job at the front, or the back, of a queue; NULL if empty */
+static batch_job *queue_take(job_queue *queue, bool front)
+{
+        batch_job *job = NULL;
+        pthread_mutex_lock(&queue->lock);
+        if (queue->len > 0) {
+                queue->len--;
+                if (front) {
+                        job = queue->ring[queue->first];
+                        queue->first = (queue->first + 1) % queue->cap;
+                } else {
+                        job = queue->ring[(queue->first + queue->len) %
+                                          queue->cap];
+                }
+        }
+        pthread_mutex_unlock(&queue->lock);
+        return job;
+}
+
+/* jobs in a queue */
+static size_t queue_length(job_queue *queue)
+{
+        pthread_mutex_lock(&queue->lock);
+        size_t len = queue->len;
+        pthread_mutex_unlock(&queue->lock);
+        return len;
+}
+
+/**********report_batch*******************************************************
+ *
+ * Purpose:
+ *      Prints how many jobs ran, how fast, how long each took, and how
+ *      they were scheduled
+ * Parameters:
+ *      FILE *out: stream to print to
+ *      batch *b: a finished batch
+ *      uint64_t elapsed_ns: wall time the batch took
+ * Returns:
+ *      None
+ * Expects:
+ *      out and b to be non-NULL
+ * Notes:
+ *      Latency is from the start of the batch, when every job was
+ *      submitted, to a job's end, and wait to its first slice, failed
+ *      jobs included; percentiles are nearest rank
+ ****************************************************************************/
+static void report_batch(FILE *out, batch *b, uint64_t elapsed_ns)
+{
+        size_t failed = 0;
+        uint64_t *latency = malloc((b->num_jobs + 1) * sizeof(*latency));
+        uint64_t *wait = malloc((b->num_jobs + 1) * sizeof(*wait));
+        assert(latency != NULL && wait != NULL);
+        for (size_t i = 0; i < b->num_jobs; i++) {
+                failed += b->jobs[i].failed;
+                latency[i] = b->jobs[i].end_ns - b->start_ns;
+                wait[i] = b->jobs[i].start_ns - b->start_ns;
+        }
+        double seconds = elapsed_ns / 1e9;
+        fprintf(out, "batch            %zu jobs (%zu failed) in %.3f s on "
+                "%u worker%s: %.1f jobs/s\n", b->num_jobs, failed, seconds,
+                b->num_workers, b->num_workers == 1 ? "" : "s",
+                seconds == 0 ? 0.0 : b->num_jobs / seconds);
+        report_percentiles(out, "latency", latency, b->num_jobs);
+        report_percentiles(out, "wait", wait, b->num_jobs);
+        fprintf(out, "scheduling       %llu slices of %llu dispatches, %llu "
+                "steals\n", (unsigned long long) b->slices,
+                (unsigned long long) b->quota,
+                (unsigned long long) b->steals);
+        free(latency);
+        free(wait);
+}
+
+/* sorts n times in ns and prints their p50, p90, p99 and max, if n > 0 */
+static void report_percentiles(FILE *out, const char *label,
+                               uint64_t *values, size_t n)
+{
+        if (n == 0) {
+                return;
+        }
+        qsort(values, n, sizeof(*values), compare_u64);
+        fprintf(out, "%-16s p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, "
+                "max %.3f ms\n", label, values[rank(n, 50)] / 1e6,
+                values[rank(n, 90)] / 1e6, values[rank(n, 99)] / 1e6,
+                values[n - 1] / 1e6);
+}
+
+/* index of the nearest rank percentile of n sorted values, n > 0 */
+static size_t rank(size_t n, unsigned percent)
+{
+        return (n * percent + 99) / 100 - 1;
+}
+
+/* qsort comparison of two uint64_t */
+static int compare_u64(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *) a;
+        uint64_t y = *(const uint64_t *) b;
+        return (x > y) - (x < y);
+}
+
+/* monotonic time in nanoseconds */
+static uint64_t now_ns(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
@@ -0,0 +1,32 @@
+/*****************************************************************************
+ *
+ *                       batch.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM batch header, contains the declaration of batch mode
+ *               (./um -B): many independent runs from a manifest, on a
+ *               pool of worker threads, each machine time-sliced by a
+ *               dispatch quota (libum.h).
+ *
+ ****************************************************************************/
+#ifndef BATCH
+#define BATCH
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Dispatches a job runs before it goes to the back of its worker's queue
+ * when no quota is given
+ */
+#define BATCH_DEFAULT_QUOTA ((uint64_t) 1000000)
+
+/* Jobs a worker starts as soon as it has room for them; past this it
+ * starts one more per full turn of its queue
+ */
+#define BATCH_LIVE_JOBS 4
+
+int run_batch(const char *manifest, unsigned workers, uint64_t quota,
+              bool pin);
+#endif
@@ -0,0 +1,196 @@
+/*****************************************************************************
+ *
+ *                       block_opt.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM block optimizer module. Works on one basic block (a
+ *               straight run of instructions entered only at the top, as
+ *               compiled by jit.c) in two passes:
+ *
+ *               - forward: tracks which registers hold known constants,
+ *                 starting from Load_value, and folds Add, Multiply,
+ *                 Divide, NAND, and Conditional_move on them
+ *               - backward: marks register writes that are overwritten
+ *                 before anything can read them
+ *
+ *               Nothing is known on entry and every register is live at
+ *               the end of the block. Segment_store, Map_segment,
+ *               Unmap_segment, and Load_program may leave the block or
+ *               read registers through um_state, so every register is
+ *               live before them. A Divide is only folded or dropped when
+ *               its divisor is known not to be 0, and Segment_load is
+ *               never dropped, so faults happen exactly where they would
+ *               in the interpreter.
+ *
+ ****************************************************************************/
+#include <assert.h>
+#include "block_opt.h"
+
+#define ALL_REGS ((1u << NUM_REG) - 1)
+#define REG_BIT(reg) (1u << (reg))
+
+/**********fold_constants*****************************************************
+ *
+ * Purpose:
+ *      Forward pass: sets folded and value on every instruction whose
+ *      result is a known constant, and marks Conditional_moves that can
+ *      never move as dead
+ * Parameters:
+ *      opt_inst_t *block: instructions of the block, in order
+ *      uint32_t len: number of instructions
+ * Returns:
+ *      None
+ * Expects:
+ *      block to be non-NULL if len > 0
+ * Notes:
+ *      Arithmetic is done in uint32_t, so it wraps exactly like the UM
+ ****************************************************************************/
+static void fold_constants(opt_inst_t *block, uint32_t len)
+{
+        bool known[NUM_REG] = { false };
+        uint32_t value[NUM_REG] = { 0 };
+
+        for (uint32_t i = 0; i < len; i++) {
+                opt_inst_t *opt = &block[i];
+                inst_decoded_t inst = opt->inst;
+                unsigned A = inst.A, B = inst.B, C = inst.C;
+                bool operands = known[B] && known[C];
+                switch (inst.OP) {
+                        case LV:
+                                opt->folded = true;
+                                opt->value = inst.val;
+                                break;
+                        case ADD:
+                                opt->folded = operands;
+                                opt->value = value[B] + value[C];
+                                break;
+                        case MUL:
+                                opt->folded = operands;
+                                opt->value = value[B] * value[C];
+                                break;
+                        case DIV:
+                                opt->folded = operands && value[C] != 0;
+                                if (opt->folded) {
+                                        opt->value = value[B] / value[C];
+                                }
+                                break;
+                        case NAND:
+                                opt->folded = operands;
+                                opt->value = ~(value[B] & value[C]);
+                                break;
+                        case CMOV:
+                                if (known[C] && value[C] == 0) {
+                                        opt->dead = true;
+                                        continue;
+                                }
+                                if (known[C] && known[B]) {
+                                        opt->folded = true;
+                                        opt->value = value[B];
+                                } else if (known[A] && known[B] &&
+                                           value[A] == value[B]) {
+                                        opt->folded = true;
+                                        opt->value = value[A];
+                                }
+                                break;
+                        case SLOAD:
+                                break;
+                        case ACTIVATE:
+                                known[B] = false;
+                                continue;
+                        default:
+                                /* no register written */
+                                continue;
+                }
+                known[A] = opt->folded;
+                value[A] = opt->value;
+        }
+}
+
+/**********drop_dead_writes***************************************************
+ *
+ * Purpose:
+ *      Backward pass: marks every instruction whose only effect is a
+ *      register write that is overwritten before it can be read
+ * Parameters:
+ *      opt_inst_t *block: instructions of the block, after fold_constants
+ *      uint32_t len: number of instructions
+ * Returns:
+ *      None
+ * Expects:
+ *      block to be non-NULL if len > 0
+ * Notes:
+ *      A folded instruction reads no registers, so folding also frees the
+ *      writes that fed it.
+ ****************************************************************************/
+static void drop_dead_writes(opt_inst_t *block, uint32_t len)
+{
+        unsigned live = ALL_REGS;
+
+        for (uint32_t i = len; i-- > 0;) {
+                opt_inst_t *opt = &block[i];
+                inst_decoded_t inst = opt->inst;
+                unsigned reads;
+                bool droppable = true;
+                switch (inst.OP) {
+                        case LV:
+                                reads = 0;
+                                break;
+                        case CMOV:
+                                reads = REG_BIT(inst.A) | REG_BIT(inst.B) |
+                                        REG_BIT(inst.C);
+                                break;
+                        case SLOAD:
+                                reads = REG_BIT(inst.B) | REG_BIT(inst.C);
+                                droppable = false;
+                                break;
+                        case DIV:
+                                reads = REG_BIT(inst.B) | REG_BIT(inst.C);
+                                droppable = opt->folded;
+                                break;
+                        case ADD:
+                        case MUL:
+                        case NAND:
+                                reads = REG_BIT(inst.B) | REG_BIT(inst.C);
+                                break;
+                        default:
+                                /* may exit or read through um_state */
+                                live = ALL_REGS;
+                                continue;
+                }
+                if (opt->dead) {
+                        continue;
+                }
+                if (droppable && (live & REG_BIT(inst.A)) == 0) {
+                        opt->dead = true;
+                        continue;
+                }
+                live &= ~REG_BIT(inst.A);
+                live |= opt->folded ? 0 : reads;
+        }
+}
+
+/**********optimize_block*****************************************************
+ *
+ * Purpose:
+ *      Runs both passes over a basic block
+ * Parameters:
+ *      opt_inst_t *block: instructions of the block, in order, with
+ *                         folded and dead cleared
+ *      uint32_t len: number of instructions
+ * Returns:
+ *      None
+ * Expects:
+ *      block to be non-NULL if len > 0, and every OP to be unfused
+ * Notes:
+ *      Only annotates; instructions keep their place so UM instruction
+ *      counts and exit program counters are unchanged
+ ****************************************************************************/
+void optimize_block(opt_inst_t *block, uint32_t len)
+{
+        assert(block != NULL || len == 0);
+        fold_constants(block, len);
+        drop_dead_writes(block, len);
+}
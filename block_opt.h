@@ -0,0 +1,37 @@
+/*****************************************************************************
+ *
+ *                       block_opt.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM block optimizer header, contains the annotated form of
+ *               a basic block and the declaration of the pass that folds
+ *               constants and finds dead register writes in it.
+ *
+ ****************************************************************************/
+#ifndef BLOCK_OPT
+#define BLOCK_OPT
+#include <stdint.h>
+#include <stdbool.h>
+#include "structs_and_constants.h"
+
+/* optimized instruction struct
+ *
+ * Purpose: one instruction of a basic block and what the optimizer found
+ * Members:
+ *      - inst_decoded_t inst: the instruction, with a plain (unfused) OP
+ *      - bool folded: its register write always stores value
+ *      - bool dead: it can be skipped; nothing observes its effect
+ *      - uint32_t value: the folded result when folded is set
+ */
+typedef struct opt_inst {
+        inst_decoded_t inst;
+        bool folded;
+        bool dead;
+        uint32_t value;
+} opt_inst_t;
+
+void optimize_block(opt_inst_t *block, uint32_t len);
+#endif
@@ -0,0 +1,53 @@
+/*****************************************************************************
+ *
+ *                       check.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM checked mode. engine.c is built a third time, with
+ *               -DUM_CHECKED, as run_um_checked: there the CHECK macros of
+ *               um_ops.h test every instruction for an invalid opcode, an
+ *               unmapped segment, an offset out of bounds, a division by
+ *               zero, an output that is not a byte, or a jump past the end
+ *               of segment 0, and call check_failed on the first one. In
+ *               run_um the same macros expand to nothing, and in
+ *               run_um_safe only offsets too big for a guard are tested.
+ *
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <assert.h>
+#include "check.h"
+#include "io.h"
+
+/**********check_failed*******************************************************
+ *
+ * Purpose:
+ *      Reports an instruction that broke one of the UM's rules and exits
+ * Parameters:
+ *      um_state_t um: state of the program, um->prog_counter being the
+ *                     instruction at fault
+ *      const char *fmt, ...: printf-style description of the fault
+ * Returns:
+ *      None (exits with failure)
+ * Expects:
+ *      um to be non-NULL
+ * Notes:
+ *      Output written so far is flushed first, so the report comes after
+ *      it, in the same form as safe mode's (guard.c)
+ ****************************************************************************/
+void check_failed(um_state_t um, const char *fmt, ...)
+{
+        assert(um != NULL);
+        io_flush(um->io);
+        fprintf(stderr, "um: pc %u: ", um->prog_counter);
+        va_list args;
+        va_start(args, fmt);
+        vfprintf(stderr, fmt, args);
+        va_end(args);
+        fputc('\n', stderr);
+        exit(EXIT_FAILURE);
+}
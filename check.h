@@ -0,0 +1,20 @@
+/*****************************************************************************
+ *
+ *                       check.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM check header, contains the declaration of the function
+ *               checked mode (./um -c) calls when a program breaks one of
+ *               the UM's rules.
+ *
+ ****************************************************************************/
+#ifndef CHECKED
+#define CHECKED
+#include "engine.h"
+
+void check_failed(um_state_t um, const char *fmt, ...)
+        __attribute__((noreturn, format(printf, 2, 3)));
+#endif
@@ -0,0 +1,780 @@
+/*****************************************************************************
+ *
+ *                       checkpoint.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM checkpoints. In checkpointing mode (./um -K) the
+ *               program runs on run_um_checkpoint (engine.c), which every
+ *               so many dispatches appends a checkpoint to a log: the
+ *               registers, program counter, spine and unmapped stack, the
+ *               output written since the last one, how much input has
+ *               been read, and every chunk of the arena written since the
+ *               last one (see checkpoint_record for the layout).
+ *
+ *               Writes are found with the MMU. After each checkpoint the
+ *               arena is made read-only with one mprotect; the first write
+ *               to a chunk faults, and the SIGSEGV handler marks it dirty
+ *               and makes it writable again, so a chunk costs one fault
+ *               per interval however often it is written. Chunks handed
+ *               out since the last checkpoint are written unless they
+ *               are still all zeros.
+ *               Page-backed segments that are unmapped have their pages
+ *               zeroed without a write, so memory.c marks them dirty
+ *               itself (touch_checkpointed).
+ *
+ *               A log is only appended to, and each checkpoint ends with a
+ *               copy of its sequence number, so a run killed part way
+ *               through one leaves every checkpoint before it whole.
+ *               Restoring (./um -R) replays the chunks of every whole
+ *               checkpoint into a scratch arena, then copies each segment
+ *               of the last one into the segment pool, as snapshot.c
+ *               does, writes all the output again, and skips the input
+ *               that had been read, so a restored run given the same
+ *               input prints exactly what the first run would have.
+ *
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "checkpoint.h"
+#include "memory.h"
+#include "io.h"
+#include "structs_and_constants.h"
+
+#define BYTE_ORDER_MARK 0x01020304u
+
+/* parts of a record are padded so the words after them stay aligned */
+#define PADDED(bytes) (((bytes) + 7) / 8 * 8)
+
+/* Checkpointing state struct
+ *
+ * Purpose: the log being written, and which chunks of the arena were
+ *          written since the last checkpoint
+ * Members:
+ *      - FILE *log: the log
+ *      - const char *path: its name, for reports
+ *      - uint8_t *arena: the arena
+ *      - size_t first: first byte of the arena segments may be in
+ *      - size_t tracked_end: end of the part of the arena made read-only
+ *        at the last checkpoint; all of it past here is dirty
+ *      - uint8_t *dirty: 1 for every chunk before tracked_end written
+ *        since the last checkpoint
+ *      - uint64_t interval: dispatches between checkpoints
+ *      - uint32_t seq: checkpoints written to the log
+ *      - struct sigaction old_fault: handler replaced
+ *      - uint64_t chunks, bytes, faults: chunks and bytes written to the
+ *        log, and faults on clean chunks
+ *      - uint64_t write_ns: time spent writing checkpoints
+ */
+struct checkpoint {
+        FILE *log;
+        const char *path;
+        uint8_t *arena;
+        size_t first;
+        size_t tracked_end;
+        uint8_t *dirty;
+        uint64_t interval;
+        uint32_t seq;
+        struct sigaction old_fault;
+        uint64_t chunks, bytes, faults;
+        uint64_t write_ns;
+};
+
+/* state the fault handler works on */
+static checkpoint_t active = NULL;
+
+static bool write_record(um_state_t um, checkpoint_t ckpt);
+static bool write_padded(FILE *out, const void *data, size_t bytes);
+static bool chunk_is_zero(const uint8_t *chunk);
+static void track_writes(checkpoint_t ckpt, size_t used);
+static void untrack_writes(checkpoint_t ckpt);
+static void checkpoint_fault(int sig, siginfo_t *info, void *context);
+static size_t record_bytes(const checkpoint_record *record, size_t room);
+static bool spine_valid(checkpoint_log *log);
+static uint64_t now_ns(void);
+
+/**********start_checkpoints**************************************************
+ *
+ * Purpose:
+ *      Starts a checkpoint log for a loaded program
+ * Parameters:
+ *      um_state_t um: loaded program in arena or spill mode, about to run
+ *                     on run_um_checkpoint, with output kept (io.h)
+ *      const char *path: file to write the log to
+ *      uint64_t interval: dispatches between checkpoints
+ * Returns:
+ *      The checkpointing state, or NULL if the log could not be written
+ * Expects:
+ *      um and path to be non-NULL, interval > 0, and no other SIGSEGV
+ *      handler to be needed while it runs
+ * Notes:
+ *      Sets um->checkpoint_due. Only one can be active at a time. Must
+ *      be freed with free_checkpoints, before the arena is unmapped
+ ****************************************************************************/
+checkpoint_t start_checkpoints(um_state_t um, const char *path,
+                               uint64_t interval)
+{
+        assert(um != NULL && path != NULL && interval > 0);
+        assert(um->pool->arena != NULL && active == NULL);
+        FILE *log = fopen(path, "wb");
+        if (log == NULL) {
+                return NULL;
+        }
+        checkpoint_log_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+        header.byte_order = BYTE_ORDER_MARK;
+        header.chunk_bytes = CHECKPOINT_CHUNK_BYTES;
+        header.arena_bytes = ARENA_BYTES;
+        if (fwrite(&header, sizeof(header), 1, log) != 1 ||
+            fflush(log) != 0) {
+                fclose(log);
+                return NULL;
+        }
+
+        checkpoint_t ckpt = calloc(1, sizeof(*ckpt));
+        assert(ckpt != NULL);
+        ckpt->dirty = calloc(ARENA_BYTES / CHECKPOINT_CHUNK_BYTES,
+                             sizeof(*ckpt->dirty));
+        assert(ckpt->dirty != NULL);
+        ckpt->log = log;
+        ckpt->path = path;
+        ckpt->arena = um->pool->arena;
+        ckpt->first = ARENA_HOLE_BYTES;
+        ckpt->tracked_end = ckpt->first;
+        ckpt->interval = interval;
+        active = ckpt;
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        sigemptyset(&action.sa_mask);
+        action.sa_sigaction = checkpoint_fault;
+        action.sa_flags = SA_SIGINFO;
+        sigaction(SIGSEGV, &action, &ckpt->old_fault);
+        um->checkpoint_due = interval;
+        return ckpt;
+}
+
+/**********take_checkpoint****************************************************
+ *
+ * Purpose:
+ *      Appends a checkpoint of a running program to its log
+ * Parameters:
+ *      um_state_t um: state of a program between two instructions, with
+ *                     um->r and um->prog_counter up to date
+ *      uint64_t dispatches: dispatches run_um_checkpoint has made
+ * Returns:
+ *      The dispatch count to take the next checkpoint at
+ * Expects:
+ *      um->pool->checkpoint to be non-NULL
+ * Notes:
+ *      A log that cannot be written is reported on stderr, and no more
+ *      checkpoints are taken; the program goes on
+ ****************************************************************************/
+uint64_t take_checkpoint(um_state_t um, uint64_t dispatches)
+{
+        assert(um != NULL && um->pool->checkpoint != NULL);
+        checkpoint_t ckpt = um->pool->checkpoint;
+        if (ckpt->log == NULL) {
+                return UINT64_MAX;
+        }
+        uint64_t start = now_ns();
+        io_flush(um->io);
+        if (!write_record(um, ckpt)) {
+                fprintf(stderr, "um: could not write checkpoint %u to %s: "
+                        "%s\n", ckpt->seq + 1, ckpt->path, strerror(errno));
+                fclose(ckpt->log);
+                ckpt->log = NULL;
+                untrack_writes(ckpt);
+                return UINT64_MAX;
+        }
+        ckpt->seq++;
+        um->io->kept_len = 0;
+        track_writes(ckpt, um->pool->arena_used);
+        ckpt->write_ns += now_ns() - start;
+        return dispatches + ckpt->interval;
+}
+
+/**********touch_checkpointed*************************************************
+ *
+ * Purpose:
+ *      Makes the chunks of a range of the arena writable and dirty
+ * Parameters:
+ *      checkpoint_t ckpt: active checkpointing state
+ *      void *start: start of the range, CHECKPOINT_CHUNK_BYTES aligned
+ *      size_t bytes: size of the range, a whole number of chunks
+ * Returns:
+ *      None
+ * Expects:
+ *      ckpt to be non-NULL and the range to be in the arena
+ * Notes:
+ *      For memory.c, before it gives back the pages of a page-backed
+ *      segment: they read back as zeros without ever being written, and
+ *      a spill file will not punch out pages that are read-only
+ ****************************************************************************/
+void touch_checkpointed(checkpoint_t ckpt, void *start, size_t bytes)
+{
+        assert(ckpt != NULL);
+        size_t first = ((uint8_t *) start - ckpt->arena) /
+                       CHECKPOINT_CHUNK_BYTES;
+        size_t end = ckpt->tracked_end / CHECKPOINT_CHUNK_BYTES;
+        for (size_t chunk = first;
+             chunk < first + bytes / CHECKPOINT_CHUNK_BYTES && chunk < end;
+             chunk++) {
+                if (!ckpt->dirty[chunk]) {
+                        mprotect(ckpt->arena + chunk * CHECKPOINT_CHUNK_BYTES,
+                                 CHECKPOINT_CHUNK_BYTES,
+                                 PROT_READ | PROT_WRITE);
+                        ckpt->dirty[chunk] = 1;
+                }
+        }
+}
+
+/**********free_checkpoints***************************************************
+ *
+ * Purpose:
+ *      Closes the log, makes the arena writable, puts the old SIGSEGV
+ *      handler back, and frees the checkpointing state
+ * Parameters:
+ *      checkpoint_t *ckpt: state to free; set to NULL
+ * Returns:
+ *      None
+ * Expects:
+ *      ckpt and *ckpt to be non-NULL
+ * Notes:
+ *      No checkpoint is taken at Halt: a halted program has nothing left
+ *      to resume
+ ****************************************************************************/
+void free_checkpoints(checkpoint_t *ckpt)
+{
+        assert(ckpt != NULL && *ckpt != NULL);
+        if ((*ckpt)->log != NULL) {
+                fclose((*ckpt)->log);
+        }
+        untrack_writes(*ckpt);
+        sigaction(SIGSEGV, &(*ckpt)->old_fault, NULL);
+        free((*ckpt)->dirty);
+        free(*ckpt);
+        *ckpt = NULL;
+        active = NULL;
+}
+
+/**********report_checkpoints*************************************************
+ *
+ * Purpose:
+ *      Prints how many checkpoints were taken, how much they wrote, and
+ *      what they cost
+ * Parameters:
+ *      FILE *out: stream to print to
+ *      checkpoint_t ckpt: checkpointing state of a halted program
+ * Returns:
+ *      None
+ * Expects:
+ *      out and ckpt to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+void report_checkpoints(FILE *out, checkpoint_t ckpt)
+{
+        assert(out != NULL && ckpt != NULL);
+        fprintf(out, "checkpoints      %u every %llu dispatches, %llu chunks "
+                "(%llu KB) written in %.1f ms; %llu write faults\n",
+                ckpt->seq, (unsigned long long) ckpt->interval,
+                (unsigned long long) ckpt->chunks,
+                (unsigned long long) (ckpt->bytes / 1024),
+                ckpt->write_ns / 1e6, (unsigned long long) ckpt->faults);
+}
+
+/**********open_checkpoint_log************************************************
+ *
+ * Purpose:
+ *      Maps a checkpoint log and rebuilds the arena as of its last whole
+ *      checkpoint
+ * Parameters:
+ *      const char *path: the log
+ *      checkpoint_log *log: filled in with the mapping and the arena
+ * Returns:
+ *      true, or false if the file is not a log this build can restore
+ *      from, or holds no whole checkpoint
+ * Expects:
+ *      path and log to be non-NULL
+ * Notes:
+ *      A checkpoint cut short, and anything after it, is ignored. Must
+ *      be closed with close_checkpoint_log
+ ****************************************************************************/
+bool open_checkpoint_log(const char *path, checkpoint_log *log)
+{
+        assert(path != NULL && log != NULL);
+        log->arena = NULL;
+        log->last = NULL;
+        if (!map_program(path, &log->image)) {
+                return false;
+        }
+        const uint8_t *bytes = log->image.bytes;
+        size_t size = log->image.size;
+        const checkpoint_log_header *header =
+                (const checkpoint_log_header *) bytes;
+        if (size < sizeof(*header) ||
+            memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) ||
+            header->byte_order != BYTE_ORDER_MARK ||
+            header->chunk_bytes != CHECKPOINT_CHUNK_BYTES ||
+            header->arena_bytes != ARENA_BYTES) {
+                close_checkpoint_log(log);
+                return false;
+        }
+        void *arena = mmap(NULL, ARENA_BYTES, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                           -1, 0);
+        if (arena == MAP_FAILED) {
+                close_checkpoint_log(log);
+                return false;
+        }
+        log->arena = arena;
+
+        size_t at = sizeof(*header);
+        for (uint32_t seq = 1; ; seq++) {
+                const checkpoint_record *record =
+                        (const checkpoint_record *) (bytes + at);
+                size_t record_size = record_bytes(record, size - at);
+                if (record_size == 0 || record->seq != seq) {
+                        break;
+                }
+                const uint8_t *chunk = (const uint8_t *) record +
+                                       record_size - sizeof(uint64_t) -
+                                       record->num_chunks *
+                                       (sizeof(uint64_t) +
+                                        CHECKPOINT_CHUNK_BYTES);
+                bool whole = true;
+                for (uint32_t i = 0; whole && i < record->num_chunks; i++) {
+                        uint64_t index;
+                        memcpy(&index, chunk, sizeof(index));
+                        whole = index < record->arena_used /
+                                        CHECKPOINT_CHUNK_BYTES;
+                        if (whole) {
+                                memcpy(log->arena +
+                                       index * CHECKPOINT_CHUNK_BYTES,
+                                       chunk + sizeof(index),
+                                       CHECKPOINT_CHUNK_BYTES);
+                        }
+                        chunk += sizeof(index) + CHECKPOINT_CHUNK_BYTES;
+                }
+                if (!whole) {
+                        /* its chunks are half applied: nothing is safe */
+                        log->last = NULL;
+                        break;
+                }
+                log->last = record;
+                at += record_size;
+        }
+        if (log->last == NULL || !spine_valid(log)) {
+                close_checkpoint_log(log);
+                return false;
+        }
+        return true;
+}
+
+/**********restore_checkpoint*************************************************
+ *
+ * Purpose:
+ *      Puts a program back in the state of a log's last whole checkpoint
+ * Parameters:
+ *      um_state_t um: state with fresh memory (new_memory) whose segment 0
+ *                     is log->seg_0_len words long, and fresh I/O
+ *      const checkpoint_log *log: log from open_checkpoint_log
+ * Returns:
+ *      None
+ * Expects:
+ *      um and log to be non-NULL
+ * Notes:
+ *      Writes the output of every checkpoint up to it, and reads and
+ *      throws away the input the program had read by then. Segment 0 is
+ *      left to be decoded by the caller
+ ****************************************************************************/
+void restore_checkpoint(um_state_t um, const checkpoint_log *log)
+{
+        assert(um != NULL && log != NULL && log->last != NULL);
+        const checkpoint_record *last = log->last;
+        while (SEG(um, um->mem_seq[0])[0] < last->num_ids) {
+                grow_memory(um);
+        }
+        uint32_t *meta = SEG(um, um->mem_seq[0]);
+        for (uint32_t id = 1; id < last->num_ids; id++) {
+                if (log->spine[id - 1] == CHECKPOINT_UNMAPPED) {
+                        continue;
+                }
+                const uint32_t *saved = (const uint32_t *)
+                                        (log->arena + log->spine[id - 1]);
+                uint32_t *seg = (id == 1) ? SEG(um, um->mem_seq[1])
+                                          : seg_alloc(um->pool, saved[0]);
+                memcpy(seg + 1, saved + 1,
+                       (saved[0] - 1) * sizeof(uint32_t));
+                um->mem_seq[id] = SEG_REF(um, seg);
+        }
+        if (last->shared != 0) {
+                seg_free(um->pool, SEG(um, um->mem_seq[1]));
+                um->mem_seq[1] = um->mem_seq[last->shared];
+        }
+        meta[1] = last->num_ids;
+        meta[META_SHARED] = last->shared;
+        um->unmapped[0] = last->num_unmapped;
+        memcpy(um->unmapped + 1, log->unmapped,
+               last->num_unmapped * sizeof(uint32_t));
+        memcpy(um->r, last->r, sizeof(um->r));
+        um->prog_counter = last->prog_counter;
+
+        const uint8_t *at = log->image.bytes + sizeof(checkpoint_log_header);
+        const checkpoint_record *record;
+        do {
+                record = (const checkpoint_record *) at;
+                const uint8_t *output = (const uint8_t *) (record + 1);
+                for (uint64_t i = 0; i < record->output_bytes; i++) {
+                        io_put(um->io, output[i]);
+                }
+                at += record_bytes(record, log->image.bytes +
+                                           log->image.size - at);
+        } while (record != last);
+        io_skip(um->io, last->input_bytes);
+}
+
+/**********close_checkpoint_log***********************************************
+ *
+ * Purpose:
+ *      Unmaps a checkpoint log and the arena rebuilt from it
+ * Parameters:
+ *      checkpoint_log *log: log from open_checkpoint_log
+ * Returns:
+ *      None
+ * Expects:
+ *      log to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+void close_checkpoint_log(checkpoint_log *log)
+{
+        assert(log != NULL);
+        if (log->arena != NULL) {
+                munmap(log->arena, ARENA_BYTES);
+                log->arena = NULL;
+        }
+        unmap_program(&log->image);
+}
+
+/**********write_record*******************************************************
+ *
+ * Purpose:
+ *      Appends a checkpoint of a program to the log
+ * Parameters:
+ *      um_state_t um: state to write, output kept and flushed
+ *      checkpoint_t ckpt: checkpointing state
+ * Returns:
+ *      true, or false if a write failed or a segment is outside the arena
+ * Expects:
+ *      um and ckpt to be non-NULL
+ * Notes:
+ *      Chunks are written straight from the arena, which is readable
+ *      throughout. Chunks handed out since the last checkpoint that are
+ *      still all zeros are left out: a restored arena starts as zeros
+ ****************************************************************************/
+static bool write_record(um_state_t um, checkpoint_t ckpt)
+{
+        seg_ref_t *mem_seq = um->mem_seq;
+        uint32_t *meta = SEG(um, mem_seq[0]);
+        size_t used = um->pool->arena_used;
+        size_t first_chunk = ckpt->first / CHECKPOINT_CHUNK_BYTES;
+        size_t tracked = ckpt->tracked_end / CHECKPOINT_CHUNK_BYTES;
+        size_t end = used / CHECKPOINT_CHUNK_BYTES;
+
+        checkpoint_record record;
+        memset(&record, 0, sizeof(record));
+        record.seq = ckpt->seq + 1;
+        memcpy(record.r, um->r, sizeof(record.r));
+        record.prog_counter = um->prog_counter;
+        record.num_ids = meta[1];
+        record.shared = meta[META_SHARED];
+        record.num_unmapped = um->unmapped[0];
+        for (size_t chunk = first_chunk; chunk < end; chunk++) {
+                if (chunk >= tracked) {
+                        /* never written before: only its non-zero words
+                         * are news */
+                        ckpt->dirty[chunk] = !chunk_is_zero(ckpt->arena +
+                                chunk * CHECKPOINT_CHUNK_BYTES);
+                }
+                record.num_chunks += ckpt->dirty[chunk];
+        }
+        record.arena_used = used;
+        record.input_bytes = um->io->in_total -
+                             (um->io->in_len - um->io->in_next);
+        record.output_bytes = um->io->kept_len;
+
+        bool ok = fwrite(&record, sizeof(record), 1, ckpt->log) == 1 &&
+                  write_padded(ckpt->log, um->io->kept, um->io->kept_len) &&
+                  write_padded(ckpt->log, um->unmapped + 1,
+                               record.num_unmapped * sizeof(uint32_t));
+        for (uint32_t id = 1; ok && id < record.num_ids; id++) {
+                uint64_t offset = CHECKPOINT_UNMAPPED;
+                if (mem_seq[id] != NO_SEG && !(id == 1 && record.shared)) {
+                        offset = (uint8_t *) SEG(um, mem_seq[id]) -
+                                 ckpt->arena;
+                        if (offset < ckpt->first || offset >= used) {
+                                errno = EFAULT;
+                                return false;
+                        }
+                }
+                ok = fwrite(&offset, sizeof(offset), 1, ckpt->log) == 1;
+        }
+        for (size_t chunk = first_chunk; ok && chunk < end; chunk++) {
+                if (!ckpt->dirty[chunk]) {
+                        continue;
+                }
+                uint64_t index = chunk;
+                ok = fwrite(&index, sizeof(index), 1, ckpt->log) == 1 &&
+                     fwrite(ckpt->arena + chunk * CHECKPOINT_CHUNK_BYTES,
+                            CHECKPOINT_CHUNK_BYTES, 1, ckpt->log) == 1;
+        }
+        uint64_t seq = record.seq;
+        ok = ok && fwrite(&seq, sizeof(seq), 1, ckpt->log) == 1 &&
+             fflush(ckpt->log) == 0;
+        if (ok) {
+                ckpt->chunks += record.num_chunks;
+                ckpt->bytes += record_bytes(&record, SIZE_MAX);
+        }
+        return ok;
+}
+
+/* writes bytes of data and pads them to a multiple of 8; false if it
+ * could not */
+static bool write_padded(FILE *out, const void *data, size_t bytes)
+{
+        static const uint8_t padding[8] = { 0 };
+        size_t pad = PADDED(bytes) - bytes;
+        return fwrite(data, 1, bytes, out) == bytes &&
+               fwrite(padding, 1, pad, out) == pad;
+}
+
+/* true if a chunk holds nothing but zeros; reading an untouched one maps
+ * no memory */
+static bool chunk_is_zero(const uint8_t *chunk)
+{
+        const uint64_t *words = (const uint64_t *) chunk;
+        uint64_t any = 0;
+        for (size_t i = 0; i < CHECKPOINT_CHUNK_BYTES / sizeof(*words);
+             i++) {
+                any |= words[i];
+        }
+        return any == 0;
+}
+
+/**********track_writes*******************************************************
+ *
+ * Purpose:
+ *      Makes the arena handed out read-only and every chunk of it clean
+ * Parameters:
+ *      checkpoint_t ckpt: checkpointing state
+ *      size_t used: bytes of the arena handed out
+ * Returns:
+ *      None
+ * Expects:
+ *      ckpt to be non-NULL
+ * Notes:
+ *      If the arena cannot be made read-only, every chunk of it stays
+ *      dirty, so the next checkpoint writes them all
+ ****************************************************************************/
+static void track_writes(checkpoint_t ckpt, size_t used)
+{
+        size_t first = ckpt->first / CHECKPOINT_CHUNK_BYTES;
+        size_t end = used / CHECKPOINT_CHUNK_BYTES;
+        ckpt->tracked_end = used;
+        if (used > ckpt->first &&
+            mprotect(ckpt->arena + ckpt->first, used - ckpt->first,
+                     PROT_READ) != 0) {
+                untrack_writes(ckpt);
+                return;
+        }
+        memset(ckpt->dirty + first, 0, end - first);
+}
+
+/**********untrack_writes*****************************************************
+ *
+ * Purpose:
+ *      Makes the whole tracked arena writable and dirty
+ * Parameters:
+ *      checkpoint_t ckpt: checkpointing state
+ * Returns:
+ *      None
+ * Expects:
+ *      ckpt to be non-NULL
+ * Notes:
+ *      Also the fallback when a single chunk cannot be made writable
+ ****************************************************************************/
+static void untrack_writes(checkpoint_t ckpt)
+{
+        size_t first = ckpt->first / CHECKPOINT_CHUNK_BYTES;
+        size_t end = ckpt->tracked_end / CHECKPOINT_CHUNK_BYTES;
+        if (end > first) {
+                mprotect(ckpt->arena + ckpt->first,
+                         ckpt->tracked_end - ckpt->first,
+                         PROT_READ | PROT_WRITE);
+                memset(ckpt->dirty + first, 1, end - first);
+        }
+}
+
+/**********checkpoint_fault***************************************************
+ *
+ * Purpose:
+ *      SIGSEGV handler: marks a clean chunk that is being written dirty
+ *      and makes it writable
+ * Parameters:
+ *      int sig: SIGSEGV
+ *      siginfo_t *info: holds the faulting address
+ *      void *context: unused
+ * Returns:
+ *      None (returns to retry the write, or to refault with the handler
+ *      that was replaced)
+ * Expects:
+ *      start_checkpoints to have been called
+ * Notes:
+ *      Faults anywhere else are not ours
+ ****************************************************************************/
+static void checkpoint_fault(int sig, siginfo_t *info, void *context)
+{
+        (void) sig;
+        (void) context;
+        checkpoint_t ckpt = active;
+        uint8_t *addr = info->si_addr;
+        if (ckpt != NULL && addr >= ckpt->arena + ckpt->first &&
+            addr < ckpt->arena + ckpt->tracked_end) {
+                size_t chunk = (addr - ckpt->arena) / CHECKPOINT_CHUNK_BYTES;
+                if (!ckpt->dirty[chunk]) {
+                        if (mprotect(ckpt->arena +
+                                     chunk * CHECKPOINT_CHUNK_BYTES,
+                                     CHECKPOINT_CHUNK_BYTES,
+                                     PROT_READ | PROT_WRITE) != 0) {
+                                /* out of mappings: stop splitting them */
+                                untrack_writes(ckpt);
+                        }
+                        ckpt->dirty[chunk] = 1;
+                        ckpt->faults++;
+                        return;
+                }
+        }
+        if (ckpt != NULL) {
+                sigaction(SIGSEGV, &ckpt->old_fault, NULL);
+        } else {
+                signal(SIGSEGV, SIG_DFL);
+        }
+}
+
+/**********record_bytes*******************************************************
+ *
+ * Purpose:
+ *      Finds the size of a checkpoint record, trailer included, if it is
+ *      whole
+ * Parameters:
+ *      const checkpoint_record *record: the record
+ *      size_t room: bytes of the log from the record on
+ * Returns:
+ *      The size, or 0 if the record does not fit in room, is not
+ *      consistent, or its trailer does not match its seq
+ * Expects:
+ *      record to be non-NULL and 8-byte aligned
+ * Notes:
+ *      The trailer is only checked when room is not SIZE_MAX
+ ****************************************************************************/
+static size_t record_bytes(const checkpoint_record *record, size_t room)
+{
+        if (room < sizeof(*record) || record->num_ids < 2 ||
+            record->shared >= record->num_ids ||
+            record->num_unmapped >= record->num_ids ||
+            record->arena_used > ARENA_BYTES ||
+            record->arena_used % CHECKPOINT_CHUNK_BYTES != 0 ||
+            record->output_bytes > room) {
+                return 0;
+        }
+        uint64_t bytes = sizeof(*record) + PADDED(record->output_bytes) +
+                         PADDED(record->num_unmapped * sizeof(uint32_t)) +
+                         (record->num_ids - 1) * sizeof(uint64_t) +
+                         record->num_chunks * (sizeof(uint64_t) +
+                                               CHECKPOINT_CHUNK_BYTES) +
+                         sizeof(uint64_t);
+        if (room == SIZE_MAX) {
+                return bytes;
+        }
+        if (bytes > room) {
+                return 0;
+        }
+        uint64_t trailer;
+        memcpy(&trailer, (const uint8_t *) record + bytes - sizeof(trailer),
+               sizeof(trailer));
+        return trailer == record->seq ? bytes : 0;
+}
+
+/**********spine_valid********************************************************
+ *
+ * Purpose:
+ *      Finds the unmapped stack and segment offsets of a log's last
+ *      checkpoint, and checks that they describe memory um can restore
+ * Parameters:
+ *      checkpoint_log *log: log with last and arena set; unmapped, spine,
+ *                           and seg_0_len are filled in
+ * Returns:
+ *      true if every segment lies in the rebuilt arena, segment 0 is
+ *      there or shared, and every unmapped id is a real id
+ * Expects:
+ *      log to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+static bool spine_valid(checkpoint_log *log)
+{
+        const checkpoint_record *last = log->last;
+        const uint8_t *at = (const uint8_t *) (last + 1) +
+                            PADDED(last->output_bytes);
+        log->unmapped = (const uint32_t *) at;
+        log->spine = (const uint64_t *)
+                        (at + PADDED(last->num_unmapped * sizeof(uint32_t)));
+        for (uint32_t i = 0; i < last->num_unmapped; i++) {
+                if (log->unmapped[i] < 2 ||
+                    log->unmapped[i] >= last->num_ids) {
+                        return false;
+                }
+        }
+        for (uint32_t id = 1; id < last->num_ids; id++) {
+                uint64_t offset = log->spine[id - 1];
+                bool unmapped = offset == CHECKPOINT_UNMAPPED;
+                if ((id == 1 || id == last->shared) &&
+                    unmapped != (id == 1 && last->shared != 0)) {
+                        return false;
+                }
+                if (unmapped) {
+                        continue;
+                }
+                if (offset % sizeof(uint32_t) != 0 ||
+                    offset >= last->arena_used) {
+                        return false;
+                }
+                uint32_t words = *(const uint32_t *) (log->arena + offset);
+                if (words == 0 || (uint64_t) words * sizeof(uint32_t) >
+                    last->arena_used - offset) {
+                        return false;
+                }
+        }
+        log->seg_0_len = (last->shared != 0) ? 0 :
+                *(const uint32_t *) (log->arena + log->spine[0]) - 1;
+        return true;
+}
+
+/* monotonic time in nanoseconds */
+static uint64_t now_ns(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
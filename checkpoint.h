@@ -0,0 +1,123 @@
+/*****************************************************************************
+ *
+ *                       checkpoint.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM checkpoint header, contains declarations for
+ *               checkpointing mode (./um -K): a log the program's state is
+ *               appended to every so many instructions, each entry holding
+ *               only the memory written since the last, and for resuming
+ *               from the log's last whole entry (./um -R).
+ *
+ ****************************************************************************/
+#ifndef CHECKPOINT
+#define CHECKPOINT
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "engine.h"
+#include "load.h"
+
+/* First 8 bytes of a checkpoint log; the last is the format's version */
+#define CHECKPOINT_MAGIC "UMckpt\0\1"
+
+/* Bytes of the arena tracked, and written, as one unit */
+#define CHECKPOINT_CHUNK_BYTES ((size_t) 64 * 1024)
+
+/* Dispatches between checkpoints when no interval is given */
+#define CHECKPOINT_DEFAULT_INTERVAL ((uint64_t) 100000000)
+
+/* Checkpoint log header struct
+ *
+ * Purpose: the start of a checkpoint log, which goes on with one
+ *          checkpoint_record after another
+ * Members:
+ *      - char magic[]: CHECKPOINT_MAGIC
+ *      - uint32_t byte_order: 0x01020304, as written by the host
+ *      - uint32_t chunk_bytes: CHECKPOINT_CHUNK_BYTES
+ *      - uint64_t arena_bytes: ARENA_BYTES (memory.h) of the build that
+ *        wrote it, since arena offsets only mean anything in that build
+ */
+typedef struct checkpoint_log_header {
+        char magic[8];
+        uint32_t byte_order;
+        uint32_t chunk_bytes;
+        uint64_t arena_bytes;
+} checkpoint_log_header;
+
+/* Checkpoint record struct
+ *
+ * Purpose: the start of one checkpoint in the log, which goes on with
+ *              output_bytes bytes of output
+ *              num_unmapped words: the unmapped stack, bottom first
+ *              num_ids - 1 64-bit arena offsets: where the segment of each
+ *              index 1 ... num_ids - 1 of the spine starts, or
+ *              CHECKPOINT_UNMAPPED (also for index 1 if it is shared)
+ *              num_chunks times a 64-bit chunk number and the chunk's bytes
+ *              the record's seq again, as a 64-bit word, to show it is whole
+ *          each part padded to a multiple of 8 bytes, all in host order
+ * Members:
+ *      - uint32_t seq: 1 for the first checkpoint in the log, and so on
+ *      - uint32_t r[]: registers
+ *      - uint32_t prog_counter: where the program resumes in segment 0
+ *      - uint32_t num_ids: mem_seq[0][1], one past the highest id used
+ *      - uint32_t shared: mem_seq[0][META_SHARED]
+ *      - uint32_t num_unmapped: ids on the unmapped stack
+ *      - uint32_t num_chunks: chunks of the arena written since the last
+ *        checkpoint, and chunks handed out since then that are not all
+ *        zeros
+ *      - uint64_t arena_used: bytes of the arena handed out
+ *      - uint64_t input_bytes: input the program has read in all
+ *      - uint64_t output_bytes: output written since the last checkpoint
+ */
+typedef struct checkpoint_record {
+        uint32_t seq;
+        uint32_t r[NUM_REG];
+        uint32_t prog_counter;
+        uint32_t num_ids;
+        uint32_t shared;
+        uint32_t num_unmapped;
+        uint32_t num_chunks;
+        uint64_t arena_used;
+        uint64_t input_bytes;
+        uint64_t output_bytes;
+} checkpoint_record;
+
+#define CHECKPOINT_UNMAPPED UINT64_MAX
+
+/* Checkpoint log struct
+ *
+ * Purpose: a checkpoint log mapped for restoring
+ * Members:
+ *      - program_image image: the mapping (load.h)
+ *      - uint8_t *arena: the arena as of the last whole checkpoint,
+ *        rebuilt from every chunk up to it
+ *      - const checkpoint_record *last: the last whole checkpoint
+ *      - const uint32_t *unmapped: its unmapped stack
+ *      - const uint64_t *spine: its segment offsets
+ *      - uint32_t seg_0_len: length of segment 0, or 0 if it is shared
+ */
+typedef struct checkpoint_log {
+        program_image image;
+        uint8_t *arena;
+        const checkpoint_record *last;
+        const uint32_t *unmapped;
+        const uint64_t *spine;
+        uint32_t seg_0_len;
+} checkpoint_log;
+
+typedef struct checkpoint *checkpoint_t;
+
+checkpoint_t start_checkpoints(um_state_t um, const char *path,
+                               uint64_t interval);
+uint64_t take_checkpoint(um_state_t um, uint64_t dispatches);
+void touch_checkpointed(checkpoint_t ckpt, void *start, size_t bytes);
+void free_checkpoints(checkpoint_t *ckpt);
+void report_checkpoints(FILE *out, checkpoint_t ckpt);
+bool open_checkpoint_log(const char *path, checkpoint_log *log);
+void restore_checkpoint(um_state_t um, const checkpoint_log *log);
+void close_checkpoint_log(checkpoint_log *log);
+#endif
@@ -0,0 +1,592 @@
+/*****************************************************************************
+ *
+ *                       compress.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM compressed mode. The segment arena (memory.c) is split
+ *               into chunks of ZIP_CHUNK_BYTES, each of which is
+ *
+ *               - hot: readable and writable, as in every other mode
+ *               - armed: inaccessible, so the next access to it faults
+ *                 and makes it hot again
+ *               - compressed: its words are held compressed in a store
+ *                 of their own and its pages are given back to the OS;
+ *                 the next access faults and decompresses it ("stall")
+ *
+ *               Every period of CPU time a pass runs from SIGVTALRM: hot
+ *               chunks are armed, and chunks still armed from the last
+ *               pass, i.e. untouched for a whole period, are compressed.
+ *               Segment_load and Segment_store carry no check; a chunk is
+ *               only ever touched through the SIGSEGV handler's repairs.
+ *               Both handlers run on the one thread that runs the program
+ *               and block each other, so a pass never races an access.
+ *
+ *               The codec is run-length coding of 32-bit words, which is
+ *               cheap enough for a signal handler and fits UM memory:
+ *               freshly mapped segments are all zeros, and the unused
+ *               tail of a slab is too. A token word with RUN_BIT set is
+ *               followed by one word repeated (token & ~RUN_BIT) times;
+ *               any other token is followed by that many literal words.
+ *
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include "compress.h"
+
+#define CHUNK_WORDS (ZIP_CHUNK_BYTES / sizeof(uint32_t))
+#define RUN_BIT 0x80000000u
+
+/* shortest run worth a run token rather than literals */
+#define MIN_RUN 3
+
+/* most passes a chunk that keeps being touched, or will not shrink, is
+ * left alone for */
+#define MAX_BACKOFF 63
+
+enum { CHUNK_HOT = 0, CHUNK_ARMED, CHUNK_COMPRESSED };
+
+/* Compression state struct
+ *
+ * Purpose: where each chunk of the arena is, and what the passes did
+ * Members:
+ *      - uint8_t *arena: the arena
+ *      - size_t bytes: size of the arena
+ *      - size_t first: first byte of the arena that may be compressed
+ *      - const size_t *arena_used: bytes of the arena handed out so far
+ *        (the pool's count)
+ *      - uint8_t *state: CHUNK_* of every chunk
+ *      - uint8_t *backoff, *skip: passes a hot chunk is left alone for
+ *        after it was last touched while armed or would not shrink (which
+ *        doubles each time, up to MAX_BACKOFF), and passes left of that
+ *      - uint32_t *zwords: compressed length in words of every
+ *        compressed chunk
+ *      - uint32_t *store: one chunk-sized slot per chunk for its
+ *        compressed words; only the pages used are ever touched
+ *      - struct sigaction old_fault, old_tick: handlers replaced
+ *      - uint64_t passes, compressions, incompressible, stalls, rearms:
+ *        passes run, chunks compressed, chunks that would not shrink,
+ *        decompressions, and faults on armed chunks
+ *      - uint64_t stall_ns: time spent decompressing
+ *      - uint64_t in_bytes, out_bytes: bytes before and after every
+ *        compression
+ *      - uint64_t zipped_chunks, zipped_bytes: chunks compressed now, and
+ *        their compressed size
+ */
+struct compress {
+        uint8_t *arena;
+        size_t bytes;
+        size_t first;
+        const size_t *arena_used;
+        uint8_t *state;
+        uint8_t *backoff, *skip;
+        uint32_t *zwords;
+        uint32_t *store;
+        struct sigaction old_fault, old_tick;
+        uint64_t passes, compressions, incompressible, stalls, rearms;
+        uint64_t stall_ns;
+        uint64_t in_bytes, out_bytes;
+        uint64_t zipped_chunks, zipped_bytes;
+};
+
+/* state the signal handlers work on */
+static compress_t active = NULL;
+
+/* where a chunk is compressed to first, so one that will not shrink
+ * touches no pages of the store */
+static uint32_t scratch[ZIP_MAX_BYTES / sizeof(uint32_t)];
+
+static void compress_pass(int sig);
+static void compress_fault(int sig, siginfo_t *info, void *context);
+static void compress_chunk(compress_t zip, size_t chunk);
+static void decompress_chunk(compress_t zip, size_t chunk);
+static void drop_compressed(compress_t zip, size_t chunk);
+static void back_off(compress_t zip, size_t chunk);
+static uint32_t encode(const uint32_t *in, uint32_t n, uint32_t *out,
+                       uint32_t max);
+static void decode(const uint32_t *in, uint32_t n, uint32_t *out);
+static uint64_t now_ns(void);
+
+/**********start_compress*****************************************************
+ *
+ * Purpose:
+ *      Starts compressing chunks of the arena that go untouched for
+ *      period_ms of CPU time
+ * Parameters:
+ *      uint8_t *arena: the arena, ZIP_CHUNK_BYTES aligned
+ *      size_t bytes: size of the arena
+ *      size_t first: bytes at the start of the arena to leave alone
+ *      const size_t *arena_used: the pool's count of arena bytes in use,
+ *                                a whole number of chunks
+ *      unsigned period_ms: CPU time between passes
+ * Returns:
+ *      The compression state, or NULL if its store could not be reserved
+ * Expects:
+ *      arena and arena_used to be non-NULL, period_ms > 0, and no other
+ *      SIGSEGV or SIGVTALRM handler to be needed while it runs
+ * Notes:
+ *      Only one can be active at a time. Must be freed with
+ *      free_compress, before the arena is unmapped
+ ****************************************************************************/
+compress_t start_compress(uint8_t *arena, size_t bytes, size_t first,
+                          const size_t *arena_used, unsigned period_ms)
+{
+        assert(arena != NULL && arena_used != NULL && period_ms > 0);
+        assert(active == NULL);
+        compress_t zip = calloc(1, sizeof(*zip));
+        assert(zip != NULL);
+        size_t chunks = bytes / ZIP_CHUNK_BYTES;
+        zip->arena = arena;
+        zip->bytes = chunks * ZIP_CHUNK_BYTES;
+        zip->first = first;
+        zip->arena_used = arena_used;
+        zip->state = calloc(chunks, sizeof(*zip->state));
+        zip->backoff = calloc(chunks, sizeof(*zip->backoff));
+        zip->skip = calloc(chunks, sizeof(*zip->skip));
+        zip->zwords = calloc(chunks, sizeof(*zip->zwords));
+        void *store = mmap(NULL, zip->bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                           -1, 0);
+        if (zip->state == NULL || zip->backoff == NULL ||
+            zip->skip == NULL || zip->zwords == NULL ||
+            store == MAP_FAILED) {
+                if (store != MAP_FAILED) {
+                        munmap(store, zip->bytes);
+                }
+                free(zip->state);
+                free(zip->backoff);
+                free(zip->skip);
+                free(zip->zwords);
+                free(zip);
+                return NULL;
+        }
+        zip->store = store;
+        active = zip;
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        sigemptyset(&action.sa_mask);
+        sigaddset(&action.sa_mask, SIGSEGV);
+        sigaddset(&action.sa_mask, SIGVTALRM);
+        action.sa_sigaction = compress_fault;
+        action.sa_flags = SA_SIGINFO;
+        sigaction(SIGSEGV, &action, &zip->old_fault);
+        action.sa_handler = compress_pass;
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGVTALRM, &action, &zip->old_tick);
+
+        struct itimerval timer;
+        timer.it_interval.tv_sec = period_ms / 1000;
+        timer.it_interval.tv_usec = (period_ms % 1000) * 1000;
+        timer.it_value = timer.it_interval;
+        setitimer(ITIMER_VIRTUAL, &timer, NULL);
+        return zip;
+}
+
+/**********forget_compressed**************************************************
+ *
+ * Purpose:
+ *      Makes the chunks of a range of the arena whose pages were just
+ *      given back hot again, dropping any compressed copy of them
+ * Parameters:
+ *      compress_t zip: active compression state
+ *      void *start: start of the range, ZIP_CHUNK_BYTES aligned
+ *      size_t bytes: size of the range, a whole number of chunks
+ * Returns:
+ *      None
+ * Expects:
+ *      zip to be non-NULL and the range to be in the arena
+ * Notes:
+ *      For memory.c, after madvise(MADV_DONTNEED) on a page-backed
+ *      segment: without it, a compressed chunk of the segment would come
+ *      back with its old words rather than zeros. Passes are held off
+ *      meanwhile
+ ****************************************************************************/
+void forget_compressed(compress_t zip, void *start, size_t bytes)
+{
+        assert(zip != NULL);
+        sigset_t tick, old;
+        sigemptyset(&tick);
+        sigaddset(&tick, SIGVTALRM);
+        sigprocmask(SIG_BLOCK, &tick, &old);
+        size_t first = ((uint8_t *) start - zip->arena) / ZIP_CHUNK_BYTES;
+        for (size_t chunk = first;
+             chunk < first + bytes / ZIP_CHUNK_BYTES; chunk++) {
+                if (zip->state[chunk] == CHUNK_COMPRESSED) {
+                        drop_compressed(zip, chunk);
+                }
+                if (zip->state[chunk] != CHUNK_HOT) {
+                        mprotect(zip->arena + chunk * ZIP_CHUNK_BYTES,
+                                 ZIP_CHUNK_BYTES, PROT_READ | PROT_WRITE);
+                        zip->state[chunk] = CHUNK_HOT;
+                }
+                zip->backoff[chunk] = 0;
+                zip->skip[chunk] = 0;
+        }
+        sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+/**********free_compress******************************************************
+ *
+ * Purpose:
+ *      Stops the passes, puts the old signal handlers back, and frees the
+ *      compression state
+ * Parameters:
+ *      compress_t *zip: state to free; set to NULL
+ * Returns:
+ *      None
+ * Expects:
+ *      zip and *zip to be non-NULL
+ * Notes:
+ *      Compressed chunks are not decompressed: the arena is about to be
+ *      unmapped
+ ****************************************************************************/
+void free_compress(compress_t *zip)
+{
+        assert(zip != NULL && *zip != NULL);
+        struct itimerval off;
+        memset(&off, 0, sizeof(off));
+        setitimer(ITIMER_VIRTUAL, &off, NULL);
+        sigaction(SIGVTALRM, &(*zip)->old_tick, NULL);
+        sigaction(SIGSEGV, &(*zip)->old_fault, NULL);
+        munmap((*zip)->store, (*zip)->bytes);
+        free((*zip)->state);
+        free((*zip)->backoff);
+        free((*zip)->skip);
+        free((*zip)->zwords);
+        free(*zip);
+        *zip = NULL;
+        active = NULL;
+}
+
+/**********report_compress****************************************************
+ *
+ * Purpose:
+ *      Prints how much of the arena is compressed, how well it
+ *      compressed, and how often and how long the program stalled on a
+ *      compressed chunk
+ * Parameters:
+ *      FILE *out: stream to print to
+ *      compress_t zip: compression state of a halted program
+ * Returns:
+ *      None
+ * Expects:
+ *      out and zip to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+void report_compress(FILE *out, compress_t zip)
+{
+        assert(out != NULL && zip != NULL);
+        fprintf(out, "compressed       %llu KB now in %llu KB (%llu chunks), "
+                "%.1fx over %llu compressions, %llu would not shrink\n",
+                (unsigned long long) (zip->zipped_chunks * ZIP_CHUNK_BYTES
+                                      / 1024),
+                (unsigned long long) (zip->zipped_bytes / 1024),
+                (unsigned long long) zip->zipped_chunks,
+                zip->out_bytes == 0 ? 0.0
+                        : (double) zip->in_bytes / zip->out_bytes,
+                (unsigned long long) zip->compressions,
+                (unsigned long long) zip->incompressible);
+        fprintf(out, "decompressions   %llu stalls, %.1f ms; %llu rearms "
+                "in %llu passes\n",
+                (unsigned long long) zip->stalls, zip->stall_ns / 1e6,
+                (unsigned long long) zip->rearms,
+                (unsigned long long) zip->passes);
+}
+
+/**********compress_pass******************************************************
+ *
+ * Purpose:
+ *      SIGVTALRM handler: compresses chunks armed by the last pass, and
+ *      arms the hot ones
+ * Parameters:
+ *      int sig: SIGVTALRM
+ * Returns:
+ *      None
+ * Expects:
+ *      start_compress to have been called
+ * Notes:
+ *      Neighbouring hot chunks are armed with one mprotect. Hot chunks
+ *      backing off are passed over
+ ****************************************************************************/
+static void compress_pass(int sig)
+{
+        (void) sig;
+        compress_t zip = active;
+        if (zip == NULL) {
+                return;
+        }
+        size_t used = __atomic_load_n(zip->arena_used, __ATOMIC_RELAXED);
+        size_t end = used / ZIP_CHUNK_BYTES;
+        size_t hot_from = end;
+        zip->passes++;
+        for (size_t chunk = zip->first / ZIP_CHUNK_BYTES; chunk <= end;
+             chunk++) {
+                bool hot = chunk < end && zip->state[chunk] == CHUNK_HOT;
+                if (hot && zip->skip[chunk] > 0) {
+                        zip->skip[chunk]--;
+                        hot = false;
+                }
+                if (hot && hot_from == end) {
+                        hot_from = chunk;
+                } else if (!hot && hot_from != end) {
+                        mprotect(zip->arena + hot_from * ZIP_CHUNK_BYTES,
+                                 (chunk - hot_from) * ZIP_CHUNK_BYTES,
+                                 PROT_NONE);
+                        memset(zip->state + hot_from, CHUNK_ARMED,
+                               chunk - hot_from);
+                        hot_from = end;
+                }
+                if (chunk < end && zip->state[chunk] == CHUNK_ARMED) {
+                        compress_chunk(zip, chunk);
+                }
+        }
+}
+
+/**********compress_fault*****************************************************
+ *
+ * Purpose:
+ *      SIGSEGV handler: makes an armed or compressed chunk hot again
+ * Parameters:
+ *      int sig: SIGSEGV
+ *      siginfo_t *info: holds the faulting address
+ *      void *context: unused
+ * Returns:
+ *      None (the access is retried)
+ * Expects:
+ *      start_compress to have been called
+ * Notes:
+ *      A fault anywhere else is not ours: the old handler is put back and
+ *      the access faults again under it
+ ****************************************************************************/
+static void compress_fault(int sig, siginfo_t *info, void *context)
+{
+        (void) sig;
+        (void) context;
+        compress_t zip = active;
+        uint8_t *addr = info->si_addr;
+        if (zip != NULL && addr >= zip->arena + zip->first &&
+            addr < zip->arena + zip->bytes) {
+                size_t chunk = (addr - zip->arena) / ZIP_CHUNK_BYTES;
+                if (zip->state[chunk] == CHUNK_ARMED) {
+                        mprotect(zip->arena + chunk * ZIP_CHUNK_BYTES,
+                                 ZIP_CHUNK_BYTES, PROT_READ | PROT_WRITE);
+                        zip->state[chunk] = CHUNK_HOT;
+                        zip->rearms++;
+                        back_off(zip, chunk);
+                        return;
+                }
+                if (zip->state[chunk] == CHUNK_COMPRESSED) {
+                        decompress_chunk(zip, chunk);
+                        return;
+                }
+        }
+        if (zip != NULL) {
+                sigaction(SIGSEGV, &zip->old_fault, NULL);
+        } else {
+                signal(SIGSEGV, SIG_DFL);
+        }
+}
+
+/**********compress_chunk*****************************************************
+ *
+ * Purpose:
+ *      Compresses an armed chunk into its slot of the store and gives
+ *      its pages back, or makes it hot if it would not shrink enough
+ * Parameters:
+ *      compress_t zip: active compression state
+ *      size_t chunk: index of an armed chunk
+ * Returns:
+ *      None
+ * Expects:
+ *      chunk to be armed
+ * Notes:
+ *      None
+ ****************************************************************************/
+static void compress_chunk(compress_t zip, size_t chunk)
+{
+        uint8_t *start = zip->arena + chunk * ZIP_CHUNK_BYTES;
+        uint32_t *slot = zip->store + chunk * CHUNK_WORDS;
+        mprotect(start, ZIP_CHUNK_BYTES, PROT_READ);
+        uint32_t words = encode((const uint32_t *) start, CHUNK_WORDS,
+                                scratch, ZIP_MAX_BYTES / sizeof(uint32_t));
+        if (words == 0) {
+                mprotect(start, ZIP_CHUNK_BYTES, PROT_READ | PROT_WRITE);
+                zip->state[chunk] = CHUNK_HOT;
+                zip->incompressible++;
+                back_off(zip, chunk);
+                return;
+        }
+        memcpy(slot, scratch, words * sizeof(uint32_t));
+        madvise(start, ZIP_CHUNK_BYTES, MADV_DONTNEED);
+        mprotect(start, ZIP_CHUNK_BYTES, PROT_NONE);
+        zip->state[chunk] = CHUNK_COMPRESSED;
+        zip->backoff[chunk] = 0;
+        zip->zwords[chunk] = words;
+        zip->compressions++;
+        zip->in_bytes += ZIP_CHUNK_BYTES;
+        zip->out_bytes += words * sizeof(uint32_t);
+        zip->zipped_chunks++;
+        zip->zipped_bytes += words * sizeof(uint32_t);
+}
+
+/**********decompress_chunk***************************************************
+ *
+ * Purpose:
+ *      Puts a compressed chunk's words back and makes it hot
+ * Parameters:
+ *      compress_t zip: active compression state
+ *      size_t chunk: index of a compressed chunk
+ * Returns:
+ *      None
+ * Expects:
+ *      chunk to be compressed
+ * Notes:
+ *      Counted as a stall, with the time it took. The chunk backs off, as
+ *      it was not as idle as it looked
+ ****************************************************************************/
+static void decompress_chunk(compress_t zip, size_t chunk)
+{
+        uint64_t start_ns = now_ns();
+        uint8_t *start = zip->arena + chunk * ZIP_CHUNK_BYTES;
+        mprotect(start, ZIP_CHUNK_BYTES, PROT_READ | PROT_WRITE);
+        decode(zip->store + chunk * CHUNK_WORDS, zip->zwords[chunk],
+               (uint32_t *) start);
+        drop_compressed(zip, chunk);
+        zip->state[chunk] = CHUNK_HOT;
+        back_off(zip, chunk);
+        zip->stalls++;
+        zip->stall_ns += now_ns() - start_ns;
+}
+
+/* gives back the pages of a compressed chunk's slot */
+static void drop_compressed(compress_t zip, size_t chunk)
+{
+        madvise(zip->store + chunk * CHUNK_WORDS, ZIP_CHUNK_BYTES,
+                MADV_DONTNEED);
+        zip->zipped_chunks--;
+        zip->zipped_bytes -= zip->zwords[chunk] * sizeof(uint32_t);
+        zip->zwords[chunk] = 0;
+}
+
+/* leaves a hot chunk alone for twice as many passes as last time */
+static void back_off(compress_t zip, size_t chunk)
+{
+        uint8_t passes = zip->backoff[chunk] * 2 + 1;
+        zip->backoff[chunk] = passes > MAX_BACKOFF ? MAX_BACKOFF : passes;
+        zip->skip[chunk] = zip->backoff[chunk];
+}
+
+/**********encode*************************************************************
+ *
+ * Purpose:
+ *      Run-length codes n words
+ * Parameters:
+ *      const uint32_t *in: words to code
+ *      uint32_t n: number of words, less than RUN_BIT
+ *      uint32_t *out: where the code goes
+ *      uint32_t max: most words the code may take
+ * Returns:
+ *      Words of code written, or 0 if it would take more than max
+ * Expects:
+ *      in and out not to overlap
+ * Notes:
+ *      Runs shorter than MIN_RUN go into literals
+ ****************************************************************************/
+static uint32_t encode(const uint32_t *in, uint32_t n, uint32_t *out,
+                       uint32_t max)
+{
+        uint32_t written = 0;
+        uint32_t literal = 0;
+        uint32_t i = 0;
+        while (i <= n) {
+                uint32_t run = 0;
+                if (i < n) {
+                        run = 1;
+                        while (i + run < n && in[i + run] == in[i]) {
+                                run++;
+                        }
+                }
+                if (run >= MIN_RUN || i == n) {
+                        uint32_t count = i - literal;
+                        if (count > 0) {
+                                if (written + 1 + count > max) {
+                                        return 0;
+                                }
+                                out[written++] = count;
+                                memcpy(out + written, in + literal,
+                                       count * sizeof(uint32_t));
+                                written += count;
+                        }
+                        if (i == n) {
+                                break;
+                        }
+                        if (written + 2 > max) {
+                                return 0;
+                        }
+                        out[written++] = RUN_BIT | run;
+                        out[written++] = in[i];
+                        literal = i + run;
+                }
+                i += run;
+        }
+        return written;
+}
+
+/**********decode*************************************************************
+ *
+ * Purpose:
+ *      Expands words run-length coded by encode
+ * Parameters:
+ *      const uint32_t *in: the code
+ *      uint32_t n: words of code
+ *      uint32_t *out: where the words go; must have room for all of them
+ * Returns:
+ *      None
+ * Expects:
+ *      in to be a whole code from encode
+ * Notes:
+ *      None
+ ****************************************************************************/
+static void decode(const uint32_t *in, uint32_t n, uint32_t *out)
+{
+        uint32_t i = 0;
+        while (i < n) {
+                uint32_t token = in[i++];
+                if ((token & RUN_BIT) != 0) {
+                        uint32_t count = token & ~RUN_BIT;
+                        uint32_t word = in[i++];
+                        if (word == 0) {
+                                memset(out, 0, count * sizeof(uint32_t));
+                        } else {
+                                for (uint32_t j = 0; j < count; j++) {
+                                        out[j] = word;
+                                }
+                        }
+                        out += count;
+                } else {
+                        memcpy(out, in + i, token * sizeof(uint32_t));
+                        out += token;
+                        i += token;
+                }
+        }
+}
+
+/* monotonic time in nanoseconds, safe in a signal handler */
+static uint64_t now_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
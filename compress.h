@@ -0,0 +1,34 @@
+/*****************************************************************************
+ *
+ *                       compress.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM compression header, contains declarations for
+ *               compressed mode (./um -z): chunks of the segment arena
+ *               that go untouched for a period are compressed in memory
+ *               and decompressed by the fault their next access takes.
+ *
+ ****************************************************************************/
+#ifndef COMPRESS
+#define COMPRESS
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Bytes of the arena compressed as one unit: one slab (memory.h) */
+#define ZIP_CHUNK_BYTES ((size_t) 64 * 1024)
+
+/* A chunk is only kept compressed if it shrinks to this size or less */
+#define ZIP_MAX_BYTES (ZIP_CHUNK_BYTES / 4 * 3)
+
+typedef struct compress *compress_t;
+
+compress_t start_compress(uint8_t *arena, size_t bytes, size_t first,
+                          const size_t *arena_used, unsigned period_ms);
+void forget_compressed(compress_t zip, void *start, size_t bytes);
+void free_compress(compress_t *zip);
+void report_compress(FILE *out, compress_t zip);
+#endif
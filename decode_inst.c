@@ -69,4 +69,40 @@ inst_loadval_t decode_loadval_inst(uint32_t inst)
         decoded.A = (inst << 4) >> 29;
         decoded.val = (inst << 7) >> 7;
         return decoded;
-}
\ No newline at end of file
+}
+
+/**********decode_inst********************************************************
+ *
+ * Purpose:
+ *      decodes an instruction of either format into a single inst_decoded_t,
+ *      the form stored in each slot of the segment 0 instruction cache
+ * Parameters: 
+ *      uint32_t inst: 32-bit word to be decoded
+ * Returns: 
+ *      inst_decoded_t containing the decoded instruction
+ * Expects:
+ *      None
+ * Notes:
+ *      Register fields not used by the instruction's format are left as 0.
+ *      For three register instructions val holds the handler table index.
+ ****************************************************************************/
+inst_decoded_t decode_inst(uint32_t inst)
+{
+        inst_decoded_t decoded = { 0, 0, 0, 0, 0 };
+        decoded.OP = inst >> OP_LSB;
+        if (decoded.OP == LOADVAL_OP) {
+                inst_loadval_t loadval = decode_loadval_inst(inst);
+                decoded.A = loadval.A;
+                decoded.val = loadval.val;
+        } else {
+                inst_3reg_t three_reg = decode_3reg_inst(inst);
+                decoded.A = three_reg.A;
+                decoded.B = three_reg.B;
+                decoded.C = three_reg.C;
+                decoded.val = (decoded.OP << HANDLER_IDX_LSB) |
+                              (three_reg.A << RA_LSB) |
+                              (three_reg.B << RB_LSB) |
+                              (three_reg.C << RC_LSB);
+        }
+        return decoded;
+}
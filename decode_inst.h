@@ -17,4 +17,5 @@
 #include "structs_and_constants.h"
 
 inst_3reg_t decode_3reg_inst(uint32_t inst);
-inst_loadval_t decode_loadval_inst(uint32_t inst);
\ No newline at end of file
+inst_loadval_t decode_loadval_inst(uint32_t inst);
+inst_decoded_t decode_inst(uint32_t inst);
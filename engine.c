@@ -0,0 +1,419 @@
+/*****************************************************************************
+ *
+ *                       engine.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *     
+ *      Summary: UM engine module, runs the program in segment 0 until it
+ *               halts. Three dispatch strategies are available, chosen at
+ *               build time (see ENGINE in the Makefile):
+ *
+ *               - switch   (default) one switch on the decoded opcode
+ *               - threaded (-DUM_THREADED) GCC labels-as-values, where
+ *                          every handler ends with its own indirect jump
+ *                          to the next handler, so the branch predictor
+ *                          sees one jump site per opcode instead of one
+ *                          for the whole machine
+ *               - table    (-DUM_TABLE) each three register instruction
+ *                          calls its operand-specialized handler from
+ *                          execute_table (execute_inst.c)
+ *
+ *               All of them run the instruction bodies from um_ops.h. The
+ *               switch and threaded engines also run fused opcodes
+ *               (fusion.h) and idioms (idiom.h); the table engine has no
+ *               handlers for them.
+ *
+ *               When um->jit is set, every engine offers each jump (a
+ *               Load_program within segment 0) to the JIT tier (jit.h),
+ *               which runs hot blocks as native code and hands back the
+ *               program counter to continue interpreting from.
+ *
+ *               This file is compiled five times: once as run_um, once
+ *               with -DUM_SAFE as run_um_safe for safe mode (guard.h), once
+ *               with -DUM_CHECKED as run_um_checked for checked mode
+ *               (check.h), whose instruction bodies test their operands,
+ *               once with -DUM_CHECKPOINT as run_um_checkpoint for
+ *               checkpointing mode (checkpoint.h), and once with
+ *               -DUM_QUOTA as run_um_quota for libum (libum.h), which
+ *               returns after um->quota dispatches, or before an Input
+ *               the host has not fed, as well as at Halt. Safe and checked
+ *               mode keep um->prog_counter at the instruction they are
+ *               running so a fault can be reported against it. Safe,
+ *               checked and quota handlers are not built into
+ *               execute_table, so the safe, checked and quota table
+ *               engines run the switch loop.
+ *               Only run_um_checkpoint and run_um_quota count dispatches
+ *               against a limit, so run_um pays nothing for either.
+ *
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "engine.h"
+#ifdef UM_QUOTA
+#include "io.h"
+/* run_um_quota stops before an Input that would wait for the host; the
+ * slot is dispatched again when it runs on */
+#define INPUT_POINT()                                                         \
+        do {                                                                  \
+                if (io_starved(um->io)) {                                     \
+                        prog_counter--;                                       \
+                        dispatches--;                                         \
+                        um->stopped = RUN_STARVED;                            \
+                        goto do_halt;                                         \
+                }                                                             \
+        } while (0)
+#endif
+#include "um_ops.h"
+#include "execute_inst.h"
+#include "jit.h"
+#ifdef UM_CHECKPOINT
+#include "checkpoint.h"
+#endif
+
+#if (defined(UM_SAFE) || defined(UM_CHECKED) || defined(UM_QUOTA)) && \
+    defined(UM_TABLE)
+#undef UM_TABLE
+#endif
+
+#if !defined(UM_SAFE) && !defined(UM_CHECKED) && !defined(UM_CHECKPOINT) && \
+    !defined(UM_QUOTA)
+#ifdef UM_TABLE
+const bool engine_fuses = false;
+#else
+const bool engine_fuses = true;
+#endif
+#endif
+
+/* run_um_safe and run_um_checked publish the program counter before
+ * every dispatch, and run_um_checked makes sure it is in segment 0
+ */
+#ifdef UM_SAFE
+#define RUN_UM run_um_safe
+#define NOTE_PC() (um->prog_counter = prog_counter)
+#elif defined(UM_CHECKED)
+#define RUN_UM run_um_checked
+#define NOTE_PC()                                                             \
+        (um->prog_counter = prog_counter,                                     \
+         CHECK(prog_counter < um->len,                                        \
+               "past the end of segment 0 (%u words)", um->len))
+#elif defined(UM_CHECKPOINT)
+/* run_um_checkpoint publishes the registers and program counter when a
+ * checkpoint is due, between two instructions */
+#define RUN_UM run_um_checkpoint
+#define NOTE_PC()                                                             \
+        do {                                                                  \
+                if (dispatches >= um->checkpoint_due) {                       \
+                        memmove(um->r, r, sizeof(um->r));                     \
+                        um->prog_counter = prog_counter;                      \
+                        um->checkpoint_due = take_checkpoint(um, dispatches); \
+                }                                                             \
+        } while (0)
+#elif defined(UM_QUOTA)
+/* run_um_quota leaves through the Halt path once its quota is used up */
+#define RUN_UM run_um_quota
+#define NOTE_PC()                                                             \
+        do {                                                                  \
+                if (dispatches == um->quota) {                                \
+                        um->stopped = RUN_QUOTA;                              \
+                        goto do_halt;                                         \
+                }                                                             \
+        } while (0)
+#else
+#define RUN_UM run_um
+#define NOTE_PC() ((void) 0)
+#endif
+
+/**********run_um*************************************************************
+ *
+ * Purpose:
+ *      Executes instructions from segment 0, starting at um->prog_counter,
+ *      until a Halt instruction is reached
+ * Parameters:
+ *      um_state_t um: loaded program, memory, and decoded segment 0
+ * Returns:
+ *      None
+ * Expects:
+ *      um->cache to hold the decoded form of segment 0, and um->slots and
+ *      um->len to point at it (set_slots)
+ * Notes:
+ *      On return, um->r and um->prog_counter hold the state at the Halt
+ *      (prog_counter is just past it) and um->dispatches and
+ *      um->fused_hits have been added to. Memory is left for the caller to
+ *      free. The switch and threaded engines copy the registers into a
+ *      local array so the compiler can see they never alias a memory
+ *      segment. run_um_safe and run_um_checked are the same loop, except
+ *      that um->prog_counter is the instruction being run while it runs,
+ *      and run_um_checked exits with a report at the first invalid one.
+ *      run_um_quota may also return before the Halt, with um->prog_counter
+ *      at the next instruction to run and the reason in um->stopped.
+ ****************************************************************************/
+void RUN_UM(um_state_t um)
+{
+        uint64_t dispatches = 0;
+        uint64_t *fused_hits = um->fused_hits;
+#ifdef UM_QUOTA
+        um->stopped = RUN_HALTED;
+#endif
+#ifdef UM_TABLE
+        /* handlers reach the registers through um, so they stay in place */
+        uint32_t *r = um->r;
+        uint32_t prog_counter = um->prog_counter;
+        inst_decoded_t *slots = um->slots;
+        (void) fused_hits;
+
+        while (1) {
+                NOTE_PC();
+                inst_decoded_t inst = slots[prog_counter++];
+                dispatches++;
+                if (inst.OP == LV) {
+                        OP_LOADVAL(inst.A, inst.val);
+                } else if (inst.OP == HALT) {
+                        break;
+                } else {
+                        prog_counter = execute_table[inst.val](um,
+                                                               prog_counter);
+                        slots = um->slots;
+                        if (inst.OP == LOADP && um->jit != NULL &&
+                            jit_wants(um->jit, prog_counter)) {
+                                prog_counter = run_jit(um->jit, um,
+                                                       prog_counter);
+                        }
+                }
+        }
+#else
+        uint32_t r[NUM_REG];
+        memcpy(r, um->r, sizeof(r));
+        uint32_t prog_counter = um->prog_counter;
+        seg_ref_t *mem_seq = um->mem_seq;
+        uint32_t *unmapped = um->unmapped;
+        inst_cache_t cache = um->cache;
+        inst_decoded_t *slots = um->slots;
+        inst_decoded_t inst;
+
+/* count one execution of a fused opcode */
+#define FUSED_HIT(op) (fused_hits[(op) - FIRST_FUSED]++)
+
+/* after a jump, let the JIT run from prog_counter if the target is hot;
+ * native Map_segment may have grown the spine */
+#define JIT_ENTER()                                                           \
+        do {                                                                  \
+                if (um->jit != NULL && jit_wants(um->jit, prog_counter)) {    \
+                        memcpy(um->r, r, sizeof(r));                          \
+                        prog_counter = run_jit(um->jit, um, prog_counter);    \
+                        memcpy(r, um->r, sizeof(r));                          \
+                        mem_seq = um->mem_seq;                                \
+                        unmapped = um->unmapped;                              \
+                }                                                             \
+        } while (0)
+
+#ifdef UM_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+        static void *const dispatch[32] = {
+                &&do_cmov, &&do_sload, &&do_sstore, &&do_add, &&do_mul,
+                &&do_div, &&do_nand, &&do_halt, &&do_map, &&do_unmap,
+                &&do_out, &&do_in, &&do_loadp, &&do_loadval,
+                &&do_invalid, &&do_invalid,
+                &&do_lv_lv, &&do_lv_add, &&do_lv_mul, &&do_lv_sload,
+                &&do_lv_sstore, &&do_nand_nand, &&do_sload_sstore,
+                &&do_lv_lv_sstore, &&do_copy_loop,
+                &&do_invalid, &&do_invalid, &&do_invalid,
+                &&do_invalid, &&do_invalid, &&do_invalid, &&do_invalid
+        };
+
+/* fetch the next slot and jump straight to its handler */
+#define NEXT()                                                                \
+        do {                                                                  \
+                NOTE_PC();                                                    \
+                inst = slots[prog_counter++];                                 \
+                dispatches++;                                                 \
+                goto *dispatch[inst.OP];                                      \
+        } while (0)
+
+        NEXT();
+do_cmov:
+        OP_CMOV(inst.A, inst.B, inst.C);
+        NEXT();
+do_sload:
+        OP_SLOAD(inst.A, inst.B, inst.C);
+        NEXT();
+do_sstore:
+        OP_SSTORE(inst.A, inst.B, inst.C);
+        NEXT();
+do_add:
+        OP_ADD(inst.A, inst.B, inst.C);
+        NEXT();
+do_mul:
+        OP_MUL(inst.A, inst.B, inst.C);
+        NEXT();
+do_div:
+        OP_DIV(inst.A, inst.B, inst.C);
+        NEXT();
+do_nand:
+        OP_NAND(inst.A, inst.B, inst.C);
+        NEXT();
+do_map:
+        OP_MAP(inst.B, inst.C);
+        NEXT();
+do_unmap:
+        OP_UNMAP(inst.C);
+        NEXT();
+do_out:
+        OP_OUT(inst.C);
+        NEXT();
+do_in:
+        OP_IN(inst.C);
+        NEXT();
+do_loadp:
+        OP_LOADP(inst.B, inst.C);
+        JIT_ENTER();
+        NEXT();
+do_loadval:
+        OP_LOADVAL(inst.A, inst.val);
+        NEXT();
+do_lv_lv:
+        FUSED_HIT(LV_LV);
+        OP_LV_LV(inst);
+        NEXT();
+do_lv_add:
+        FUSED_HIT(LV_ADD);
+        OP_LV_ADD(inst);
+        NEXT();
+do_lv_mul:
+        FUSED_HIT(LV_MUL);
+        OP_LV_MUL(inst);
+        NEXT();
+do_lv_sload:
+        FUSED_HIT(LV_SLOAD);
+        OP_LV_SLOAD(inst);
+        NEXT();
+do_lv_sstore:
+        FUSED_HIT(LV_SSTORE);
+        OP_LV_SSTORE(inst);
+        NEXT();
+do_nand_nand:
+        FUSED_HIT(NAND_NAND);
+        OP_NAND_NAND(inst);
+        NEXT();
+do_sload_sstore:
+        FUSED_HIT(SLOAD_SSTORE);
+        OP_SLOAD_SSTORE(inst);
+        NEXT();
+do_lv_lv_sstore:
+        FUSED_HIT(LV_LV_SSTORE);
+        OP_LV_LV_SSTORE(inst);
+        NEXT();
+do_copy_loop:
+        if (!run_idiom(um, r, &prog_counter)) {
+                OP_LOADVAL(inst.A, inst.val);
+        }
+        NEXT();
+do_invalid:
+        /* outside checked mode opcodes 14 and 15 do nothing, as in the
+         * switch engine */
+        OP_INVALID(inst.OP);
+        NEXT();
+#undef NEXT
+#pragma GCC diagnostic pop
+#else
+        while (1) {
+                NOTE_PC();
+                inst = slots[prog_counter++];
+                dispatches++;
+                switch (inst.OP) {
+                        case CMOV:
+                                OP_CMOV(inst.A, inst.B, inst.C);
+                                break;
+                        case SLOAD:
+                                OP_SLOAD(inst.A, inst.B, inst.C);
+                                break;
+                        case SSTORE:
+                                OP_SSTORE(inst.A, inst.B, inst.C);
+                                break;
+                        case ADD:
+                                OP_ADD(inst.A, inst.B, inst.C);
+                                break;
+                        case MUL:
+                                OP_MUL(inst.A, inst.B, inst.C);
+                                break;
+                        case DIV:
+                                OP_DIV(inst.A, inst.B, inst.C);
+                                break;
+                        case NAND:
+                                OP_NAND(inst.A, inst.B, inst.C);
+                                break;
+                        case HALT:
+                                goto do_halt;
+                        case ACTIVATE:
+                                OP_MAP(inst.B, inst.C);
+                                break;
+                        case INACTIVATE:
+                                OP_UNMAP(inst.C);
+                                break;
+                        case OUT:
+                                OP_OUT(inst.C);
+                                break;
+                        case IN:
+                                OP_IN(inst.C);
+                                break;
+                        case LOADP:
+                                OP_LOADP(inst.B, inst.C);
+                                JIT_ENTER();
+                                break;
+                        case LV:
+                                OP_LOADVAL(inst.A, inst.val);
+                                break;
+                        case LV_LV:
+                                FUSED_HIT(LV_LV);
+                                OP_LV_LV(inst);
+                                break;
+                        case LV_ADD:
+                                FUSED_HIT(LV_ADD);
+                                OP_LV_ADD(inst);
+                                break;
+                        case LV_MUL:
+                                FUSED_HIT(LV_MUL);
+                                OP_LV_MUL(inst);
+                                break;
+                        case LV_SLOAD:
+                                FUSED_HIT(LV_SLOAD);
+                                OP_LV_SLOAD(inst);
+                                break;
+                        case LV_SSTORE:
+                                FUSED_HIT(LV_SSTORE);
+                                OP_LV_SSTORE(inst);
+                                break;
+                        case NAND_NAND:
+                                FUSED_HIT(NAND_NAND);
+                                OP_NAND_NAND(inst);
+                                break;
+                        case SLOAD_SSTORE:
+                                FUSED_HIT(SLOAD_SSTORE);
+                                OP_SLOAD_SSTORE(inst);
+                                break;
+                        case LV_LV_SSTORE:
+                                FUSED_HIT(LV_LV_SSTORE);
+                                OP_LV_LV_SSTORE(inst);
+                                break;
+                        case COPY_LOOP:
+                                if (!run_idiom(um, r, &prog_counter)) {
+                                        OP_LOADVAL(inst.A, inst.val);
+                                }
+                                break;
+                        default:
+                                OP_INVALID(inst.OP);
+                                break;
+                }
+        }
+#endif /* UM_THREADED */
+do_halt:
+#undef FUSED_HIT
+#undef JIT_ENTER
+        memcpy(um->r, r, sizeof(r));
+#endif /* UM_TABLE */
+        um->prog_counter = prog_counter;
+        um->dispatches += dispatches;
+}
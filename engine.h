@@ -0,0 +1,137 @@
+/*****************************************************************************
+ *
+ *                       engine.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *     
+ *      Summary: UM engine header, contains the state a loaded program runs
+ *               against and the declarations of the engine's main loops.
+ *
+ ****************************************************************************/
+#ifndef ENGINE
+#define ENGINE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "structs_and_constants.h"
+#include "inst_cache.h"
+
+/* A spine entry. Normally it is the segment's address. In the flat memory
+ * model (make MEMORY=flat) every segment is carved from one arena of at most
+ * 2^32 words, and an entry is the segment's offset in words from the start
+ * of it, um->seg_base: half the size, and every access is base + offset.
+ * SEG turns an entry into the segment's address, SEG_REF goes back, and
+ * NO_SEG is the entry of an unmapped id.
+ */
+#ifdef UM_FLAT
+typedef uint32_t seg_ref_t;
+#define SEG(um, ref) ((um)->seg_base + (ref))
+#define SEG_REF(um, seg) ((seg_ref_t) ((seg) - (um)->seg_base))
+#define NO_SEG 0
+#else
+typedef uint32_t *seg_ref_t;
+#define SEG(um, ref) (ref)
+#define SEG_REF(um, seg) (seg)
+#define NO_SEG NULL
+#endif
+
+/* Why run_um_quota returned */
+typedef enum run_stop {
+        RUN_HALTED = 0,         /* the program ran Halt */
+        RUN_QUOTA,              /* um->quota dispatches ran */
+        RUN_STARVED             /* an Input would wait for the host (io.h) */
+} run_stop;
+
+/* UM state struct
+ *
+ * Purpose: stores everything an engine needs to run a loaded program
+ * Members:
+ *      - uint32_t r[]: registers
+ *      - uint32_t prog_counter: index of the next instruction in segment 0
+ *      - uint32_t len: words in segment 0, cache->len
+ *      - seg_ref_t *mem_seq: virtual memory spine (see memory.c for layout);
+ *        segment 0 is mem_seq[1]
+ *      - uint32_t *seg_base: start of the arena spine entries are offsets
+ *        into in the flat memory model, else NULL
+ *      - inst_decoded_t *slots: decoded form of segment 0, cache->slots
+ *      - inst_cache_t cache: instruction cache slots and len come from
+ *      - uint32_t *unmapped: stack of unmapped segment ids
+ *      - struct seg_pool *pool: storage of every segment (memory.h)
+ *      - uint64_t dispatches: slots the engine has dispatched on
+ *      - uint64_t fused_hits[]: executions of each fused opcode
+ *      - uint64_t idiom_hits[]: loops run natively, per idiom (idiom.h)
+ *      - uint64_t idiom_insts: UM instructions those loops stood for,
+ *        besides the dispatch of their first slot
+ *      - struct jit *jit: JIT tier (jit.h), or NULL to only interpret
+ *      - uint64_t jit_insts: UM instructions run as native code
+ *      - struct um_io *io: buffers Output and Input go through (io.h)
+ *      - struct snapshot_request *snapshot: snapshot still to be written
+ *        (snapshot.h), or NULL
+ *      - uint64_t checkpoint_due: dispatch count run_um_checkpoint takes
+ *        the next checkpoint at (checkpoint.h)
+ *      - uint64_t quota: dispatches run_um_quota may make before it returns
+ *      - run_stop stopped: why run_um_quota last returned
+ *
+ * The members up to slots fill the first 64-byte cache line of the
+ * struct, which is aligned to one: registers, program counter, segment 0's
+ * length and slots, spine and arena base, so a dispatch touches no other
+ * line. cache and everything after it are in later lines; set_slots copies
+ * slots and len out of cache after every build.
+ */
+typedef struct um_state {
+        uint32_t r[NUM_REG];
+        uint32_t prog_counter;
+        uint32_t len;
+        seg_ref_t *mem_seq;
+        uint32_t *seg_base;
+        inst_decoded_t *slots;
+        inst_cache_t cache;
+        uint32_t *unmapped;
+        struct seg_pool *pool;
+        uint64_t dispatches;
+        uint64_t fused_hits[NUM_FUSED];
+        uint64_t idiom_hits[NUM_IDIOMS];
+        uint64_t idiom_insts;
+        struct jit *jit;
+        uint64_t jit_insts;
+        struct um_io *io;
+        struct snapshot_request *snapshot;
+        uint64_t checkpoint_due;
+        uint64_t quota;
+        run_stop stopped;
+} __attribute__((aligned(64))) *um_state_t;
+
+__extension__ _Static_assert(offsetof(struct um_state, slots) +
+                             sizeof(inst_decoded_t *) <= 64,
+                             "dispatch state must fit one cache line");
+
+/**********set_slots**********************************************************
+ *
+ * Purpose:
+ *      Points um->slots and um->len at the build um->cache holds
+ * Parameters:
+ *      um_state_t um: state whose cache was just built
+ * Returns:
+ *      None
+ * Expects:
+ *      um->cache to be non-NULL
+ * Notes:
+ *      Called after every build_inst_cache, which may move the slots
+ ****************************************************************************/
+static inline void set_slots(um_state_t um)
+{
+        um->slots = um->cache->slots;
+        um->len = um->cache->len;
+}
+
+/* true if the engine built in can run fused opcodes (fusion.h) */
+extern const bool engine_fuses;
+
+void run_um(um_state_t um);
+void run_um_safe(um_state_t um);
+void run_um_checked(um_state_t um);
+void run_um_checkpoint(um_state_t um);
+void run_um_quota(um_state_t um);
+#endif
@@ -10,13 +10,174 @@
  *               to execute UM instructions given their Opcodes, register
  *               indices, and/or values to load.
  *
+ *               Every three register instruction has one handler per
+ *               combination of registers it reads or writes, generated by
+ *               the macros below, so r[A], r[B], and r[C] are fixed offsets
+ *               into the register array rather than runtime indices. The
+ *               handlers are collected into execute_table, indexed by
+ *               (OP << 9) | the low 9 bits of the instruction.
+ *
  ****************************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
 #include "execute_inst.h"
 #include "structs_and_constants.h"
-// #include <assert.h>
-#include <string.h>
+#include "um_ops.h"
+
+/**********handler definitions************************************************
+ *
+ * Each DEFINE_* macro expands to one handler. The locals it declares are
+ * the ones the um_ops.h bodies expect to find in scope; um_ops.h documents
+ * them. Handlers for opcodes that ignore some registers are generated only
+ * for the registers they use, and the table repeats them across the rest.
+ ****************************************************************************/
+#define DEFINE_REG_OP(name, BODY, A, B, C)                                    \
+        static uint32_t exec_##name##_##A##B##C(um_state_t um,                \
+                                                uint32_t prog_counter)        \
+        {                                                                     \
+                uint32_t *r = um->r;                                          \
+                BODY(A, B, C);                                                \
+                return prog_counter;                                          \
+        }
+
+#define DEFINE_MEM_OP(name, BODY, A, B, C)                                    \
+        static uint32_t exec_##name##_##A##B##C(um_state_t um,                \
+                                                uint32_t prog_counter)        \
+        {                                                                     \
+                uint32_t *r = um->r;                                          \
+                seg_ref_t *mem_seq = um->mem_seq;                             \
+                inst_cache_t cache = um->cache;                               \
+                (void) cache;                                                 \
+                BODY(A, B, C);                                                \
+                return prog_counter;                                          \
+        }
+
+#define DEFINE_MAP(B, C)                                                      \
+        static uint32_t exec_map_##B##C(um_state_t um, uint32_t prog_counter) \
+        {                                                                     \
+                uint32_t *r = um->r;                                          \
+                seg_ref_t *mem_seq = um->mem_seq;                             \
+                uint32_t *unmapped = um->unmapped;                            \
+                OP_MAP(B, C);                                                 \
+                return prog_counter;                                          \
+        }
+
+#define DEFINE_LOADP(B, C)                                                    \
+        static uint32_t exec_loadp_##B##C(um_state_t um,                      \
+                                          uint32_t prog_counter)              \
+        {                                                                     \
+                uint32_t *r = um->r;                                          \
+                seg_ref_t *mem_seq = um->mem_seq;                             \
+                inst_cache_t cache = um->cache;                               \
+                inst_decoded_t *slots;                                        \
+                OP_LOADP(B, C);                                               \
+                (void) slots;                                                 \
+                return prog_counter;                                          \
+        }
+
+#define DEFINE_UNMAP(C)                                                       \
+        static uint32_t exec_unmap_##C(um_state_t um, uint32_t prog_counter)  \
+        {                                                                     \
+                uint32_t *r = um->r;                                          \
+                seg_ref_t *mem_seq = um->mem_seq;                             \
+                uint32_t *unmapped = um->unmapped;                            \
+                OP_UNMAP(C);                                                  \
+                return prog_counter;                                          \
+        }
+
+#define DEFINE_OUT(C)                                                         \
+        static uint32_t exec_out_##C(um_state_t um, uint32_t prog_counter)    \
+        {                                                                     \
+                uint32_t *r = um->r;                                          \
+                OP_OUT(C);                                                    \
+                return prog_counter;                                          \
+        }
+
+#define DEFINE_IN(C)                                                          \
+        static uint32_t exec_in_##C(um_state_t um, uint32_t prog_counter)     \
+        {                                                                     \
+                uint32_t *r = um->r;                                          \
+                OP_IN(C);                                                     \
+                return prog_counter;                                          \
+        }
+
+/* expand DEF once for every value of the last one, two, or three registers */
+#define FOR_C(DEF, ...)                                                       \
+        DEF(__VA_ARGS__, 0) DEF(__VA_ARGS__, 1) DEF(__VA_ARGS__, 2)           \
+        DEF(__VA_ARGS__, 3) DEF(__VA_ARGS__, 4) DEF(__VA_ARGS__, 5)           \
+        DEF(__VA_ARGS__, 6) DEF(__VA_ARGS__, 7)
+#define FOR_BC(DEF, ...)                                                      \
+        FOR_C(DEF, __VA_ARGS__, 0) FOR_C(DEF, __VA_ARGS__, 1)                 \
+        FOR_C(DEF, __VA_ARGS__, 2) FOR_C(DEF, __VA_ARGS__, 3)                 \
+        FOR_C(DEF, __VA_ARGS__, 4) FOR_C(DEF, __VA_ARGS__, 5)                 \
+        FOR_C(DEF, __VA_ARGS__, 6) FOR_C(DEF, __VA_ARGS__, 7)
+#define FOR_ABC(DEF, ...)                                                     \
+        FOR_BC(DEF, __VA_ARGS__, 0) FOR_BC(DEF, __VA_ARGS__, 1)               \
+        FOR_BC(DEF, __VA_ARGS__, 2) FOR_BC(DEF, __VA_ARGS__, 3)               \
+        FOR_BC(DEF, __VA_ARGS__, 4) FOR_BC(DEF, __VA_ARGS__, 5)               \
+        FOR_BC(DEF, __VA_ARGS__, 6) FOR_BC(DEF, __VA_ARGS__, 7)
+
+/* DEFINE_MAP etc. take no leading arguments, so give FOR_* a dummy one */
+#define DROP_FIRST_BC(dummy, B, C) DEFINE_MAP(B, C)
+#define DROP_FIRST_LOADP(dummy, B, C) DEFINE_LOADP(B, C)
+#define DROP_FIRST_UNMAP(dummy, C) DEFINE_UNMAP(C)
+#define DROP_FIRST_OUT(dummy, C) DEFINE_OUT(C)
+#define DROP_FIRST_IN(dummy, C) DEFINE_IN(C)
+
+FOR_ABC(DEFINE_REG_OP, cmov, OP_CMOV)
+FOR_ABC(DEFINE_MEM_OP, sload, OP_SLOAD)
+FOR_ABC(DEFINE_MEM_OP, sstore, OP_SSTORE)
+FOR_ABC(DEFINE_REG_OP, add, OP_ADD)
+FOR_ABC(DEFINE_REG_OP, mul, OP_MUL)
+FOR_ABC(DEFINE_REG_OP, div, OP_DIV)
+FOR_ABC(DEFINE_REG_OP, nand, OP_NAND)
+FOR_BC(DROP_FIRST_BC, x)
+FOR_C(DROP_FIRST_UNMAP, x)
+FOR_C(DROP_FIRST_OUT, x)
+FOR_C(DROP_FIRST_IN, x)
+FOR_BC(DROP_FIRST_LOADP, x)
+
+/* Halt has no body; the engine checks for it before calling a handler */
+static uint32_t exec_halt(um_state_t um, uint32_t prog_counter)
+{
+        (void) um;
+        return prog_counter;
+}
+
+static uint32_t exec_invalid(um_state_t um, uint32_t prog_counter)
+{
+        (void) um;
+        return prog_counter;
+}
+
+/**********handler table******************************************************
+ *
+ * One row of 512 entries per opcode, in opcode order. ENTRY_* macros name
+ * the handler for one (A, B, C); the FOR_* macros above expand a row.
+ ****************************************************************************/
+#define ENTRY_ABC(name, A, B, C) exec_##name##_##A##B##C,
+#define ENTRY_BC(name, A, B, C) exec_##name##_##B##C,
+#define ENTRY_C(name, A, B, C) exec_##name##_##C,
+#define ENTRY_NONE(name, A, B, C) exec_##name,
+
+exec_fn const execute_table[NUM_HANDLER_ROWS << HANDLER_IDX_LSB] = {
+        FOR_ABC(ENTRY_ABC, cmov)
+        FOR_ABC(ENTRY_ABC, sload)
+        FOR_ABC(ENTRY_ABC, sstore)
+        FOR_ABC(ENTRY_ABC, add)
+        FOR_ABC(ENTRY_ABC, mul)
+        FOR_ABC(ENTRY_ABC, div)
+        FOR_ABC(ENTRY_ABC, nand)
+        FOR_ABC(ENTRY_NONE, halt)
+        FOR_ABC(ENTRY_BC, map)
+        FOR_ABC(ENTRY_C, unmap)
+        FOR_ABC(ENTRY_C, out)
+        FOR_ABC(ENTRY_C, in)
+        FOR_ABC(ENTRY_BC, loadp)
+        FOR_ABC(ENTRY_NONE, invalid)
+        FOR_ABC(ENTRY_NONE, invalid)
+        FOR_ABC(ENTRY_NONE, invalid)
+};
 
 /**********execute********************************************************
  *
@@ -27,161 +188,23 @@
  *      uint32_t A: idx of register A
  *      uint32_t B: idx of register B
  *      uint32_t C: idx of register C
- *      mem_struct memory: virtual memory struct pointer
- *      uint32_t r[]: arr[a]y of registers
- *      uint32_t *prog_counter: pointer to progr[a]m counter
+ *      uint32_t OP: opcode
+ *      um_state_t um: registers, virtual memory, and decoded segment 0
+ *      uint32_t prog_counter: idx of the instruction after this one
  * Returns:
- *      None
+ *      the progr[a]m counter to continue from
  * Expects:
  *      - A, B, and C to be within the r[a]nge 0-7
- *      - mem to be non-NULL
+ *      - um to be non-NULL
  * Notes:
  *      For any non-Halt instruction, may change values contained within the
- *      virtual memory struct, registers arr[a]y, and/or the progr[a]m counter.
+ *      registers and virtual memory of um. Engines that already have the
+ *      table index (inst_decoded_t.val) index execute_table directly.
  ****************************************************************************/
-void execute(uint32_t A, uint32_t B, uint32_t C, uint32_t OP,
-             uint32_t **mem_seq, uint32_t *unmapped, uint32_t r[], uint32_t *prog_counter)
+uint32_t execute(uint32_t A, uint32_t B, uint32_t C, uint32_t OP,
+                 um_state_t um, uint32_t prog_counter)
 {
-        switch (OP) {
-                case 0: 
-                {
-                        if (r[C] != 0) {
-                                r[A] = r[B];
-                        }
-                        break;
-                }
-                case 1:
-                {
-                        if (r[B] == 0) {
-                                uint32_t *seg = (mem_seq)[1];
-                                r[A] = seg[r[C] + 1];
-                                return;
-                        }
-                        uint32_t *seg = (mem_seq)[r[B]];
-                        r[A] = seg[r[C] + 1];
-                        break;
-                }
-                case 2:
-                {
-                        uint32_t *segA = mem_seq[r[A]];
-                        if (r[A] == 0) {
-                                uint32_t *seg = (mem_seq)[1];
-                                seg[r[B] + 1] = r[C];
-                                return;
-                        }
-                        segA[r[B] + 1] = r[C];
-                        break;
-                }
-                case 3:
-                {
-                        r[A] = (r[B] + r[C]);
-                        break;
-                }
-                case 4:
-                {
-                        r[A] = (r[B] * r[C]);
-                        break;
-                }
-                case 5:
-                {
-                        r[A] = (r[B] / r[C]);
-                        break;
-                }
-                case 6:
-                {
-                        r[A] = ~(r[B] & r[C]);
-                        break;
-                }
-                case 7:
-                {
-                        uint32_t num_segs = (mem_seq[0][1]);
-                        for (long seg = 0; seg < num_segs; seg++) {
-                                uint32_t *curr_seg = (mem_seq)[seg];
-                                if (curr_seg != NULL) {
-                                        free(curr_seg);
-                                }
-                        }
-                        free(mem_seq);
-                        free(unmapped);
-                        exit(0);
-                        break;
-                }
-                case 8:
-                {
-                        uint32_t *new_seg = calloc(((size_t) r[C]) + 1, sizeof(uint32_t));
-                        new_seg[0] = r[C] + 1;
-                        uint32_t unmapped_size = unmapped[0];
-                        if (unmapped_size != 0) {
-                                uint32_t unmapped_id = unmapped[unmapped_size];
-                                (mem_seq)[unmapped_id] = new_seg;
-                                r[B] = unmapped_id;
-                                unmapped[0]--;
-                        } else {
-                                uint32_t *meta = mem_seq[0];
-                                uint32_t seg_id = meta[1];
-                                (mem_seq)[seg_id] = new_seg;
-                                r[B] = seg_id;
-                                meta[1] = seg_id + 1;
-                        }
-                        break;
-                }
-                case 9:
-                {
-                        /* free segment being unmapped */
-                        uint32_t *seg = (mem_seq)[r[C]];
-                        free(seg);
-
-                        /* set pointer in mem_struct to NULL and add id to unmapped sequence */
-                        mem_seq[r[C]] = NULL;
-                        unmapped[unmapped[0] + 1] = r[C];
-                        unmapped[0]++;
-                        break;
-                }
-                case 10:
-                {
-                        if (r[C] == (uint32_t) ~0) {
-                                return;
-                        }
-                        /* otherwise, print char of value at r[C] */
-                        putc(r[C], stdout);
-                        break;
-                }
-                case 11:
-                {
-                        int val = getc(stdin);
-
-                        /* if input reaches EOF, fill r[C] with all 1's, otherwise just
-                        * put int value of input char in r[C]
-                        */
-                        if (val != EOF) {
-                                r[C] = (uint32_t) val;
-                        } else {
-                                r[C] = (uint32_t) ~0;
-                        }
-                        break;
-                }
-                case 12:
-                {
-                        *prog_counter = r[C];
-        
-                        /* if loading progr[a]m from mem[0] just return */
-                        if (r[B] == 0) {
-                                return;
-                        }
-                        
-                        /* otherwise, copy segment from r[B] into mem[0] and free the 
-                        * previous contents of m[0]
-                        */
-                        uint32_t *old_prog = (mem_seq)[1];
-                        uint32_t *prog_seg = (mem_seq)[r[B]];
-                        size_t prog_bytes = (prog_seg[0] + 1) * 4;
-                        uint32_t *prog_copy = malloc(prog_bytes);
-                        memcpy(prog_copy, prog_seg, prog_bytes);
-                        free(old_prog);
-                        mem_seq[1] = prog_copy;
-                        break;
-                }
-                default:
-                        {break;}
-        }
-}
\ No newline at end of file
+        uint32_t idx = (OP << HANDLER_IDX_LSB) | (A << RA_LSB) |
+                       (B << RB_LSB) | (C << RC_LSB);
+        return execute_table[idx](um, prog_counter);
+}
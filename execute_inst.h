@@ -11,12 +11,27 @@
  *               indices, and/or values to load.
  *
  ****************************************************************************/
+#ifndef EXECUTE_INST
+#define EXECUTE_INST
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include "uarray.h"
 #include "structs_and_constants.h"
+#include "engine.h"
 
-void execute(uint32_t A, uint32_t B, uint32_t C, uint32_t OP,
-             uint32_t **mem_seq, uint32_t *unmapped, uint32_t registers[],
-             uint32_t *prog_counter);
\ No newline at end of file
+/* Number of rows in the handler table: one per 4-bit opcode. Row 13
+ * (Load_value) is never used, and rows 14 and 15 do nothing.
+ */
+#define NUM_HANDLER_ROWS 16
+
+/* A three register handler runs one opcode with its A, B, and C baked in
+ * as constants, and returns the program counter to continue from.
+ */
+typedef uint32_t (*exec_fn)(um_state_t um, uint32_t prog_counter);
+
+extern exec_fn const execute_table[NUM_HANDLER_ROWS << HANDLER_IDX_LSB];
+
+uint32_t execute(uint32_t A, uint32_t B, uint32_t C, uint32_t OP,
+                 um_state_t um, uint32_t prog_counter);
+#endif
@@ -0,0 +1,223 @@
+/*****************************************************************************
+ *
+ *                       fusion.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *     
+ *      Summary: UM fusion module, rewrites recurring 2-3 instruction
+ *               sequences in decoded segment 0 into one fused slot so the
+ *               engine dispatches once for the whole sequence.
+ *
+ *               Only the first slot of a sequence is rewritten: its OP
+ *               becomes the fused opcode and its other fields are left
+ *               alone. The slots after it keep their normal decoding, so
+ *               the engine reads their fields from there, and a jump into
+ *               the middle of a sequence still runs the right code.
+ *
+ *               The sequences were picked from dynamic opcode-pair counts
+ *               on umbin/midmark.um and umbin/sandmark.umz, where Load_value
+ *               followed by Segment_load or Segment_store alone makes up
+ *               about 30% of all pairs.
+ *
+ ****************************************************************************/
+#include <stdio.h>
+#include <assert.h>
+#include "fusion.h"
+
+/* fusion struct
+ *
+ * Purpose: describes the sequence one fused opcode replaces
+ * Members:
+ *      - uint8_t ops[]: opcodes of the sequence, in order
+ *      - uint8_t len: number of instructions in the sequence
+ *      - const char *name: name used in the fusion report
+ */
+static const struct fusion {
+        uint8_t ops[MAX_FUSED_LEN];
+        uint8_t len;
+        const char *name;
+} fusions[NUM_FUSED] = {
+        [LV_LV - FIRST_FUSED]        = { { LV, LV },         2, "lv+lv" },
+        [LV_ADD - FIRST_FUSED]       = { { LV, ADD },        2, "lv+add" },
+        [LV_MUL - FIRST_FUSED]       = { { LV, MUL },        2, "lv+mul" },
+        [LV_SLOAD - FIRST_FUSED]     = { { LV, SLOAD },      2, "lv+sload" },
+        [LV_SSTORE - FIRST_FUSED]    = { { LV, SSTORE },     2, "lv+sstore" },
+        [NAND_NAND - FIRST_FUSED]    = { { NAND, NAND },     2, "nand+nand" },
+        [SLOAD_SSTORE - FIRST_FUSED] = { { SLOAD, SSTORE },  2,
+                                         "sload+sstore" },
+        [LV_LV_SSTORE - FIRST_FUSED] = { { LV, LV, SSTORE }, 3,
+                                         "lv+lv+sstore" },
+};
+
+/**********match_fusion*******************************************************
+ *
+ * Purpose:
+ *      Finds the longest fusion whose sequence starts at slots[idx]
+ * Parameters: 
+ *      const inst_decoded_t *slots: decoded segment 0
+ *      uint32_t idx: index of the first instruction of the sequence
+ *      uint32_t len: number of slots
+ * Returns: 
+ *      the fused opcode, or 0 if no sequence matches
+ * Expects:
+ *      slots to hold only plain (unfused) opcodes from idx on
+ * Notes:
+ *      None
+ ****************************************************************************/
+static uint8_t match_fusion(const inst_decoded_t *slots, uint32_t idx,
+                            uint32_t len)
+{
+        uint8_t best = 0;
+        unsigned best_len = 0;
+        for (unsigned f = 0; f < NUM_FUSED; f++) {
+                unsigned f_len = fusions[f].len;
+                if (f_len <= best_len || f_len > len - idx) {
+                        continue;
+                }
+                unsigned i = 0;
+                while (i < f_len && slots[idx + i].OP == fusions[f].ops[i]) {
+                        i++;
+                }
+                if (i == f_len) {
+                        best = FIRST_FUSED + f;
+                        best_len = f_len;
+                }
+        }
+        return best;
+}
+
+/**********fuse_insts*********************************************************
+ *
+ * Purpose:
+ *      Rewrites every fusable sequence in decoded segment 0, scanning left
+ *      to right and taking the longest match at each instruction
+ * Parameters: 
+ *      inst_decoded_t *slots: freshly decoded segment 0
+ *      uint32_t len: number of slots
+ *      uint64_t sites[]: per fused opcode count of rewritten sequences,
+ *                        added to so it accumulates over every load
+ * Returns: 
+ *      None
+ * Expects:
+ *      slots to be non-NULL if len is nonzero
+ * Notes:
+ *      Instructions inside a rewritten sequence are not considered as the
+ *      start of another one.
+ ****************************************************************************/
+void fuse_insts(inst_decoded_t *slots, uint32_t len, uint64_t sites[])
+{
+        uint32_t idx = 0;
+        while (idx < len) {
+                uint8_t fused = match_fusion(slots, idx, len);
+                if (fused == 0) {
+                        idx++;
+                        continue;
+                }
+                slots[idx].OP = fused;
+                sites[fused - FIRST_FUSED]++;
+                idx += fusions[fused - FIRST_FUSED].len;
+        }
+}
+
+/**********unfuse_inst********************************************************
+ *
+ * Purpose:
+ *      Restores the plain opcode of any fused sequence that covers
+ *      slots[idx], after that word of segment 0 has been overwritten
+ * Parameters: 
+ *      inst_decoded_t *slots: decoded segment 0
+ *      uint32_t idx: index of the overwritten (and already re-decoded) word
+ * Returns: 
+ *      None
+ * Expects:
+ *      slots[idx] to already hold the decoding of the new word
+ * Notes:
+ *      Only sequences starting in the MAX_FUSED_LEN - 1 slots before idx
+ *      can cover it. The fused slot's other fields were never changed, so
+ *      putting back the sequence's first opcode is enough.
+ ****************************************************************************/
+void unfuse_inst(inst_decoded_t *slots, uint32_t idx)
+{
+        for (uint32_t back = 1; back < MAX_FUSED_LEN && back <= idx; back++) {
+                uint8_t op = slots[idx - back].OP;
+                if (op < FIRST_FUSED || op >= END_FUSED) {
+                        continue;
+                }
+                const struct fusion *f = &fusions[op - FIRST_FUSED];
+                if (f->len > back) {
+                        slots[idx - back].OP = f->ops[0];
+                }
+        }
+}
+
+/**********unfused_op*********************************************************
+ *
+ * Purpose:
+ *      Gives the plain opcode of the instruction in a slot
+ * Parameters: 
+ *      uint8_t op: opcode stored in the slot, fused or not
+ * Returns: 
+ *      op itself if it is not fused, else the first opcode of its sequence
+ * Expects:
+ *      None
+ * Notes:
+ *      For passes that work one instruction at a time (e.g. the JIT)
+ ****************************************************************************/
+uint8_t unfused_op(uint8_t op)
+{
+        if (op < FIRST_FUSED || op >= END_FUSED) {
+                return op;
+        }
+        return fusions[op - FIRST_FUSED].ops[0];
+}
+
+/**********fused_insts_saved**************************************************
+ *
+ * Purpose:
+ *      Counts the dispatches fusion avoided
+ * Parameters: 
+ *      const uint64_t hits[]: per fused opcode count of executions
+ * Returns: 
+ *      number of UM instructions run without a dispatch of their own
+ * Expects:
+ *      None
+ * Notes:
+ *      Instructions executed = dispatches + fused_insts_saved(hits)
+ ****************************************************************************/
+uint64_t fused_insts_saved(const uint64_t hits[])
+{
+        uint64_t saved = 0;
+        for (unsigned f = 0; f < NUM_FUSED; f++) {
+                saved += hits[f] * (fusions[f].len - 1);
+        }
+        return saved;
+}
+
+/**********report_fusion******************************************************
+ *
+ * Purpose:
+ *      Prints which fusions fired: how many sequences were rewritten and
+ *      how many times each fused slot ran
+ * Parameters: 
+ *      FILE *out: stream to print to
+ *      const uint64_t sites[]: per fused opcode count of rewritten sequences
+ *      const uint64_t hits[]: per fused opcode count of executions
+ * Returns: 
+ *      None
+ * Expects:
+ *      out to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+void report_fusion(FILE *out, const uint64_t sites[], const uint64_t hits[])
+{
+        assert(out != NULL);
+        fprintf(out, "%-16s %12s %16s\n", "fusion", "sites", "executions");
+        for (unsigned f = 0; f < NUM_FUSED; f++) {
+                fprintf(out, "%-16s %12llu %16llu\n", fusions[f].name,
+                        (unsigned long long) sites[f],
+                        (unsigned long long) hits[f]);
+        }
+}
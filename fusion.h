@@ -0,0 +1,38 @@
+/*****************************************************************************
+ *
+ *                       fusion.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *     
+ *      Summary: UM fusion header, contains the fused opcodes and the
+ *               declarations for the pass that rewrites common instruction
+ *               sequences in decoded segment 0 into single fused slots.
+ *
+ ****************************************************************************/
+#ifndef FUSION
+#define FUSION
+#include <stdio.h>
+#include <stdint.h>
+#include "structs_and_constants.h"
+
+/* Fused opcodes are numbered after the 16 opcodes a UM word can encode.
+ * Each names the sequence it replaces, first instruction first.
+ */
+typedef enum fused_opcode {
+        FIRST_FUSED = 16,
+        LV_LV = FIRST_FUSED, LV_ADD, LV_MUL, LV_SLOAD, LV_SSTORE,
+        NAND_NAND, SLOAD_SSTORE, LV_LV_SSTORE,
+        END_FUSED
+} fused_opcode;
+
+#define NUM_FUSED (END_FUSED - FIRST_FUSED)
+#define MAX_FUSED_LEN 3
+
+void fuse_insts(inst_decoded_t *slots, uint32_t len, uint64_t sites[]);
+void unfuse_inst(inst_decoded_t *slots, uint32_t idx);
+uint8_t unfused_op(uint8_t op);
+uint64_t fused_insts_saved(const uint64_t hits[]);
+void report_fusion(FILE *out, const uint64_t sites[], const uint64_t hits[]);
+#endif
@@ -0,0 +1,303 @@
+/*****************************************************************************
+ *
+ *                       guard.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM safe mode. Segment_load and Segment_store never compare
+ *               an offset against a segment's length; instead, in safe
+ *               mode every segment gets a mapping of its own, laid out as
+ *
+ *                 [ pages holding the segment ][ GUARD_BYTES, no access ]
+ *
+ *               with the segment's last word right before the guard. An
+ *               offset past the end lands in the guard and faults, and the
+ *               SIGSEGV handler finds whose guard it was and reports the
+ *               program counter (kept by run_um_safe), the segment id, and
+ *               the offset, then exits. An offset of GUARD_WORDS or more
+ *               could reach past the guard, so those alone are compared
+ *               against the segment's length (um_ops.h) and reported the
+ *               same way; otherwise in-bounds accesses run exactly the code
+ *               they run outside safe mode.
+ *
+ *               Segments of unmapped ids are NULL in the spine, so using
+ *               one faults near address 0 and is reported as well.
+ *
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "guard.h"
+#include "io.h"
+
+/* state the fault handler reports on */
+static um_state_t guarded_um = NULL;
+
+static size_t data_bytes(uint32_t cls);
+static uint8_t *map_guarded(size_t bytes);
+static void report_fault(int sig, siginfo_t *info, void *context);
+
+/**********guarded_alloc******************************************************
+ *
+ * Purpose:
+ *      Gets zeroed storage for a segment that ends right at a guard
+ * Parameters:
+ *      seg_pool_t pool: pool in safe mode
+ *      uint32_t words: length of the segment + 1
+ * Returns:
+ *      The segment, with words in word [0] and every other word 0
+ * Expects:
+ *      pool to be non-NULL and words to be at least 1
+ * Notes:
+ *      Mappings are sized by size class (memory.h) and recycled through
+ *      the pool's free lists, so a Map_segment that finds one costs no
+ *      system call; the segment is placed so it ends where the mapping's
+ *      guard starts. Each live segment takes two of the process's memory
+ *      mappings (see /proc/sys/vm/max_map_count); running out even after
+ *      unmapping the idle ones is reported and exits, since safe mode
+ *      cannot fall back to unguarded storage. Must be freed with
+ *      guarded_free
+ ****************************************************************************/
+uint32_t *guarded_alloc(seg_pool_t pool, uint32_t words)
+{
+        uint32_t cls = size_class(words);
+        size_t bytes = data_bytes(cls);
+        uint8_t *base = (uint8_t *) pool->free_lists[cls];
+        if (base != NULL) {
+                pool->free_lists[cls] = *(uint32_t **) base;
+                pool->recycled++;
+        } else {
+                base = map_guarded(bytes);
+                if (base == NULL) {
+                        /* out of mappings: give back the idle ones, retry */
+                        release_guarded_free_lists(pool);
+                        base = map_guarded(bytes);
+                }
+                if (base == NULL) {
+                        fprintf(stderr, "um: safe mode could not map a "
+                                "segment of %u words (too many segments "
+                                "for vm.max_map_count?)\n", words - 1);
+                        exit(EXIT_FAILURE);
+                }
+                pool->paged++;
+        }
+        uint32_t *seg = (uint32_t *) (base + bytes) - words;
+        memset(seg, 0, ((size_t) words) * sizeof(uint32_t));
+        seg[0] = words;
+        return seg;
+}
+
+/**********guarded_free*******************************************************
+ *
+ * Purpose:
+ *      Puts the mapping of a segment from guarded_alloc on its class's
+ *      free list
+ * Parameters:
+ *      seg_pool_t pool: pool in safe mode
+ *      uint32_t *seg: segment, with its length + 1 in word [0]
+ * Returns:
+ *      None
+ * Expects:
+ *      pool and seg to be non-NULL
+ * Notes:
+ *      Mappings bigger than a slab give their pages back to the OS first
+ ****************************************************************************/
+void guarded_free(seg_pool_t pool, uint32_t *seg)
+{
+        uint32_t cls = size_class(seg[0]);
+        size_t bytes = data_bytes(cls);
+        uint8_t *base = (uint8_t *) (seg + seg[0]) - bytes;
+        if (CLASS_WORDS(cls) > SLAB_WORDS) {
+                madvise(base, bytes, MADV_DONTNEED);
+                pool->released++;
+        }
+        *(uint32_t **) base = pool->free_lists[cls];
+        pool->free_lists[cls] = (uint32_t *) base;
+}
+
+/**********release_guarded****************************************************
+ *
+ * Purpose:
+ *      Unmaps a segment from guarded_alloc, guard included
+ * Parameters:
+ *      uint32_t *seg: segment, with its length + 1 in word [0]
+ * Returns:
+ *      None
+ * Expects:
+ *      seg to be non-NULL
+ * Notes:
+ *      For free_memory; the pool is not updated
+ ****************************************************************************/
+void release_guarded(uint32_t *seg)
+{
+        size_t bytes = data_bytes(size_class(seg[0]));
+        uint8_t *base = (uint8_t *) (seg + seg[0]) - bytes;
+        munmap(base, bytes + GUARD_BYTES);
+}
+
+/**********release_guarded_free_lists*****************************************
+ *
+ * Purpose:
+ *      Unmaps every mapping on the pool's free lists
+ * Parameters:
+ *      seg_pool_t pool: pool in safe mode
+ * Returns:
+ *      None
+ * Expects:
+ *      pool to be non-NULL
+ * Notes:
+ *      For free_memory; leaves the free lists empty
+ ****************************************************************************/
+void release_guarded_free_lists(seg_pool_t pool)
+{
+        for (uint32_t cls = 0; cls < NUM_SIZE_CLASSES; cls++) {
+                uint8_t *base = (uint8_t *) pool->free_lists[cls];
+                while (base != NULL) {
+                        uint8_t *next = (uint8_t *) *(uint32_t **) base;
+                        munmap(base, data_bytes(cls) + GUARD_BYTES);
+                        base = next;
+                }
+                pool->free_lists[cls] = NULL;
+        }
+}
+
+/**********install_fault_report***********************************************
+ *
+ * Purpose:
+ *      Makes a fault in a guard report the failing access and exit
+ * Parameters:
+ *      um_state_t um: state of the program about to run in safe mode
+ * Returns:
+ *      None
+ * Expects:
+ *      um to be non-NULL, with all of its segments from guarded_alloc
+ * Notes:
+ *      Faults that are not in a guard still crash as usual
+ ****************************************************************************/
+void install_fault_report(um_state_t um)
+{
+        assert(um != NULL);
+        guarded_um = um;
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = report_fault;
+        action.sa_flags = SA_SIGINFO | SA_RESETHAND;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, NULL);
+}
+
+/**********data_bytes*********************************************************
+ *
+ * Purpose:
+ *      Finds the size of the accessible part of a guarded mapping
+ * Parameters:
+ *      uint32_t cls: size class of the mapping
+ * Returns:
+ *      The class's words, rounded up to whole pages
+ * Expects:
+ *      cls < NUM_SIZE_CLASSES
+ * Notes:
+ *      None
+ ****************************************************************************/
+static size_t data_bytes(uint32_t cls)
+{
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        size_t bytes = CLASS_WORDS(cls) * sizeof(uint32_t);
+        return (bytes + page - 1) / page * page;
+}
+
+/**********map_guarded********************************************************
+ *
+ * Purpose:
+ *      Maps bytes of zeroed memory followed by a guard
+ * Parameters:
+ *      size_t bytes: accessible bytes, a whole number of pages
+ * Returns:
+ *      The start of the mapping, or NULL if it could not be made
+ * Expects:
+ *      None
+ * Notes:
+ *      None
+ ****************************************************************************/
+static uint8_t *map_guarded(size_t bytes)
+{
+        uint8_t *base = mmap(NULL, bytes + GUARD_BYTES, PROT_NONE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                             -1, 0);
+        if (base == MAP_FAILED) {
+                return NULL;
+        }
+        if (mprotect(base, bytes, PROT_READ | PROT_WRITE) != 0) {
+                munmap(base, bytes + GUARD_BYTES);
+                return NULL;
+        }
+        return base;
+}
+
+/**********report_fault*******************************************************
+ *
+ * Purpose:
+ *      SIGSEGV handler: reports an access past the end of a segment, or
+ *      to an unmapped segment, and exits
+ * Parameters:
+ *      int sig: SIGSEGV
+ *      siginfo_t *info: holds the faulting address
+ *      void *context: unused
+ * Returns:
+ *      None (exits, or returns to refault with the default action)
+ * Expects:
+ *      install_fault_report to have been called
+ * Notes:
+ *      Output written so far is flushed first, so the report comes after
+ *      it. um->prog_counter is the instruction run_um_safe was running.
+ *      Ids are checked before they are used (CHECK_MAPPED in um_ops.h),
+ *      which names the segment, so the unmapped case is only a fallback
+ *      for a spine entry that was never checked.
+ ****************************************************************************/
+static void report_fault(int sig, siginfo_t *info, void *context)
+{
+        (void) sig;
+        (void) context;
+        uintptr_t addr = (uintptr_t) info->si_addr;
+        seg_ref_t *mem_seq = guarded_um->mem_seq;
+        uint32_t num_ids = SEG(guarded_um, mem_seq[0])[1];
+        uint32_t pc = guarded_um->prog_counter;
+        char msg[160];
+        int len = 0;
+
+        for (uint32_t id = 1; id < num_ids && len == 0; id++) {
+                if (mem_seq[id] == NO_SEG) {
+                        continue;
+                }
+                uint32_t *seg = SEG(guarded_um, mem_seq[id]);
+                uintptr_t guard = (uintptr_t) (seg + seg[0]);
+                if (addr >= guard && addr - guard < GUARD_BYTES) {
+                        uintptr_t offset = (addr - (uintptr_t) (seg + 1)) /
+                                           sizeof(uint32_t);
+                        len = snprintf(msg, sizeof(msg),
+                                       "um: pc %u: offset %llu is out of "
+                                       "bounds of segment %u (%u words)\n",
+                                       pc, (unsigned long long) offset,
+                                       (id == 1) ? 0 : id, seg[0] - 1);
+                }
+        }
+        if (len == 0 && addr < (((uintptr_t) 1) << 32) * sizeof(uint32_t)) {
+                len = snprintf(msg, sizeof(msg),
+                               "um: pc %u: access to an unmapped segment\n",
+                               pc);
+        }
+        if (len == 0) {
+                /* not a UM access: SA_RESETHAND lets it crash as usual */
+                return;
+        }
+        io_flush(guarded_um->io);
+        ssize_t written = write(STDERR_FILENO, msg, len);
+        (void) written;
+        _exit(EXIT_FAILURE);
+}
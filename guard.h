@@ -0,0 +1,36 @@
+/*****************************************************************************
+ *
+ *                       guard.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM guard header, contains declarations for safe mode
+ *               (./um -g): segments placed flush against guard pages, and
+ *               the SIGSEGV handler that turns a fault in a guard into a
+ *               report of the program counter and segment.
+ *
+ ****************************************************************************/
+#ifndef GUARD
+#define GUARD
+#include <stdint.h>
+#include "engine.h"
+#include "memory.h"
+
+/* Inaccessible bytes reserved after every segment in safe mode; an access
+ * up to this far past the end of a segment faults in its own guard. Any
+ * offset below GUARD_WORDS is in bounds or in the guard; safe mode compares
+ * larger offsets (up to 2^32 - 1) against the segment's length instead,
+ * since guards covering them (16 GB each) would run the address space out
+ * after about 8000 segments.
+ */
+#define GUARD_BYTES ((size_t) 1 << 30)
+#define GUARD_WORDS ((uint32_t) (GUARD_BYTES / sizeof(uint32_t)))
+
+uint32_t *guarded_alloc(seg_pool_t pool, uint32_t words);
+void guarded_free(seg_pool_t pool, uint32_t *seg);
+void release_guarded(uint32_t *seg);
+void release_guarded_free_lists(seg_pool_t pool);
+void install_fault_report(um_state_t um);
+#endif
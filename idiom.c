@@ -0,0 +1,502 @@
+/*****************************************************************************
+ *
+ *                       idiom.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM idiom module, recognizes whole loops in decoded segment
+ *               0 and runs them natively against mem_seq.
+ *
+ *               An idiom is a fixed sequence of instructions whose
+ *               registers and some Load_value constants are free: each
+ *               pattern register binds to one real register (all
+ *               different), and pattern values bind to constants. Matches
+ *               are marked like fused sequences, by replacing the opcode of
+ *               the loop's first slot, and unmarked by unidiom_inst if
+ *               segment 0 overwrites any word of them. A bitmap of the
+ *               slots marked loops span lets a store outside every loop
+ *               (nearly all of them) skip looking for one.
+ *
+ *               When an engine reaches a marked slot, run_idiom re-reads
+ *               the bindings from the slots and checks the run time
+ *               preconditions (segment ids, bounds, aliasing). If they
+ *               hold, the whole loop runs at once and leaves registers,
+ *               memory, and the program counter exactly as the UM would;
+ *               if not, the engine runs the slot as its plain instruction
+ *               and the loop is interpreted as usual.
+ *
+ *               Only the copy loop below was hot in the profiles of
+ *               umbin/codex.umz (about 15% of its instructions) and
+ *               umbin/sandmark.umz; its hot loops walk lists instead.
+ *
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "idiom.h"
+#include "engine.h"
+#include "um_ops.h"
+
+#define NUM_PATTERN_REGS NUM_REG
+#define NUM_PATTERN_VALS 2
+#define UNBOUND 0xff
+
+/* where a Load_value in a pattern gets its value */
+typedef enum val_kind {
+        VAL_LIT,        /* exactly val */
+        VAL_REL,        /* first slot's index + val (a jump target) */
+        VAL_VAR         /* binds pattern value number val */
+} val_kind;
+
+/* idiom step struct
+ *
+ * Purpose: one instruction of an idiom's pattern
+ * Members:
+ *      - uint8_t op: plain opcode
+ *      - uint8_t A, B, C: pattern registers, or UNBOUND for any register
+ *      - uint8_t kind, uint32_t val: Load_value constant (see val_kind)
+ */
+struct idiom_step {
+        uint8_t op, A, B, C;
+        uint8_t kind;
+        uint32_t val;
+};
+
+/* idiom match struct
+ *
+ * Purpose: what an idiom's pattern registers and values bound to
+ * Members:
+ *      - uint8_t reg[]: real register for each pattern register
+ *      - uint32_t val[]: constant for each pattern value
+ */
+struct idiom_match {
+        uint8_t reg[NUM_PATTERN_REGS];
+        uint32_t val[NUM_PATTERN_VALS];
+};
+
+/**********copy loop*********************************************************
+ *
+ * A counted copy between two segments, with the count and the source
+ * index kept in words of segment 0 (codex.umz copies its data this way):
+ *
+ *      while ((n = m[0][COUNT_WORD]) != 0) {
+ *              m[0][COUNT_WORD] = n - 1;
+ *              j = ++m[0][SRC_WORD];
+ *              m[DST][IDX++] = m[SRC][j + 2];
+ *      }
+ ****************************************************************************/
+enum copy_regs {
+        CP_ZERO, CP_COUNT, CP_TMP, CP_TMP2, CP_ONES, CP_SRC, CP_DST, CP_IDX
+};
+enum copy_vals { CP_COUNT_WORD, CP_SRC_WORD };
+
+#define LV_STEP(A, kind, val) { LV, A, UNBOUND, UNBOUND, kind, val }
+#define REG_STEP(op, A, B, C) { op, A, B, C, VAL_LIT, 0 }
+#define COPY_LOOP_LEN 23
+#define COPY_LOOP_BODY 6
+
+static const struct idiom_step copy_loop[COPY_LOOP_LEN] = {
+        LV_STEP(CP_COUNT, VAL_VAR, CP_COUNT_WORD),
+        REG_STEP(SLOAD, CP_COUNT, CP_ZERO, CP_COUNT),
+        LV_STEP(CP_TMP, VAL_REL, COPY_LOOP_LEN),
+        LV_STEP(CP_TMP2, VAL_REL, COPY_LOOP_BODY),
+        REG_STEP(CMOV, CP_TMP, CP_TMP2, CP_COUNT),
+        REG_STEP(LOADP, UNBOUND, CP_ZERO, CP_TMP),
+        REG_STEP(NAND, CP_ONES, CP_ZERO, CP_ZERO),
+        REG_STEP(ADD, CP_COUNT, CP_ONES, CP_COUNT),
+        LV_STEP(CP_TMP, VAL_VAR, CP_COUNT_WORD),
+        REG_STEP(SSTORE, CP_ZERO, CP_TMP, CP_COUNT),
+        LV_STEP(CP_TMP2, VAL_VAR, CP_SRC_WORD),
+        REG_STEP(SLOAD, CP_COUNT, CP_ZERO, CP_TMP2),
+        LV_STEP(CP_TMP, VAL_LIT, 1),
+        REG_STEP(ADD, CP_COUNT, CP_COUNT, CP_TMP),
+        REG_STEP(SSTORE, CP_ZERO, CP_TMP2, CP_COUNT),
+        LV_STEP(CP_TMP, VAL_LIT, 2),
+        REG_STEP(ADD, CP_TMP, CP_TMP, CP_COUNT),
+        REG_STEP(SLOAD, CP_TMP, CP_SRC, CP_TMP),
+        REG_STEP(SSTORE, CP_DST, CP_IDX, CP_TMP),
+        LV_STEP(CP_TMP, VAL_LIT, 1),
+        REG_STEP(ADD, CP_IDX, CP_IDX, CP_TMP),
+        LV_STEP(CP_TMP, VAL_REL, 0),
+        REG_STEP(LOADP, UNBOUND, CP_ZERO, CP_TMP),
+};
+
+/* idiom struct
+ *
+ * Purpose: describes one idiom
+ * Members:
+ *      - const struct idiom_step *steps: its pattern
+ *      - uint8_t len: number of steps (words of segment 0 it spans)
+ *      - const char *name: name used in the idiom report
+ */
+static const struct idiom {
+        const struct idiom_step *steps;
+        uint8_t len;
+        const char *name;
+} idioms[NUM_IDIOMS] = {
+        [COPY_LOOP - FIRST_IDIOM] = { copy_loop, COPY_LOOP_LEN, "copy" },
+};
+
+/* binds pattern register reg to real register real, keeping the real
+ * registers of different pattern registers different */
+static bool bind_reg(struct idiom_match *m, uint8_t reg, uint8_t real)
+{
+        if (reg == UNBOUND) {
+                return true;
+        }
+        if (m->reg[reg] != UNBOUND) {
+                return m->reg[reg] == real;
+        }
+        for (unsigned i = 0; i < NUM_PATTERN_REGS; i++) {
+                if (m->reg[i] == real) {
+                        return false;
+                }
+        }
+        m->reg[reg] = real;
+        return true;
+}
+
+/**********match_idiom********************************************************
+ *
+ * Purpose:
+ *      Checks whether an idiom's pattern matches the slots starting at idx
+ * Parameters:
+ *      const struct idiom *idiom: idiom to try
+ *      const inst_decoded_t *slots: decoded segment 0
+ *      uint32_t idx: index of the first instruction
+ *      uint32_t len: number of slots
+ *      struct idiom_match *m: filled in with the bindings on a match
+ * Returns:
+ *      true if every step matched and the value words make sense
+ * Expects:
+ *      None
+ * Notes:
+ *      Slots may hold fused or idiom opcodes; only their plain opcode and
+ *      fields are compared. Pattern values must name words of segment 0
+ *      outside the idiom, so the loop never writes its own code.
+ ****************************************************************************/
+static bool match_idiom(const struct idiom *idiom, const inst_decoded_t *slots,
+                        uint32_t idx, uint32_t len, struct idiom_match *m)
+{
+        if (len - idx < idiom->len) {
+                return false;
+        }
+        memset(m->reg, UNBOUND, sizeof(m->reg));
+        bool val_bound[NUM_PATTERN_VALS] = { false };
+        for (unsigned i = 0; i < idiom->len; i++) {
+                const struct idiom_step *step = &idiom->steps[i];
+                inst_decoded_t inst = slots[idx + i];
+                if (unfused_op(idiom_plain_op(inst.OP)) != step->op ||
+                    !bind_reg(m, step->A, inst.A)) {
+                        return false;
+                }
+                if (step->op != LV) {
+                        if (!bind_reg(m, step->B, inst.B) ||
+                            !bind_reg(m, step->C, inst.C)) {
+                                return false;
+                        }
+                } else if (step->kind == VAL_LIT) {
+                        if (inst.val != step->val) {
+                                return false;
+                        }
+                } else if (step->kind == VAL_REL) {
+                        if (inst.val != idx + step->val) {
+                                return false;
+                        }
+                } else if (val_bound[step->val]) {
+                        if (inst.val != m->val[step->val]) {
+                                return false;
+                        }
+                } else {
+                        val_bound[step->val] = true;
+                        m->val[step->val] = inst.val;
+                }
+        }
+        for (unsigned v = 0; v < NUM_PATTERN_VALS; v++) {
+                if (!val_bound[v]) {
+                        continue;
+                }
+                uint32_t word = m->val[v];
+                if (word >= len || (word >= idx && word < idx + idiom->len)) {
+                        return false;
+                }
+                for (unsigned w = 0; w < v; w++) {
+                        if (val_bound[w] && m->val[w] == word) {
+                                return false;
+                        }
+                }
+        }
+        return true;
+}
+
+/* sets or clears the bits of slots [start, start + len) in spans */
+static void mark_span(uint64_t spans[], uint32_t start, uint32_t len,
+                      bool covered)
+{
+        for (uint32_t i = start; i < start + len; i++) {
+                uint64_t bit = (uint64_t) 1 << (i % 64);
+                spans[i / 64] = covered ? (spans[i / 64] | bit)
+                                        : (spans[i / 64] & ~bit);
+        }
+}
+
+/**********find_idioms********************************************************
+ *
+ * Purpose:
+ *      Marks the first slot of every idiom in decoded segment 0
+ * Parameters:
+ *      inst_decoded_t *slots: decoded (and possibly fused) segment 0
+ *      uint32_t len: number of slots
+ *      uint64_t sites[]: per idiom count of marked loops, added to so it
+ *                        accumulates over every load
+ *      uint64_t spans[]: IDIOM_SPAN_WORDS(len) words, all zero, in which
+ *                        the bits of every slot a marked loop spans are
+ *                        set
+ * Returns:
+ *      None
+ * Expects:
+ *      slots and spans to be non-NULL if len is nonzero
+ * Notes:
+ *      A marked first slot loses any fused opcode it had; the loop's other
+ *      slots are left alone.
+ ****************************************************************************/
+void find_idioms(inst_decoded_t *slots, uint32_t len, uint64_t sites[],
+                 uint64_t spans[])
+{
+        struct idiom_match m;
+        uint32_t idx = 0;
+        while (idx < len) {
+                unsigned k = 0;
+                while (k < NUM_IDIOMS &&
+                       (unfused_op(slots[idx].OP) != idioms[k].steps[0].op ||
+                        !match_idiom(&idioms[k], slots, idx, len, &m))) {
+                        k++;
+                }
+                if (k == NUM_IDIOMS) {
+                        idx++;
+                        continue;
+                }
+                slots[idx].OP = FIRST_IDIOM + k;
+                sites[k]++;
+                mark_span(spans, idx, idioms[k].len, true);
+                idx += idioms[k].len;
+        }
+}
+
+/**********unidiom_inst*******************************************************
+ *
+ * Purpose:
+ *      Unmarks any idiom that spans slots[idx], after that word of segment
+ *      0 has been overwritten
+ * Parameters:
+ *      inst_decoded_t *slots: decoded segment 0
+ *      uint64_t spans[]: bitmap of the slots marked idioms span, as
+ *                        find_idioms set it; the unmarked loop's bits are
+ *                        cleared
+ *      uint32_t idx: index of the overwritten (and already re-decoded) word
+ *      uint8_t old_op: the opcode slots[idx] held before it was overwritten
+ * Returns:
+ *      None
+ * Expects:
+ *      slots[idx] to already hold the decoding of the new word
+ * Notes:
+ *      O(1) unless idx's bit is set. The marked slot's fields were never
+ *      changed, so putting back the first step's opcode is enough; if the
+ *      store replaced the marked slot itself, old_op names the loop whose
+ *      span to clear. Marked loops never overlap, so at most one spans
+ *      idx.
+ ****************************************************************************/
+void unidiom_inst(inst_decoded_t *slots, uint64_t spans[], uint32_t idx,
+                  uint8_t old_op)
+{
+        if ((spans[idx / 64] >> (idx % 64) & 1) == 0) {
+                return;
+        }
+        if (old_op >= FIRST_IDIOM && old_op < END_IDIOM) {
+                /* idx was the loop's first slot: the store unmarked it */
+                mark_span(spans, idx, idioms[old_op - FIRST_IDIOM].len,
+                          false);
+                return;
+        }
+        for (uint32_t back = 1; back < MAX_IDIOM_LEN && back <= idx; back++) {
+                uint8_t op = slots[idx - back].OP;
+                if (op < FIRST_IDIOM || op >= END_IDIOM) {
+                        continue;
+                }
+                const struct idiom *idiom = &idioms[op - FIRST_IDIOM];
+                if (idiom->len > back) {
+                        slots[idx - back].OP = idiom->steps[0].op;
+                        mark_span(spans, idx - back, idiom->len, false);
+                        return;
+                }
+                break;
+        }
+}
+
+/**********idiom_plain_op*****************************************************
+ *
+ * Purpose:
+ *      Gives the plain opcode of the instruction in a slot
+ * Parameters:
+ *      uint8_t op: opcode stored in the slot
+ * Returns:
+ *      op itself if it is not an idiom, else the idiom's first opcode
+ * Expects:
+ *      None
+ * Notes:
+ *      For passes that work one instruction at a time (e.g. the JIT)
+ ****************************************************************************/
+uint8_t idiom_plain_op(uint8_t op)
+{
+        if (op < FIRST_IDIOM || op >= END_IDIOM) {
+                return op;
+        }
+        return idioms[op - FIRST_IDIOM].steps[0].op;
+}
+
+/**********run_copy_loop******************************************************
+ *
+ * Purpose:
+ *      Runs a matched copy loop with memcpy
+ * Parameters:
+ *      um_state_t um: memory and decoded segment 0
+ *      uint32_t *r: registers
+ *      uint32_t start: index of the loop's first instruction
+ *      const struct idiom_match *m: bindings of the loop
+ * Returns:
+ *      number of UM instructions the loop ran, or 0 if a precondition
+ *      failed and nothing was changed
+ * Expects:
+ *      m to be the match at start
+ * Notes:
+ *      Falls back when the count is 0, when either segment is 0, unmapped,
+ *      or the other one, when the destination shares storage with segment
+ *      0, or when either range runs past its segment.
+ ****************************************************************************/
+static uint64_t run_copy_loop(um_state_t um, uint32_t *r, uint32_t start,
+                              const struct idiom_match *m)
+{
+        seg_ref_t *mem_seq = um->mem_seq;
+        uint32_t *meta = SEG(um, mem_seq[0]);
+        if (r[m->reg[CP_ZERO]] != 0) {
+                return 0;
+        }
+        uint32_t count_word = m->val[CP_COUNT_WORD] + 1;
+        uint32_t src_word = m->val[CP_SRC_WORD] + 1;
+        uint32_t count = SEG(um, mem_seq[1])[count_word];
+        uint32_t src_id = r[m->reg[CP_SRC]];
+        uint32_t dst_id = r[m->reg[CP_DST]];
+        if (count == 0 || src_id == 0 || dst_id == 0 || src_id == dst_id ||
+            src_id >= meta[1] || dst_id >= meta[1] ||
+            dst_id == meta[META_SHARED]) {
+                return 0;
+        }
+        if (mem_seq[src_id] == NO_SEG || mem_seq[dst_id] == NO_SEG) {
+                return 0;
+        }
+        uint32_t *src = SEG(um, mem_seq[src_id]);
+        uint32_t *dst = SEG(um, mem_seq[dst_id]);
+        uint32_t src_idx = SEG(um, mem_seq[1])[src_word];
+        uint32_t dst_idx = r[m->reg[CP_IDX]];
+        uint64_t first = (uint64_t) src_idx + 3;
+        if (first + count > src[0] - 1 ||
+            (uint64_t) dst_idx + count > dst[0] - 1) {
+                return 0;
+        }
+
+        if (meta[META_SHARED] != 0) {
+                UNSHARE_SEG_0();
+        }
+        memcpy(dst + 1 + dst_idx, src + 1 + first,
+               ((size_t) count) * sizeof(uint32_t));
+        uint32_t *seg_0 = SEG(um, mem_seq[1]);
+        seg_0[count_word] = 0;
+        seg_0[src_word] = src_idx + count;
+        refresh_inst(um->cache, count_word - 1, 0);
+        refresh_inst(um->cache, src_word - 1, src_idx + count);
+
+        /* as left by the last pass through the body and the final test */
+        r[m->reg[CP_IDX]] = dst_idx + count;
+        r[m->reg[CP_ONES]] = ~0u;
+        r[m->reg[CP_COUNT]] = 0;
+        r[m->reg[CP_TMP]] = start + COPY_LOOP_LEN;
+        r[m->reg[CP_TMP2]] = start + COPY_LOOP_BODY;
+        /* count full passes, then the test that falls out of the loop */
+        return (uint64_t) count * COPY_LOOP_LEN + COPY_LOOP_BODY;
+}
+
+/**********run_idiom**********************************************************
+ *
+ * Purpose:
+ *      Runs the idiom whose marked slot was just dispatched, if its run
+ *      time preconditions hold
+ * Parameters:
+ *      um_state_t um: memory, decoded segment 0, and idiom counters
+ *      uint32_t *r: registers (the engine's copy)
+ *      uint32_t *prog_counter: index just past the marked slot; moved past
+ *                              the loop if it ran
+ * Returns:
+ *      true if the loop ran; false if the engine must run the marked slot
+ *      as its plain instruction
+ * Expects:
+ *      slots[*prog_counter - 1] to hold an idiom opcode
+ * Notes:
+ *      Adds to um->idiom_hits, and to um->idiom_insts the UM instructions
+ *      the loop ran besides the dispatched one.
+ ****************************************************************************/
+bool run_idiom(um_state_t um, uint32_t *r, uint32_t *prog_counter)
+{
+        uint32_t start = *prog_counter - 1;
+        uint8_t op = um->slots[start].OP;
+        assert(op >= FIRST_IDIOM && op < END_IDIOM);
+        const struct idiom *idiom = &idioms[op - FIRST_IDIOM];
+        struct idiom_match m;
+        if (!match_idiom(idiom, um->slots, start, um->len, &m)) {
+                return false;
+        }
+
+        uint64_t insts = 0;
+        switch (op) {
+                case COPY_LOOP:
+                        insts = run_copy_loop(um, r, start, &m);
+                        *prog_counter = start + COPY_LOOP_LEN;
+                        break;
+        }
+        if (insts == 0) {
+                *prog_counter = start + 1;
+                return false;
+        }
+        um->idiom_hits[op - FIRST_IDIOM]++;
+        um->idiom_insts += insts - 1;
+        return true;
+}
+
+/**********report_idioms******************************************************
+ *
+ * Purpose:
+ *      Prints, for each idiom, how many loops were marked and how many
+ *      times one ran natively
+ * Parameters:
+ *      FILE *out: stream to print to
+ *      const uint64_t sites[]: per idiom count of marked loops
+ *      const uint64_t hits[]: per idiom count of native runs
+ * Returns:
+ *      None
+ * Expects:
+ *      out to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+void report_idioms(FILE *out, const uint64_t sites[], const uint64_t hits[])
+{
+        assert(out != NULL);
+        fprintf(out, "idiom                   sites             hits\n");
+        for (unsigned k = 0; k < NUM_IDIOMS; k++) {
+                fprintf(out, "%-16s %12llu %16llu\n", idioms[k].name,
+                        (unsigned long long) sites[k],
+                        (unsigned long long) hits[k]);
+        }
+}
@@ -0,0 +1,49 @@
+/*****************************************************************************
+ *
+ *                       idiom.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM idiom header, contains the idiom opcodes and the
+ *               declarations for the pass that marks whole UM loops in
+ *               decoded segment 0 and the native routines that run them.
+ *
+ ****************************************************************************/
+#ifndef IDIOM
+#define IDIOM
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "structs_and_constants.h"
+#include "fusion.h"
+
+/* Idiom opcodes are numbered after the fused ones. An idiom slot is the
+ * first instruction of a recognized loop and keeps that instruction's
+ * fields, so it can always be run as its plain opcode instead.
+ */
+typedef enum idiom_opcode {
+        FIRST_IDIOM = END_FUSED,
+        COPY_LOOP = FIRST_IDIOM,
+        END_IDIOM
+} idiom_opcode;
+
+#define NUM_IDIOMS (END_IDIOM - FIRST_IDIOM)
+
+/* Most words of segment 0 one idiom spans */
+#define MAX_IDIOM_LEN 23
+
+/* uint64_t words in a bitmap of which of len slots lie in a marked idiom */
+#define IDIOM_SPAN_WORDS(len) (((size_t) (len) + 63) / 64)
+
+struct um_state;
+
+void find_idioms(inst_decoded_t *slots, uint32_t len, uint64_t sites[],
+                 uint64_t spans[]);
+void unidiom_inst(inst_decoded_t *slots, uint64_t spans[], uint32_t idx,
+                  uint8_t old_op);
+uint8_t idiom_plain_op(uint8_t op);
+bool run_idiom(struct um_state *um, uint32_t *r, uint32_t *prog_counter);
+void report_idioms(FILE *out, const uint64_t sites[], const uint64_t hits[]);
+#endif
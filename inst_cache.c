@@ -0,0 +1,339 @@
+/*****************************************************************************
+ *
+ *                       inst_cache.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *     
+ *      Summary: UM instruction cache module, decodes segment 0 once when a
+ *               program is loaded so the main loop only has to index a
+ *               slot. Segment stores into segment 0 re-decode just the
+ *               slot they overwrite.
+ *
+ *               Builds of contents loaded more than once are kept, keyed
+ *               by a hash of their length and a sample of their raw words,
+ *               so a further Load_program of them (the same image, from
+ *               any segment) copies the saved slots instead of decoding
+ *               and fusing again. A build is saved only on the second load
+ *               of its contents, since one image loaded once (as codex.umz
+ *               loads each of its two) would never repay the copy, and
+ *               the saved builds together are capped at SAVED_BUILD_BYTES.
+ *
+ ****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "inst_cache.h"
+#include "decode_inst.h"
+#include "jit.h"
+
+/**********new_inst_cache*****************************************************
+ *
+ * Purpose:
+ *      Allocates an empty instruction cache
+ * Parameters: 
+ *      bool fuse: whether to fuse common sequences after every build
+ * Returns: 
+ *      inst_cache_t with no decoded slots
+ * Expects:
+ *      fuse to be false unless the engine can run fused opcodes
+ * Notes:
+ *      Caller must free with free_inst_cache
+ ****************************************************************************/
+inst_cache_t new_inst_cache(bool fuse)
+{
+        inst_cache_t cache = calloc(1, sizeof(*cache));
+        assert(cache != NULL);
+        cache->slots = NULL;
+        cache->idiom_spans = NULL;
+        cache->len = 0;
+        cache->cap = 0;
+        cache->fuse = fuse;
+        cache->jit = NULL;
+        return cache;
+}
+
+/* Words of a segment key_words hashes, spread evenly over it */
+#define KEY_SAMPLES 64
+
+/**********key_words**********************************************************
+ *
+ * Purpose:
+ *      Keys the raw words of a segment: a hash (64-bit FNV-1a) of its
+ *      length and of KEY_SAMPLES words spread evenly over it
+ * Parameters: 
+ *      const uint32_t *words: first word
+ *      uint32_t len: number of words
+ * Returns: 
+ *      the key
+ * Expects:
+ *      None
+ * Notes:
+ *      Costs the same for any length. Only picks candidates; a match is
+ *      confirmed by comparing the words
+ ****************************************************************************/
+static uint64_t key_words(const uint32_t *words, uint32_t len)
+{
+        uint64_t hash = (14695981039346656037ULL ^ len) * 1099511628211ULL;
+        uint32_t samples = (len < KEY_SAMPLES) ? len : KEY_SAMPLES;
+        for (uint32_t i = 0; i < samples; i++) {
+                uint32_t idx = ((uint64_t) i * len) / samples;
+                hash = (hash ^ words[idx]) * 1099511628211ULL;
+        }
+        return hash;
+}
+
+/* bytes a saved build of len words holds */
+static size_t build_bytes(uint32_t len)
+{
+        return ((size_t) len) * (sizeof(uint32_t) + sizeof(inst_decoded_t)) +
+               IDIOM_SPAN_WORDS(len) * sizeof(uint64_t);
+}
+
+/**********find_saved_build***************************************************
+ *
+ * Purpose:
+ *      Looks for a saved build of exactly these words
+ * Parameters: 
+ *      inst_cache_t cache: cache holding the saved builds
+ *      uint64_t key: key_words(words, len)
+ *      const uint32_t *words: raw words being loaded
+ *      uint32_t len: number of words
+ * Returns: 
+ *      the saved build, or NULL if there is none
+ * Expects:
+ *      cache to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+static saved_build_t *find_saved_build(inst_cache_t cache, uint64_t key,
+                                       const uint32_t *words, uint32_t len)
+{
+        for (unsigned i = 0; i < NUM_SAVED_BUILDS; i++) {
+                saved_build_t *saved = &cache->saved[i];
+                if (saved->words != NULL && saved->hash == key &&
+                    saved->len == len &&
+                    memcmp(saved->words, words,
+                           ((size_t) len) * sizeof(uint32_t)) == 0) {
+                        return saved;
+                }
+        }
+        return NULL;
+}
+
+/**********seen_before********************************************************
+ *
+ * Purpose:
+ *      Tells whether a load of the same key was seen since its build was
+ *      last saved, and remembers this one if not
+ * Parameters: 
+ *      inst_cache_t cache: cache remembering recent loads
+ *      uint64_t key: key_words of the words being loaded
+ * Returns: 
+ *      true if the key was seen (it is then forgotten, as its build is
+ *      about to be saved), else false
+ * Expects:
+ *      cache to be non-NULL
+ * Notes:
+ *      A false match of keys only saves a build that is not needed
+ ****************************************************************************/
+static bool seen_before(inst_cache_t cache, uint64_t key)
+{
+        for (unsigned i = 0; i < cache->num_seen; i++) {
+                if (cache->seen[i] == key) {
+                        cache->seen[i] = cache->seen[--cache->num_seen];
+                        return true;
+                }
+        }
+        if (cache->num_seen < NUM_SEEN_LOADS) {
+                cache->seen[cache->num_seen++] = key;
+        } else {
+                cache->seen[cache->next_seen] = key;
+                cache->next_seen = (cache->next_seen + 1) % NUM_SEEN_LOADS;
+        }
+        return false;
+}
+
+/* frees a saved build, leaving its entry empty */
+static void drop_saved_build(inst_cache_t cache, saved_build_t *saved)
+{
+        if (saved->words != NULL) {
+                cache->saved_bytes -= build_bytes(saved->len);
+        }
+        free(saved->words);
+        free(saved->slots);
+        free(saved->idiom_spans);
+        memset(saved, 0, sizeof(*saved));
+}
+
+/**********save_build*********************************************************
+ *
+ * Purpose:
+ *      Keeps a copy of the words and slots just built, replacing the
+ *      oldest saved build, and more while they would exceed
+ *      SAVED_BUILD_BYTES
+ * Parameters: 
+ *      inst_cache_t cache: cache whose slots were just built from words
+ *      uint64_t key: key_words(words, len)
+ *      const uint32_t *words: raw words the slots were built from
+ *      uint32_t len: number of words
+ * Returns: 
+ *      None
+ * Expects:
+ *      cache->slots to hold the fresh build of words
+ * Notes:
+ *      A build bigger than SAVED_BUILD_BYTES on its own is not saved
+ ****************************************************************************/
+static void save_build(inst_cache_t cache, uint64_t key,
+                       const uint32_t *words, uint32_t len)
+{
+        size_t bytes = build_bytes(len);
+        if (bytes > SAVED_BUILD_BYTES) {
+                return;
+        }
+        saved_build_t *saved = &cache->saved[cache->next_saved];
+        drop_saved_build(cache, saved);
+        for (unsigned i = 1; cache->saved_bytes + bytes > SAVED_BUILD_BYTES;
+             i++) {
+                drop_saved_build(cache, &cache->saved[(cache->next_saved + i) %
+                                                      NUM_SAVED_BUILDS]);
+        }
+        cache->next_saved = (cache->next_saved + 1) % NUM_SAVED_BUILDS;
+        saved->words = malloc(((size_t) len) * sizeof(uint32_t));
+        saved->slots = malloc(((size_t) len) * sizeof(inst_decoded_t));
+        saved->idiom_spans = malloc(IDIOM_SPAN_WORDS(len) *
+                                    sizeof(uint64_t));
+        assert(len == 0 || (saved->words != NULL && saved->slots != NULL &&
+                            saved->idiom_spans != NULL));
+        saved->hash = key;
+        saved->len = len;
+        memcpy(saved->words, words, ((size_t) len) * sizeof(uint32_t));
+        memcpy(saved->slots, cache->slots,
+               ((size_t) len) * sizeof(inst_decoded_t));
+        memcpy(saved->idiom_spans, cache->idiom_spans,
+               IDIOM_SPAN_WORDS(len) * sizeof(uint64_t));
+        cache->saved_bytes += bytes;
+}
+
+/**********build_inst_cache***************************************************
+ *
+ * Purpose:
+ *      Decodes every word of a newly loaded segment 0 into the cache
+ * Parameters: 
+ *      inst_cache_t cache: cache to fill
+ *      const uint32_t *words: first instruction word of segment 0
+ *      uint32_t len: number of words in segment 0
+ * Returns: 
+ *      None
+ * Expects:
+ *      cache to be non-NULL
+ * Notes:
+ *      Called once at load and again after every Load_program that replaces
+ *      segment 0. May move cache->slots, so callers holding a pointer into
+ *      the slots must reload it. Drops any native code compiled from the
+ *      old segment 0. Contents with a saved build are copied from it
+ *      (counted in build_hits) instead of decoded again; contents loaded
+ *      a second time get their build saved.
+ ****************************************************************************/
+void build_inst_cache(inst_cache_t cache, const uint32_t *words, uint32_t len)
+{
+        assert(cache != NULL);
+        if (len > cache->cap) {
+                free(cache->slots);
+                free(cache->idiom_spans);
+                cache->slots = malloc(((size_t) len) * sizeof(inst_decoded_t));
+                cache->idiom_spans = malloc(IDIOM_SPAN_WORDS(len) *
+                                            sizeof(uint64_t));
+                assert(cache->slots != NULL && cache->idiom_spans != NULL);
+                cache->cap = len;
+        }
+        cache->len = len;
+        uint64_t key = key_words(words, len);
+        saved_build_t *saved = find_saved_build(cache, key, words, len);
+        if (saved != NULL) {
+                memcpy(cache->slots, saved->slots,
+                       ((size_t) len) * sizeof(inst_decoded_t));
+                memcpy(cache->idiom_spans, saved->idiom_spans,
+                       IDIOM_SPAN_WORDS(len) * sizeof(uint64_t));
+                cache->build_hits++;
+        } else {
+                memset(cache->idiom_spans, 0,
+                       IDIOM_SPAN_WORDS(len) * sizeof(uint64_t));
+                for (uint32_t i = 0; i < len; i++) {
+                        cache->slots[i] = decode_inst(words[i]);
+                }
+                if (cache->fuse) {
+                        fuse_insts(cache->slots, len, cache->fused_sites);
+                        find_idioms(cache->slots, len, cache->idiom_sites,
+                                    cache->idiom_spans);
+                }
+                if (seen_before(cache, key)) {
+                        save_build(cache, key, words, len);
+                }
+                cache->build_misses++;
+        }
+        if (cache->jit != NULL) {
+                reset_jit(cache->jit, len);
+        }
+}
+
+/**********refresh_inst*******************************************************
+ *
+ * Purpose:
+ *      Invalidates the slot for one word of segment 0 after a Segment_store
+ *      into segment 0 has overwritten it
+ * Parameters: 
+ *      inst_cache_t cache: cache holding the stale slot
+ *      uint32_t idx: index of the overwritten word
+ *      uint32_t word: the word that was stored
+ * Returns: 
+ *      None
+ * Expects:
+ *      idx to be within the decoded length of segment 0
+ * Notes:
+ *      Only the overwritten slot is touched, so self-modifying programs stay
+ *      correct without paying for a full rebuild. A fused sequence that
+ *      covered the slot falls back to running its instructions one by one,
+ *      an idiom spanning it is unmarked, and native code compiled from the
+ *      slot is dropped.
+ ****************************************************************************/
+void refresh_inst(inst_cache_t cache, uint32_t idx, uint32_t word)
+{
+        uint8_t old_op = cache->slots[idx].OP;
+        cache->slots[idx] = decode_inst(word);
+        if (cache->fuse) {
+                unfuse_inst(cache->slots, idx);
+                unidiom_inst(cache->slots, cache->idiom_spans, idx, old_op);
+        }
+        if (cache->jit != NULL) {
+                invalidate_jit_word(cache->jit, idx);
+        }
+}
+
+/**********free_inst_cache****************************************************
+ *
+ * Purpose:
+ *      Frees an instruction cache and sets the caller's handle to NULL
+ * Parameters: 
+ *      inst_cache_t *cache: pointer to the cache to free
+ * Returns: 
+ *      None
+ * Expects:
+ *      cache and *cache to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+void free_inst_cache(inst_cache_t *cache)
+{
+        assert(cache != NULL && *cache != NULL);
+        for (unsigned i = 0; i < NUM_SAVED_BUILDS; i++) {
+                free((*cache)->saved[i].words);
+                free((*cache)->saved[i].slots);
+                free((*cache)->saved[i].idiom_spans);
+        }
+        free((*cache)->slots);
+        free((*cache)->idiom_spans);
+        free(*cache);
+        *cache = NULL;
+}
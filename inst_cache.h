@@ -0,0 +1,93 @@
+/*****************************************************************************
+ *
+ *                       inst_cache.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *     
+ *      Summary: UM instruction cache header, contains the pre-decoded form
+ *               of segment 0 and declarations for functions used to build
+ *               it and keep it in sync with the raw words.
+ *
+ ****************************************************************************/
+#ifndef INST_CACHE
+#define INST_CACHE
+#include <stdint.h>
+#include <stdbool.h>
+#include "structs_and_constants.h"
+#include "fusion.h"
+#include "idiom.h"
+
+/* Builds kept for reuse by a later Load_program of identical contents */
+#define NUM_SAVED_BUILDS 4
+
+/* Most bytes the saved builds may hold together (about 12 per word) */
+#define SAVED_BUILD_BYTES ((size_t) 64 << 20)
+
+/* Loads remembered by key, so a build is saved only on the second load of
+ * the same contents
+ */
+#define NUM_SEEN_LOADS 8
+
+/* saved build struct
+ *
+ * Purpose: one decoded (and fused) segment 0, keyed by its raw words
+ * Members:
+ *      - uint64_t hash: key_words of the raw words
+ *      - uint32_t len: number of words
+ *      - uint32_t *words: copy of the raw words, to confirm a hash match
+ *      - inst_decoded_t *slots: the slots decoded from them
+ *      - uint64_t *idiom_spans: the slots' idiom bitmap (idiom.h)
+ */
+typedef struct saved_build {
+        uint64_t hash;
+        uint32_t len;
+        uint32_t *words;
+        inst_decoded_t *slots;
+        uint64_t *idiom_spans;
+} saved_build_t;
+
+/* instruction cache struct
+ *
+ * Purpose: holds one decoded slot per word of segment 0
+ * Members:
+ *      - inst_decoded_t *slots: slots[i] is the decoded form of word i
+ *      - uint32_t len: number of words currently decoded
+ *      - uint32_t cap: number of slots allocated
+ *      - bool fuse: whether to run the fusion pass (fusion.h) and the idiom
+ *        pass (idiom.h) after decoding
+ *      - uint64_t fused_sites[]: sequences fused so far, per fused opcode
+ *      - uint64_t idiom_sites[]: loops marked so far, per idiom
+ *      - uint64_t *idiom_spans: bit i is set if slot i lies in a marked
+ *        loop, for cap slots
+ *      - struct jit *jit: JIT tier (jit.h) to keep in sync, or NULL
+ *      - saved_build_t saved[]: recent builds, replaced round robin
+ *      - unsigned next_saved: entry of saved the next new build replaces
+ *      - size_t saved_bytes: bytes the saved builds hold
+ *      - uint64_t seen[]: keys of recent loads not saved, num_seen of them
+ *        (at most NUM_SEEN_LOADS), the next replacing seen[next_seen]
+ *      - uint64_t build_hits, build_misses: builds reused and decoded
+ */
+struct jit;
+typedef struct inst_cache {
+        inst_decoded_t *slots;
+        uint32_t len, cap;
+        bool fuse;
+        uint64_t fused_sites[NUM_FUSED];
+        uint64_t idiom_sites[NUM_IDIOMS];
+        uint64_t *idiom_spans;
+        struct jit *jit;
+        saved_build_t saved[NUM_SAVED_BUILDS];
+        unsigned next_saved;
+        size_t saved_bytes;
+        uint64_t seen[NUM_SEEN_LOADS];
+        unsigned num_seen, next_seen;
+        uint64_t build_hits, build_misses;
+} *inst_cache_t;
+
+inst_cache_t new_inst_cache(bool fuse);
+void build_inst_cache(inst_cache_t cache, const uint32_t *words, uint32_t len);
+void refresh_inst(inst_cache_t cache, uint32_t idx, uint32_t word);
+void free_inst_cache(inst_cache_t *cache);
+#endif
@@ -0,0 +1,325 @@
+/*****************************************************************************
+ *
+ *                       io.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM I/O. Output and Input bypass stdio, whose every putc
+ *               and getc takes the stream's lock: output collects in a
+ *               private buffer written to fd 1 with one write(2) when it
+ *               fills, and input is read from fd 0 as far ahead as one
+ *               read(2) goes.
+ *
+ *               A read can block until the user types, so pending output
+ *               is always written before one: a prompt appears before the
+ *               program waits on its answer. um writes the rest at Halt,
+ *               and before any report of a program's error (check.c,
+ *               guard.c), so the report comes after the output.
+ *
+ *               Hosted I/O, for a program run through libum (libum.h),
+ *               touches no file descriptor: the host feeds input into the
+ *               input buffer and drains output from the kept copy.
+ *
+ ****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include "io.h"
+
+/**********new_io*************************************************************
+ *
+ * Purpose:
+ *      Makes empty I/O buffers for a program
+ * Parameters:
+ *      bool hosted: input is fed and output drained by a host (io_feed,
+ *                   io_drain) instead of fds 0 and 1
+ * Returns:
+ *      The buffers
+ * Expects:
+ *      None
+ * Notes:
+ *      Must be freed with free_io
+ ****************************************************************************/
+um_io_t new_io(bool hosted)
+{
+        um_io_t io = malloc(sizeof(*io));
+        assert(io != NULL);
+        io->out_len = 0;
+        io->hosted = hosted;
+        io->line_flush = !hosted && isatty(STDOUT_FILENO);
+        io->in_next = 0;
+        io->in_len = 0;
+        io->in_eof = false;
+        io->in_total = 0;
+        io->keep = hosted;
+        io->kept = NULL;
+        io->kept_len = 0;
+        io->kept_cap = 0;
+        return io;
+}
+
+/**********io_flush***********************************************************
+ *
+ * Purpose:
+ *      Writes out all buffered output
+ * Parameters:
+ *      um_io_t io: the program's I/O
+ * Returns:
+ *      None
+ * Expects:
+ *      io to be non-NULL
+ * Notes:
+ *      Output that cannot be written (say, to a closed pipe) is dropped,
+ *      as putc would drop it. Safe to call from a signal handler, unless
+ *      output is being kept. Hosted output is only kept
+ ****************************************************************************/
+void io_flush(um_io_t io)
+{
+        if (io->keep) {
+                if (io->kept_len + io->out_len > io->kept_cap) {
+                        io->kept_cap = 2 * (io->kept_len + io->out_len);
+                        io->kept = realloc(io->kept, io->kept_cap);
+                        assert(io->kept != NULL);
+                }
+                memcpy(io->kept + io->kept_len, io->out, io->out_len);
+                io->kept_len += io->out_len;
+        }
+        size_t done = 0;
+        while (!io->hosted && done < io->out_len) {
+                ssize_t n = write(STDOUT_FILENO, io->out + done,
+                                  io->out_len - done);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        break;
+                }
+                done += n;
+        }
+        io->out_len = 0;
+}
+
+/**********io_fill************************************************************
+ *
+ * Purpose:
+ *      Refills the empty input buffer and inputs its first byte
+ * Parameters:
+ *      um_io_t io: the program's I/O, with no input buffered
+ * Returns:
+ *      The byte, or all 1's at end of file
+ * Expects:
+ *      io to be non-NULL
+ * Notes:
+ *      Writes buffered output first. End of file, or an error reading,
+ *      sticks, like stdio's. Hosted input has nothing to read: all of it
+ *      that was fed is in the buffer, so this is end of file, for now if
+ *      the host has not ended it (run_um_quota stops before such an
+ *      Input instead)
+ ****************************************************************************/
+uint32_t io_fill(um_io_t io)
+{
+        io_flush(io);
+        io->in_next = 0;
+        io->in_len = 0;
+        while (!io->in_eof && !io->hosted) {
+                ssize_t n = read(STDIN_FILENO, io->in, IO_BUF_BYTES);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        io->in_eof = true;
+                        break;
+                }
+                io->in_len = n;
+                io->in_next = 1;
+                io->in_total += n;
+                return io->in[0];
+        }
+        return (uint32_t) ~0;
+}
+
+/**********io_keep************************************************************
+ *
+ * Purpose:
+ *      Starts or stops keeping a copy of all output from here on
+ * Parameters:
+ *      um_io_t io: the program's I/O
+ *      bool keep: whether to keep it
+ * Returns:
+ *      None
+ * Expects:
+ *      io to be non-NULL
+ * Notes:
+ *      Stopping throws the copy away. The copy is of output that has
+ *      been flushed
+ ****************************************************************************/
+void io_keep(um_io_t io, bool keep)
+{
+        assert(io != NULL);
+        if (!keep) {
+                free(io->kept);
+                io->kept = NULL;
+                io->kept_len = 0;
+                io->kept_cap = 0;
+        }
+        io->keep = keep;
+}
+
+/**********io_read_any********************************************************
+ *
+ * Purpose:
+ *      Tells whether the program has tried to read any input
+ * Parameters:
+ *      um_io_t io: the program's I/O
+ * Returns:
+ *      true if fd 0 has been read
+ * Expects:
+ *      io to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+bool io_read_any(um_io_t io)
+{
+        assert(io != NULL);
+        return io->in_len != 0 || io->in_eof;
+}
+
+/**********io_skip************************************************************
+ *
+ * Purpose:
+ *      Inputs bytes bytes and throws them away
+ * Parameters:
+ *      um_io_t io: the program's I/O
+ *      uint64_t bytes: bytes to skip
+ * Returns:
+ *      None
+ * Expects:
+ *      io to be non-NULL
+ * Notes:
+ *      Stops early at end of file. For a restored checkpoint, whose
+ *      program had consumed that much of the same input
+ ****************************************************************************/
+void io_skip(um_io_t io, uint64_t bytes)
+{
+        assert(io != NULL);
+        while (bytes > 0) {
+                if (io->in_next == io->in_len) {
+                        if (io_fill(io) == (uint32_t) ~0) {
+                                return;
+                        }
+                        bytes--;
+                        continue;
+                }
+                size_t n = io->in_len - io->in_next;
+                n = (bytes < n) ? bytes : n;
+                io->in_next += n;
+                bytes -= n;
+        }
+}
+
+/**********io_feed************************************************************
+ *
+ * Purpose:
+ *      Adds input from the host to hosted input
+ * Parameters:
+ *      um_io_t io: hosted I/O
+ *      const uint8_t *bytes: input
+ *      size_t len: bytes of input
+ * Returns:
+ *      How many of the bytes fit in the input buffer, from the first
+ * Expects:
+ *      io to be non-NULL and hosted, and bytes to be non-NULL if len > 0
+ * Notes:
+ *      Input the program has consumed makes room. Nothing fits after
+ *      io_end_input
+ ****************************************************************************/
+size_t io_feed(um_io_t io, const uint8_t *bytes, size_t len)
+{
+        assert(io != NULL && io->hosted);
+        if (io->in_eof) {
+                return 0;
+        }
+        memmove(io->in, io->in + io->in_next, io->in_len - io->in_next);
+        io->in_len -= io->in_next;
+        io->in_next = 0;
+        size_t n = IO_BUF_BYTES - io->in_len;
+        n = (len < n) ? len : n;
+        memcpy(io->in + io->in_len, bytes, n);
+        io->in_len += n;
+        io->in_total += n;
+        return n;
+}
+
+/**********io_end_input*******************************************************
+ *
+ * Purpose:
+ *      Ends hosted input: once the program consumes what was fed, it
+ *      reads end of file
+ * Parameters:
+ *      um_io_t io: hosted I/O
+ * Returns:
+ *      None
+ * Expects:
+ *      io to be non-NULL and hosted
+ * Notes:
+ *      None
+ ****************************************************************************/
+void io_end_input(um_io_t io)
+{
+        assert(io != NULL && io->hosted);
+        io->in_eof = true;
+}
+
+/**********io_drain***********************************************************
+ *
+ * Purpose:
+ *      Takes hosted output for the host
+ * Parameters:
+ *      um_io_t io: hosted I/O
+ *      uint8_t *bytes: where to copy the output
+ *      size_t cap: room at bytes
+ * Returns:
+ *      Bytes copied, oldest first; 0 if there was no output
+ * Expects:
+ *      io to be non-NULL and hosted, and bytes to be non-NULL if cap > 0
+ * Notes:
+ *      Output not drained stays kept, however much there is
+ ****************************************************************************/
+size_t io_drain(um_io_t io, uint8_t *bytes, size_t cap)
+{
+        assert(io != NULL && io->hosted);
+        io_flush(io);
+        size_t n = (io->kept_len < cap) ? io->kept_len : cap;
+        if (n == 0) {
+                return 0;
+        }
+        memcpy(bytes, io->kept, n);
+        memmove(io->kept, io->kept + n, io->kept_len - n);
+        io->kept_len -= n;
+        return n;
+}
+
+/**********free_io************************************************************
+ *
+ * Purpose:
+ *      Frees a program's I/O buffers
+ * Parameters:
+ *      um_io_t *io: buffers to free; set to NULL
+ * Returns:
+ *      None
+ * Expects:
+ *      io and *io to be non-NULL
+ * Notes:
+ *      Buffered output is dropped: call io_flush first
+ ****************************************************************************/
+void free_io(um_io_t *io)
+{
+        assert(io != NULL && *io != NULL);
+        free((*io)->kept);
+        free(*io);
+        *io = NULL;
+}
@@ -0,0 +1,133 @@
+/*****************************************************************************
+ *
+ *                       io.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM I/O header, contains the buffers Output and Input go
+ *               through instead of stdio or, through libum, to and from
+ *               the host, and the inline functions the engines call for
+ *               them.
+ *
+ ****************************************************************************/
+#ifndef UM_IO
+#define UM_IO
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Bytes buffered on each side */
+#define IO_BUF_BYTES ((size_t) 64 * 1024)
+
+/* UM I/O struct
+ *
+ * Purpose: buffers the program's output to fd 1 and reads ahead of its
+ *          input from fd 0
+ * Members:
+ *      - uint8_t out[]: output not yet written
+ *      - size_t out_len: bytes in out
+ *      - bool hosted: input is fed and output drained by a host (libum.h)
+ *        instead of fds 0 and 1
+ *      - bool line_flush: output goes to a terminal, so every newline
+ *        writes it out, as stdio would
+ *      - uint8_t in[]: input read but not yet consumed
+ *      - size_t in_next, in_len: next byte of in to consume, and bytes in
+ *        in
+ *      - bool in_eof: fd 0 has reported end of file
+ *      - uint64_t in_total: bytes read from fd 0 in all, for a checkpoint
+ *        (checkpoint.h) to count the input consumed
+ *      - bool keep: a copy of all output is kept, for a snapshot
+ *        (snapshot.h) or checkpoint to replay, or for the host to drain
+ *      - uint8_t *kept: the copy, of kept_len bytes in kept_cap
+ */
+typedef struct um_io {
+        uint8_t out[IO_BUF_BYTES];
+        size_t out_len;
+        bool hosted;
+        bool line_flush;
+        uint8_t in[IO_BUF_BYTES];
+        size_t in_next, in_len;
+        bool in_eof;
+        uint64_t in_total;
+        bool keep;
+        uint8_t *kept;
+        size_t kept_len, kept_cap;
+} *um_io_t;
+
+um_io_t new_io(bool hosted);
+void io_flush(um_io_t io);
+uint32_t io_fill(um_io_t io);
+void io_keep(um_io_t io, bool keep);
+bool io_read_any(um_io_t io);
+void io_skip(um_io_t io, uint64_t bytes);
+size_t io_feed(um_io_t io, const uint8_t *bytes, size_t len);
+void io_end_input(um_io_t io);
+size_t io_drain(um_io_t io, uint8_t *bytes, size_t cap);
+void free_io(um_io_t *io);
+
+/**********io_put*************************************************************
+ *
+ * Purpose:
+ *      Outputs one byte
+ * Parameters:
+ *      um_io_t io: the program's I/O
+ *      uint8_t byte: byte to output
+ * Returns:
+ *      None
+ * Expects:
+ *      io to be non-NULL
+ * Notes:
+ *      Written out when the buffer fills, at a newline on a terminal, or
+ *      by io_flush
+ ****************************************************************************/
+static inline void io_put(um_io_t io, uint8_t byte)
+{
+        io->out[io->out_len++] = byte;
+        if (io->out_len == IO_BUF_BYTES ||
+            (byte == '\n' && io->line_flush)) {
+                io_flush(io);
+        }
+}
+
+/**********io_get*************************************************************
+ *
+ * Purpose:
+ *      Inputs one byte
+ * Parameters:
+ *      um_io_t io: the program's I/O
+ * Returns:
+ *      The byte, or all 1's at end of file
+ * Expects:
+ *      io to be non-NULL
+ * Notes:
+ *      Reads ahead only when the buffer is empty (io_fill)
+ ****************************************************************************/
+static inline uint32_t io_get(um_io_t io)
+{
+        if (io->in_next < io->in_len) {
+                return io->in[io->in_next++];
+        }
+        return io_fill(io);
+}
+
+/**********io_starved*********************************************************
+ *
+ * Purpose:
+ *      Tells whether an Input now would have to wait for the host
+ * Parameters:
+ *      um_io_t io: the program's I/O
+ * Returns:
+ *      true if io is hosted, all input fed so far is consumed, and the
+ *      host has not ended input
+ * Expects:
+ *      io to be non-NULL
+ * Notes:
+ *      For run_um_quota (engine.c), which stops before such an Input
+ ****************************************************************************/
+static inline bool io_starved(um_io_t io)
+{
+        return io->hosted && io->in_next == io->in_len && !io->in_eof;
+}
+#endif
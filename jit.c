@@ -0,0 +1,775 @@
+/*****************************************************************************
+ *
+ *                       jit.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM JIT module, compiles hot basic blocks of segment 0 to
+ *               x86-64 machine code with no outside libraries.
+ *
+ *               Engines count jumps (Load_program with r[B] == 0) to each
+ *               program counter; after JIT_THRESHOLD jumps the block
+ *               starting there is compiled. A block runs until Halt, I/O,
+ *               or a Load_program, and leaves early ("side exit") at a
+ *               Segment_store whose r[A] turns out to be 0 or the segment
+ *               that segment 0 shares storage with (um_ops.h), so every
+ *               change to segment 0 still goes through the interpreter. The
+ *               instruction cache tells the JIT about those changes:
+ *               overwriting a compiled word, or loading a new segment 0,
+ *               throws all native code away.
+ *
+ *               Generated code keeps rbx pointing at the um_state and works
+ *               on the registers in um->r. Map_segment and Unmap_segment
+ *               call their handlers from execute_table.
+ *
+ *               A block that ends in a jump ends in an inline cache: a
+ *               compare of the target against the one pc it was patched
+ *               for, and a direct jump into that block's body. Until it is
+ *               patched, or when the compare fails, the block returns the
+ *               target and the cache's address, and run_jit looks the
+ *               target up and patches the cache if it is still empty. Hot
+ *               loops of blocks then run without coming back to C at all.
+ *               Patched jumps live in the code buffer, so every flush
+ *               (a new segment 0, or code overwritten) drops them too.
+ *
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <assert.h>
+#include "jit.h"
+#include "fusion.h"
+#include "execute_inst.h"
+#include "block_opt.h"
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+
+/* Size of the executable buffer; when it fills, all blocks are dropped */
+#define JIT_CODE_SIZE (64 * 1024 * 1024)
+
+/* Longest block compiled, and the most bytes one UM instruction needs */
+#define MAX_BLOCK_INSTS 256
+#define MAX_INST_BYTES 128
+
+/* Bytes of "push rbx ; mov rbx, rdi" before a block's body */
+#define BLOCK_PROLOGUE_LEN 4
+
+/* Inline cache layout: cmp eax, target ; jne miss ; jmp body */
+#define IC_TARGET_OFFSET 1
+#define IC_JUMP_END 16
+#define IC_NO_TARGET UINT32_MAX
+
+/* x86-64 register numbers */
+enum { EAX = 0, ECX = 1, EDX = 2, EBX = 3, ESI = 6, EDI = 7 };
+
+#define REG_DISP(i) ((int32_t) ((i) * sizeof(uint32_t)))
+#define STATE_DISP(member) ((int32_t) offsetof(struct um_state, member))
+
+/**********emitters***********************************************************
+ *
+ * Each emit_* appends one x86-64 instruction at jit->code + code_used.
+ * Callers make sure there is room (see compile_block). [rbx + disp] means
+ * a field of the um_state, most often a UM register.
+ ****************************************************************************/
+static void emit8(jit_t jit, uint8_t byte)
+{
+        jit->code[jit->code_used++] = byte;
+}
+
+static void emit32(jit_t jit, uint32_t word)
+{
+        memcpy(jit->code + jit->code_used, &word, sizeof(word));
+        jit->code_used += sizeof(word);
+}
+
+static void emit64(jit_t jit, uint64_t word)
+{
+        memcpy(jit->code + jit->code_used, &word, sizeof(word));
+        jit->code_used += sizeof(word);
+}
+
+/* opcode bytes, then a ModRM for reg (or /digit) and [rbx + disp] */
+static void emit_rbx_op(jit_t jit, const char *opcode, int reg, int32_t disp)
+{
+        for (const char *byte = opcode; *byte != '\0'; byte++) {
+                emit8(jit, (uint8_t) *byte);
+        }
+        if (disp >= -128 && disp <= 127) {
+                emit8(jit, 0x40 | (reg << 3) | EBX);
+                emit8(jit, (uint8_t) disp);
+        } else {
+                emit8(jit, 0x80 | (reg << 3) | EBX);
+                emit32(jit, (uint32_t) disp);
+        }
+}
+
+/* mov reg, [rbx + disp] */
+static void emit_load(jit_t jit, int reg, int32_t disp)
+{
+        emit_rbx_op(jit, "\x8b", reg, disp);
+}
+
+/* mov [rbx + disp], reg */
+static void emit_store(jit_t jit, int reg, int32_t disp)
+{
+        emit_rbx_op(jit, "\x89", reg, disp);
+}
+
+/* mov dword [rbx + disp], imm32 */
+static void emit_store_imm(jit_t jit, int32_t disp, uint32_t imm)
+{
+        emit_rbx_op(jit, "\xc7", 0, disp);
+        emit32(jit, imm);
+}
+
+/* jcc rel32 with the offset left for patch_jump; returns its position */
+static size_t emit_jump(jit_t jit, uint8_t cc)
+{
+        emit8(jit, 0x0f);
+        emit8(jit, cc);
+        emit32(jit, 0);
+        return jit->code_used;
+}
+
+/* point the jump ending at jump_end to the current position */
+static void patch_jump(jit_t jit, size_t jump_end)
+{
+        uint32_t rel = (uint32_t) (jit->code_used - jump_end);
+        memcpy(jit->code + jump_end - sizeof(rel), &rel, sizeof(rel));
+}
+
+#define JZ 0x84
+#define JNZ 0x85
+
+#ifdef UM_FLAT
+/* turn the word offset in rsi into an address:
+ *      shl rsi, 2
+ *      add rsi, [rbx + seg_base]
+ */
+static void emit_seg_address(jit_t jit)
+{
+        emit8(jit, 0x48);
+        emit8(jit, 0xc1);
+        emit8(jit, 0xe6);
+        emit8(jit, 0x02);
+        emit8(jit, 0x48);
+        emit_rbx_op(jit, "\x03", ESI, STATE_DISP(seg_base));
+}
+#endif
+
+/* load the spine entry for the segment id in eax into rsi:
+ *      mov rsi, [rbx + mem_seq]
+ *      mov rsi, [rsi + rax * 8]
+ * or, with 32-bit offsets as entries (engine.h):
+ *      mov esi, [rsi + rax * 4]
+ * followed by emit_seg_address
+ */
+static void emit_segment(jit_t jit)
+{
+        emit8(jit, 0x48);
+        emit_load(jit, ESI, STATE_DISP(mem_seq));
+#ifdef UM_FLAT
+        emit8(jit, 0x8b);
+        emit8(jit, 0x34);
+        emit8(jit, 0x86);
+        emit_seg_address(jit);
+#else
+        emit8(jit, 0x48);
+        emit8(jit, 0x8b);
+        emit8(jit, 0x34);
+        emit8(jit, 0xc6);
+#endif
+}
+
+/* add qword [rbx + jit_insts], insts */
+static void emit_count(jit_t jit, uint32_t insts)
+{
+        emit8(jit, 0x48);
+        emit_rbx_op(jit, "\x81", 0, STATE_DISP(jit_insts));
+        emit32(jit, insts);
+}
+
+/**********emit_exit**********************************************************
+ *
+ * Purpose:
+ *      Emits a return from the block: counts the UM instructions it ran
+ *      and hands ret back to run_jit
+ * Parameters:
+ *      jit_t jit: JIT to emit into
+ *      uint32_t insts: UM instructions run before this exit
+ *      uint64_t ret: value to return in next
+ * Returns:
+ *      None
+ * Expects:
+ *      ret to have JIT_INTERPRET set; the ic half of the return is unset
+ * Notes:
+ *      mov rax, ret ; pop rbx ; ret
+ ****************************************************************************/
+static void emit_exit(jit_t jit, uint32_t insts, uint64_t ret)
+{
+        emit_count(jit, insts);
+        emit8(jit, 0x48);
+        emit8(jit, 0xb8);
+        emit64(jit, ret);
+        emit8(jit, 0x5b);
+        emit8(jit, 0xc3);
+}
+
+/**********emit_jump_exit*****************************************************
+ *
+ * Purpose:
+ *      Emits the end of a block whose last instruction is a jump to r[C]:
+ *      an empty inline cache, then a return of the target and the cache
+ * Parameters:
+ *      jit_t jit: JIT to emit into
+ *      uint8_t C: register holding the jump target
+ *      uint32_t insts: UM instructions run by the block, the jump included
+ * Returns:
+ *      None
+ * Expects:
+ *      None
+ * Notes:
+ *      The jmp starts out jumping to the miss path right after it, and
+ *      patch_ic points it at a block's body once the compare is set.
+ ****************************************************************************/
+static void emit_jump_exit(jit_t jit, uint8_t C, uint32_t insts)
+{
+        emit_load(jit, EAX, REG_DISP(C));
+        emit_count(jit, insts);
+
+        uint8_t *ic = jit->code + jit->code_used;
+        /* cmp eax, imm32 */
+        emit8(jit, 0x3d);
+        emit32(jit, IC_NO_TARGET);
+        size_t miss = emit_jump(jit, JNZ);
+        /* jmp rel32 */
+        emit8(jit, 0xe9);
+        emit32(jit, 0);
+        patch_jump(jit, miss);
+
+        /* mov rdx, ic ; pop rbx ; ret (rax is the zero-extended target) */
+        emit8(jit, 0x48);
+        emit8(jit, 0xba);
+        emit64(jit, (uint64_t) (uintptr_t) ic);
+        emit8(jit, 0x5b);
+        emit8(jit, 0xc3);
+}
+
+/**********patch_ic***********************************************************
+ *
+ * Purpose:
+ *      Points an empty inline cache at the block compiled for target
+ * Parameters:
+ *      jit_t jit: the JIT tier
+ *      uint8_t *ic: inline cache returned by a block
+ *      uint32_t target: the pc that cache missed on
+ *      jit_block_fn block: block starting at target
+ * Returns:
+ *      None
+ * Expects:
+ *      ic to be in the code buffer as it is now (no flush since it missed)
+ * Notes:
+ *      Caches are monomorphic: one already patched for another target is
+ *      left alone, and its misses keep going through run_jit.
+ ****************************************************************************/
+static void patch_ic(jit_t jit, uint8_t *ic, uint32_t target,
+                     jit_block_fn block)
+{
+        uint32_t cached;
+        memcpy(&cached, ic + IC_TARGET_OFFSET, sizeof(cached));
+        if (cached != IC_NO_TARGET) {
+                return;
+        }
+        uint8_t *body;
+        memcpy(&body, &block, sizeof(body));
+        body += BLOCK_PROLOGUE_LEN;
+        uint32_t rel = (uint32_t) (body - (ic + IC_JUMP_END));
+        memcpy(ic + IC_JUMP_END - sizeof(rel), &rel, sizeof(rel));
+        memcpy(ic + IC_TARGET_OFFSET, &target, sizeof(target));
+        jit->chained++;
+}
+
+/**********emit_inst**********************************************************
+ *
+ * Purpose:
+ *      Emits native code for one UM instruction that does not end a block
+ * Parameters:
+ *      jit_t jit: JIT to emit into
+ *      inst_decoded_t inst: the instruction, with its plain opcode in OP
+ *      uint32_t prog_counter: where the instruction is in segment 0
+ *      uint32_t done: UM instructions already run in this block
+ * Returns:
+ *      None
+ * Expects:
+ *      inst.OP to be one of CMOV - NAND, ACTIVATE, or INACTIVATE
+ * Notes:
+ *      Segment_store emits a side exit back to the interpreter when
+ *      r[A] is 0 or shares storage with segment 0, before anything is
+ *      written.
+ ****************************************************************************/
+static void emit_inst(jit_t jit, inst_decoded_t inst, uint32_t prog_counter,
+                      uint32_t done)
+{
+        int32_t A = REG_DISP(inst.A);
+        int32_t B = REG_DISP(inst.B);
+        int32_t C = REG_DISP(inst.C);
+        switch (inst.OP) {
+                case CMOV:
+                        /* mov ecx, r[C] ; mov eax, r[A] ; test ecx, ecx ;
+                         * cmovne eax, r[B] ; mov r[A], eax
+                         */
+                        emit_load(jit, ECX, C);
+                        emit_load(jit, EAX, A);
+                        emit8(jit, 0x85);
+                        emit8(jit, 0xc9);
+                        emit_rbx_op(jit, "\x0f\x45", EAX, B);
+                        emit_store(jit, EAX, A);
+                        break;
+                case SLOAD:
+                        /* id = r[B] == 0 ? 1 : r[B] ; r[A] = seg[r[C] + 1] */
+                        emit_load(jit, EAX, B);
+                        emit8(jit, 0xb9);
+                        emit32(jit, 1);
+                        emit8(jit, 0x85);
+                        emit8(jit, 0xc0);
+                        emit8(jit, 0x0f);
+                        emit8(jit, 0x44);
+                        emit8(jit, 0xc1);
+                        emit_segment(jit);
+                        emit_load(jit, EAX, C);
+                        /* mov eax, [rsi + rax * 4 + 4] */
+                        emit8(jit, 0x8b);
+                        emit8(jit, 0x44);
+                        emit8(jit, 0x86);
+                        emit8(jit, 0x04);
+                        emit_store(jit, EAX, A);
+                        break;
+                case SSTORE: {
+                        /* test eax, eax ; jz exit ;
+                         * mov rsi, [rbx + mem_seq] ; mov rsi, [rsi] ;
+                         * cmp eax, [rsi + 4 * META_SHARED] ; jne store
+                         * (flat: mov esi, [rsi], then emit_seg_address)
+                         */
+                        emit_load(jit, EAX, A);
+                        emit8(jit, 0x85);
+                        emit8(jit, 0xc0);
+                        size_t seg_0 = emit_jump(jit, JZ);
+                        emit8(jit, 0x48);
+                        emit_load(jit, ESI, STATE_DISP(mem_seq));
+#ifdef UM_FLAT
+                        emit8(jit, 0x8b);
+                        emit8(jit, 0x36);
+                        emit_seg_address(jit);
+#else
+                        emit8(jit, 0x48);
+                        emit8(jit, 0x8b);
+                        emit8(jit, 0x36);
+#endif
+                        emit8(jit, 0x3b);
+                        emit8(jit, 0x46);
+                        emit8(jit, 4 * META_SHARED);
+                        size_t not_shared = emit_jump(jit, JNZ);
+                        patch_jump(jit, seg_0);
+                        emit_exit(jit, done, JIT_INTERPRET | prog_counter);
+                        patch_jump(jit, not_shared);
+                        emit_segment(jit);
+                        emit_load(jit, EAX, B);
+                        emit_load(jit, ECX, C);
+                        /* mov [rsi + rax * 4 + 4], ecx */
+                        emit8(jit, 0x89);
+                        emit8(jit, 0x4c);
+                        emit8(jit, 0x86);
+                        emit8(jit, 0x04);
+                        break;
+                }
+                case ADD:
+                        emit_load(jit, EAX, B);
+                        emit_rbx_op(jit, "\x03", EAX, C);
+                        emit_store(jit, EAX, A);
+                        break;
+                case MUL:
+                        emit_load(jit, EAX, B);
+                        emit_rbx_op(jit, "\x0f\xaf", EAX, C);
+                        emit_store(jit, EAX, A);
+                        break;
+                case DIV:
+                        /* xor edx, edx ; div dword r[C] */
+                        emit_load(jit, EAX, B);
+                        emit8(jit, 0x31);
+                        emit8(jit, 0xd2);
+                        emit_rbx_op(jit, "\xf7", 6, C);
+                        emit_store(jit, EAX, A);
+                        break;
+                case NAND:
+                        /* and eax, r[C] ; not eax */
+                        emit_load(jit, EAX, B);
+                        emit_rbx_op(jit, "\x23", EAX, C);
+                        emit8(jit, 0xf7);
+                        emit8(jit, 0xd0);
+                        emit_store(jit, EAX, A);
+                        break;
+                case ACTIVATE:
+                case INACTIVATE:
+                        /* handler(um, prog_counter + 1):
+                         * mov rdi, rbx ; mov esi, imm32 ;
+                         * mov rax, imm64 ; call rax
+                         */
+                        emit8(jit, 0x48);
+                        emit8(jit, 0x89);
+                        emit8(jit, 0xdf);
+                        emit8(jit, 0xbe);
+                        emit32(jit, prog_counter + 1);
+                        emit8(jit, 0x48);
+                        emit8(jit, 0xb8);
+                        emit64(jit, (uint64_t) (uintptr_t)
+                                    execute_table[inst.val]);
+                        emit8(jit, 0xff);
+                        emit8(jit, 0xd0);
+                        break;
+                default:
+                        assert(0);
+        }
+}
+
+/**********compile_block******************************************************
+ *
+ * Purpose:
+ *      Compiles the basic block starting at prog_counter
+ * Parameters:
+ *      jit_t jit: JIT to compile into
+ *      const inst_decoded_t *slots: decoded segment 0
+ *      uint32_t prog_counter: first instruction of the block
+ * Returns:
+ *      the compiled block, or NULL if the block would be empty
+ * Expects:
+ *      prog_counter < jit->len
+ * Notes:
+ *      Flushes every block if the code buffer cannot hold another one.
+ *      The block is run through optimize_block (block_opt.h) first:
+ *      folded instructions store their constant, dead ones emit nothing,
+ *      and both still count as run. Load_program ends the block: with
+ *      r[B] == 0 it goes through the block's inline cache (see
+ *      emit_jump_exit).
+ ****************************************************************************/
+static jit_block_fn compile_block(jit_t jit, const inst_decoded_t *slots,
+                                  uint32_t prog_counter)
+{
+        opt_inst_t block[MAX_BLOCK_INSTS];
+        uint32_t len = 0;
+        bool ends_in_loadp = false;
+        while (len < MAX_BLOCK_INSTS && prog_counter + len < jit->len) {
+                inst_decoded_t inst = slots[prog_counter + len];
+                if (len == 0 && inst.OP >= FIRST_IDIOM &&
+                    inst.OP < END_IDIOM) {
+                        /* leave recognized loops to run_idiom */
+                        break;
+                }
+                inst.OP = unfused_op(idiom_plain_op(inst.OP));
+                if (inst.OP == HALT || inst.OP == OUT || inst.OP == IN ||
+                    inst.OP > LV) {
+                        /* Halt, I/O, and invalid opcodes end the block */
+                        break;
+                }
+                block[len] = (opt_inst_t) { .inst = inst };
+                len++;
+                if (inst.OP == LOADP) {
+                        ends_in_loadp = true;
+                        break;
+                }
+        }
+        if (len == 0) {
+                return NULL;
+        }
+        optimize_block(block, len);
+
+        if (jit->code_cap - jit->code_used <
+            (MAX_BLOCK_INSTS + 2) * MAX_INST_BYTES) {
+                reset_jit(jit, jit->len);
+                jit->flushes++;
+        }
+        uint8_t *start = jit->code + jit->code_used;
+        /* push rbx ; mov rbx, rdi */
+        emit8(jit, 0x53);
+        emit8(jit, 0x48);
+        emit8(jit, 0x89);
+        emit8(jit, 0xfb);
+
+        for (uint32_t done = 0; done < len; done++) {
+                uint32_t pc = prog_counter + done;
+                inst_decoded_t inst = block[done].inst;
+                jit->covered[pc] = 1;
+                if (block[done].dead) {
+                        jit->dead_writes++;
+                } else if (block[done].folded) {
+                        emit_store_imm(jit, REG_DISP(inst.A),
+                                       block[done].value);
+                        jit->folded += (inst.OP != LV);
+                } else if (inst.OP == LOADP) {
+                        /* anything but a jump goes back to the engine */
+                        emit_load(jit, EAX, REG_DISP(inst.B));
+                        emit8(jit, 0x85);
+                        emit8(jit, 0xc0);
+                        size_t jump = emit_jump(jit, JZ);
+                        emit_exit(jit, done, JIT_INTERPRET | pc);
+                        patch_jump(jit, jump);
+                        emit_jump_exit(jit, inst.C, done + 1);
+                } else {
+                        emit_inst(jit, inst, pc, done);
+                }
+        }
+        if (!ends_in_loadp) {
+                emit_exit(jit, len, JIT_INTERPRET | (prog_counter + len));
+        }
+
+        jit_block_fn compiled;
+        memcpy(&compiled, &start, sizeof(compiled));
+        jit->entry[prog_counter] = compiled;
+        jit->blocks++;
+        return compiled;
+}
+
+/**********new_jit************************************************************
+ *
+ * Purpose:
+ *      Sets up the JIT tier with an empty executable buffer
+ * Parameters:
+ *      None
+ * Returns:
+ *      the JIT, or NULL if executable memory is not available
+ * Expects:
+ *      None
+ * Notes:
+ *      Caller must reset_jit for segment 0 before running, and free with
+ *      free_jit
+ ****************************************************************************/
+jit_t new_jit(void)
+{
+        void *code = mmap(NULL, JIT_CODE_SIZE,
+                          PROT_READ | PROT_WRITE | PROT_EXEC,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED) {
+                return NULL;
+        }
+        jit_t jit = calloc(1, sizeof(*jit));
+        assert(jit != NULL);
+        jit->code = code;
+        jit->code_cap = JIT_CODE_SIZE;
+        return jit;
+}
+
+/**********free_jit***********************************************************
+ *
+ * Purpose:
+ *      Frees the JIT and its code and sets the caller's handle to NULL
+ * Parameters:
+ *      jit_t *jit: pointer to the JIT to free
+ * Returns:
+ *      None
+ * Expects:
+ *      jit to be non-NULL; *jit may be NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+void free_jit(jit_t *jit)
+{
+        assert(jit != NULL);
+        if (*jit == NULL) {
+                return;
+        }
+        munmap((*jit)->code, (*jit)->code_cap);
+        free((*jit)->entry);
+        free((*jit)->counts);
+        free((*jit)->covered);
+        free(*jit);
+        *jit = NULL;
+}
+#else
+/* no native code tier off x86-64 */
+jit_t new_jit(void)
+{
+        return NULL;
+}
+
+void free_jit(jit_t *jit)
+{
+        (void) jit;
+}
+
+static jit_block_fn compile_block(jit_t jit, const inst_decoded_t *slots,
+                                  uint32_t prog_counter)
+{
+        (void) jit;
+        (void) slots;
+        (void) prog_counter;
+        return NULL;
+}
+
+static void patch_ic(jit_t jit, uint8_t *ic, uint32_t target,
+                     jit_block_fn block)
+{
+        (void) jit;
+        (void) ic;
+        (void) target;
+        (void) block;
+}
+#endif /* __x86_64__ */
+
+/**********reset_jit**********************************************************
+ *
+ * Purpose:
+ *      Drops all native code and resizes the per-word tables for a
+ *      segment 0 of len words
+ * Parameters:
+ *      jit_t jit: the JIT tier
+ *      uint32_t len: words in segment 0
+ * Returns:
+ *      None
+ * Expects:
+ *      jit to be non-NULL
+ * Notes:
+ *      Jump counts are kept when len is unchanged (a flush of the same
+ *      program), so hot blocks are recompiled on their next jump. A new
+ *      length means a new program, and counting starts over.
+ ****************************************************************************/
+void reset_jit(jit_t jit, uint32_t len)
+{
+        assert(jit != NULL);
+        if (len > jit->cap) {
+                free(jit->entry);
+                free(jit->counts);
+                free(jit->covered);
+                jit->entry = malloc(((size_t) len) * sizeof(jit_block_fn));
+                jit->counts = malloc(((size_t) len) * sizeof(uint32_t));
+                jit->covered = malloc(len);
+                assert(jit->entry != NULL && jit->counts != NULL &&
+                       jit->covered != NULL);
+                jit->cap = len;
+                jit->len = 0;
+        }
+        if (len != jit->len) {
+                memset(jit->counts, 0, ((size_t) len) * sizeof(uint32_t));
+        }
+        memset(jit->entry, 0, ((size_t) len) * sizeof(jit_block_fn));
+        memset(jit->covered, 0, len);
+        jit->len = len;
+        jit->code_used = 0;
+}
+
+/**********invalidate_jit_word************************************************
+ *
+ * Purpose:
+ *      Keeps native code in sync after word idx of segment 0 was overwritten
+ * Parameters:
+ *      jit_t jit: the JIT tier
+ *      uint32_t idx: index of the overwritten word
+ * Returns:
+ *      None
+ * Expects:
+ *      jit to be non-NULL
+ * Notes:
+ *      Stores into words no block was compiled from (data kept in segment
+ *      0) cost nothing; a store into compiled code drops every block.
+ ****************************************************************************/
+void invalidate_jit_word(jit_t jit, uint32_t idx)
+{
+        if (idx < jit->len && jit->covered[idx]) {
+                reset_jit(jit, jit->len);
+                jit->flushes++;
+        }
+}
+
+/**********run_jit************************************************************
+ *
+ * Purpose:
+ *      Runs compiled blocks starting at prog_counter, compiling hot ones
+ *      as they are reached, until a block hands control back
+ * Parameters:
+ *      jit_t jit: the JIT tier
+ *      um_state_t um: state the blocks run against; um->r must be current
+ *      uint32_t prog_counter: first block to run
+ * Returns:
+ *      the program counter the interpreter continues from
+ * Expects:
+ *      jit_wants(jit, prog_counter) to have returned true
+ * Notes:
+ *      um->r holds the registers on return. Each jump a block could not
+ *      follow on its own gets its inline cache patched here, once the
+ *      target has a block.
+ ****************************************************************************/
+uint32_t run_jit(jit_t jit, um_state_t um, uint32_t prog_counter)
+{
+        const inst_decoded_t *slots = um->slots;
+        uint8_t *ic = NULL;
+        while (1) {
+                jit_block_fn block = jit->entry[prog_counter];
+                if (block == NULL) {
+                        uint32_t count = jit->counts[prog_counter];
+                        if (count == JIT_NEVER || count < JIT_THRESHOLD) {
+                                return prog_counter;
+                        }
+                        uint64_t flushes = jit->flushes;
+                        block = compile_block(jit, slots, prog_counter);
+                        if (block == NULL) {
+                                jit->counts[prog_counter] = JIT_NEVER;
+                                return prog_counter;
+                        }
+                        if (jit->flushes != flushes) {
+                                ic = NULL;
+                        }
+                }
+                if (ic != NULL) {
+                        patch_ic(jit, ic, prog_counter, block);
+                }
+                jit_exit_t result = block(um);
+                prog_counter = (uint32_t) result.next;
+                if ((result.next & JIT_INTERPRET) ||
+                    prog_counter >= jit->len) {
+                        return prog_counter;
+                }
+                ic = result.ic;
+                jit->ic_misses++;
+                if (jit->entry[prog_counter] == NULL &&
+                    jit->counts[prog_counter] != JIT_NEVER) {
+                        jit->counts[prog_counter]++;
+                }
+        }
+}
+
+/**********report_jit*********************************************************
+ *
+ * Purpose:
+ *      Prints how much the JIT compiled and how often it started over
+ * Parameters:
+ *      FILE *out: stream to print to
+ *      jit_t jit: the JIT tier
+ * Returns:
+ *      None
+ * Expects:
+ *      out to be non-NULL
+ * Notes:
+ *      Instructions run natively are reported by the caller, from
+ *      um->jit_insts
+ ****************************************************************************/
+void report_jit(FILE *out, jit_t jit)
+{
+        assert(out != NULL);
+        if (jit == NULL) {
+                return;
+        }
+        fprintf(out, "jit blocks       %llu\n",
+                (unsigned long long) jit->blocks);
+        fprintf(out, "jit flushes      %llu\n",
+                (unsigned long long) jit->flushes);
+        fprintf(out, "jit folded       %llu\n",
+                (unsigned long long) jit->folded);
+        fprintf(out, "jit dead writes  %llu\n",
+                (unsigned long long) jit->dead_writes);
+        fprintf(out, "jit chained      %llu\n",
+                (unsigned long long) jit->chained);
+        fprintf(out, "jit ic misses    %llu\n",
+                (unsigned long long) jit->ic_misses);
+}
@@ -0,0 +1,107 @@
+/*****************************************************************************
+ *
+ *                       jit.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM JIT header, contains the native code tier for hot basic
+ *               blocks of segment 0 and declarations for the functions the
+ *               engines and the instruction cache use to drive it.
+ *
+ ****************************************************************************/
+#ifndef JIT
+#define JIT
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "engine.h"
+
+/* Jumps to a block start before it is compiled */
+#define JIT_THRESHOLD 32
+
+/* counts[] value for a block start that cannot be compiled */
+#define JIT_NEVER UINT32_MAX
+
+/* A compiled block runs against um->r and returns the next program
+ * counter in the low 32 bits of next. Bit 32 is set when the instruction at
+ * that program counter must be run by the interpreter (Halt, I/O,
+ * Load_program of a new segment, or a Segment_store into segment 0).
+ * Otherwise the block ended in a jump its inline cache could not follow,
+ * and ic points at that cache so run_jit can patch it.
+ */
+typedef struct jit_exit {
+        uint64_t next;
+        uint8_t *ic;
+} jit_exit_t;
+typedef jit_exit_t (*jit_block_fn)(um_state_t um);
+#define JIT_INTERPRET ((uint64_t) 1 << 32)
+
+/* JIT struct
+ *
+ * Purpose: native code for segment 0 and the bookkeeping to promote and
+ *          invalidate it
+ * Members:
+ *      - uint8_t *code: executable buffer that blocks are emitted into
+ *      - size_t code_used, code_cap: bytes of code used and available
+ *      - jit_block_fn *entry: entry[pc] is the block starting at pc, if any
+ *      - uint32_t *counts: jumps to each pc so far, or JIT_NEVER
+ *      - uint8_t *covered: covered[i] is nonzero if word i is compiled
+ *      - uint32_t len, cap: words of segment 0 tracked, and allocated
+ *      - uint64_t blocks, flushes: blocks compiled and full flushes so far
+ *      - uint64_t chained: inline caches patched to jump straight to a block
+ *      - uint64_t ic_misses: jumps that came back to run_jit for a lookup
+ *      - uint64_t folded, dead_writes: instructions compiled to a constant
+ *        store, or to nothing, by the block optimizer (block_opt.h)
+ */
+typedef struct jit {
+        uint8_t *code;
+        size_t code_used, code_cap;
+        jit_block_fn *entry;
+        uint32_t *counts;
+        uint8_t *covered;
+        uint32_t len, cap;
+        uint64_t blocks, flushes;
+        uint64_t chained, ic_misses;
+        uint64_t folded, dead_writes;
+} *jit_t;
+
+jit_t new_jit(void);
+void reset_jit(jit_t jit, uint32_t len);
+void invalidate_jit_word(jit_t jit, uint32_t idx);
+uint32_t run_jit(jit_t jit, um_state_t um, uint32_t prog_counter);
+void report_jit(FILE *out, jit_t jit);
+void free_jit(jit_t *jit);
+
+/**********jit_wants**********************************************************
+ *
+ * Purpose:
+ *      Counts a jump to prog_counter and decides whether the engine should
+ *      hand control to the JIT there
+ * Parameters:
+ *      jit_t jit: the JIT tier
+ *      uint32_t prog_counter: target of the jump just taken
+ * Returns:
+ *      true if the block at prog_counter is compiled or just became hot
+ * Expects:
+ *      jit to be non-NULL
+ * Notes:
+ *      Inline because engines call it on every jump.
+ ****************************************************************************/
+static inline bool jit_wants(jit_t jit, uint32_t prog_counter)
+{
+        if (prog_counter >= jit->len) {
+                return false;
+        }
+        if (jit->entry[prog_counter] != NULL) {
+                return true;
+        }
+        uint32_t count = jit->counts[prog_counter];
+        if (count == JIT_NEVER) {
+                return false;
+        }
+        jit->counts[prog_counter] = count + 1;
+        return count + 1 >= JIT_THRESHOLD;
+}
+#endif
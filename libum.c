@@ -0,0 +1,286 @@
+/*****************************************************************************
+ *
+ *                       libum.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: libum, the UM as a library. A machine is a um_state, as
+ *               ./um runs, with hosted I/O (io.c) and nothing global: its
+ *               segments come from a pool of its own in heap mode, and it
+ *               runs on run_um_quota (engine.c), the interpreter with a
+ *               dispatch quota. Nothing here installs a signal handler or
+ *               exits, so machines on different threads do not meet.
+ *
+ *               A quota counts dispatches, as -s reports them: a fused
+ *               slot stands for up to three instructions, and an idiom
+ *               for a whole loop, so a quota of N runs at least N
+ *               instructions unless the program stops first.
+ *
+ *               A program that goes wrong (say, divides by zero) goes
+ *               wrong as it would under ./um; libum does not check it.
+ *
+ ****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "libum.h"
+#include "engine.h"
+#include "memory.h"
+#include "io.h"
+#include "load.h"
+
+#define BYTES_PER_WORD 4
+
+/* UM machine struct
+ *
+ * Purpose: one machine of libum
+ * Members:
+ *      - struct um_state um: its state, first, so the members engine.h
+ *        packs into one cache line start the allocation
+ *      - bool loaded: a program is loaded
+ *      - bool halted: the program has run Halt
+ */
+struct um_vm {
+        struct um_state um;
+        bool loaded;
+        bool halted;
+};
+
+/**********new_um_vm**********************************************************
+ *
+ * Purpose:
+ *      Makes a machine with no program
+ * Parameters:
+ *      None
+ * Returns:
+ *      The machine
+ * Expects:
+ *      None
+ * Notes:
+ *      Must be freed with free_um_vm
+ ****************************************************************************/
+um_vm_t new_um_vm(void)
+{
+        void *mem;
+        int failed = posix_memalign(&mem, __alignof__(struct um_vm),
+                                    sizeof(struct um_vm));
+        assert(failed == 0);
+        (void) failed;
+        um_vm_t vm = mem;
+        memset(vm, 0, sizeof(*vm));
+        vm->um.io = new_io(true);
+        return vm;
+}
+
+/**********um_vm_load*********************************************************
+ *
+ * Purpose:
+ *      Loads a program, as the bytes of a .um file, into a machine
+ * Parameters:
+ *      um_vm_t vm: machine with no program
+ *      const uint8_t *bytes: the program's big-endian words
+ *      size_t size: bytes of it
+ * Returns:
+ *      true, or false if a program is already loaded, size is not a whole
+ *      number of words below 2^32, or memory could not be set up
+ * Expects:
+ *      vm to be non-NULL, and bytes to be non-NULL if size > 0
+ * Notes:
+ *      bytes are copied; the program starts at its first word
+ ****************************************************************************/
+bool um_vm_load(um_vm_t vm, const uint8_t *bytes, size_t size)
+{
+        assert(vm != NULL);
+        if (vm->loaded || size % BYTES_PER_WORD != 0 ||
+            size / BYTES_PER_WORD >= UINT32_MAX) {
+                return false;
+        }
+        uint32_t num_words = size / BYTES_PER_WORD;
+        um_state_t um = &vm->um;
+        if (!new_memory(um, num_words, MEM_HEAP)) {
+                return false;
+        }
+        uint32_t *m_0 = SEG(um, um->mem_seq[1]);
+        load_words(m_0 + 1, bytes, num_words);
+        /* run_um_quota is a switch or threaded loop: it runs fused slots */
+        um->cache = new_inst_cache(true);
+        build_inst_cache(um->cache, m_0 + 1, num_words);
+        set_slots(um);
+        vm->loaded = true;
+        return true;
+}
+
+/**********um_vm_load_file****************************************************
+ *
+ * Purpose:
+ *      Loads a .um file into a machine
+ * Parameters:
+ *      um_vm_t vm: machine with no program
+ *      const char *path: the file
+ * Returns:
+ *      true, or false if the file could not be read or um_vm_load failed
+ * Expects:
+ *      vm and path to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+bool um_vm_load_file(um_vm_t vm, const char *path)
+{
+        assert(vm != NULL && path != NULL);
+        program_image image;
+        if (!map_program(path, &image)) {
+                return false;
+        }
+        bool loaded = um_vm_load(vm, image.bytes, image.size);
+        unmap_program(&image);
+        return loaded;
+}
+
+/**********um_vm_run**********************************************************
+ *
+ * Purpose:
+ *      Runs a machine's program for up to quota dispatches
+ * Parameters:
+ *      um_vm_t vm: the machine
+ *      uint64_t quota: dispatches to run at most
+ * Returns:
+ *      UM_VM_HALTED if the program has run Halt, now or before;
+ *      UM_VM_QUOTA if it used up the quota; UM_VM_INPUT if it is at an
+ *      Input and all input fed is consumed; UM_VM_EMPTY if no program is
+ *      loaded
+ * Expects:
+ *      vm to be non-NULL
+ * Notes:
+ *      The next run goes on where this one stopped. A machine at an Input
+ *      stays there until um_vm_feed or um_vm_end_input
+ ****************************************************************************/
+um_vm_status um_vm_run(um_vm_t vm, uint64_t quota)
+{
+        assert(vm != NULL);
+        if (!vm->loaded) {
+                return UM_VM_EMPTY;
+        }
+        if (vm->halted) {
+                return UM_VM_HALTED;
+        }
+        vm->um.quota = quota;
+        run_um_quota(&vm->um);
+        if (vm->um.stopped == RUN_QUOTA) {
+                return UM_VM_QUOTA;
+        }
+        if (vm->um.stopped == RUN_STARVED) {
+                return UM_VM_INPUT;
+        }
+        vm->halted = true;
+        return UM_VM_HALTED;
+}
+
+/**********um_vm_feed*********************************************************
+ *
+ * Purpose:
+ *      Gives a machine's program input
+ * Parameters:
+ *      um_vm_t vm: the machine
+ *      const uint8_t *bytes: input
+ *      size_t len: bytes of input
+ * Returns:
+ *      How many of the bytes were taken, from the first; the rest can be
+ *      fed once the program has consumed some (IO_BUF_BYTES fit at most)
+ * Expects:
+ *      vm to be non-NULL, and bytes to be non-NULL if len > 0
+ * Notes:
+ *      Nothing is taken after um_vm_end_input
+ ****************************************************************************/
+size_t um_vm_feed(um_vm_t vm, const uint8_t *bytes, size_t len)
+{
+        assert(vm != NULL);
+        return io_feed(vm->um.io, bytes, len);
+}
+
+/**********um_vm_end_input****************************************************
+ *
+ * Purpose:
+ *      Ends a machine's input: once its program consumes what was fed,
+ *      Input reads end of file
+ * Parameters:
+ *      um_vm_t vm: the machine
+ * Returns:
+ *      None
+ * Expects:
+ *      vm to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+void um_vm_end_input(um_vm_t vm)
+{
+        assert(vm != NULL);
+        io_end_input(vm->um.io);
+}
+
+/**********um_vm_drain********************************************************
+ *
+ * Purpose:
+ *      Takes output a machine's program has written
+ * Parameters:
+ *      um_vm_t vm: the machine
+ *      uint8_t *bytes: where to copy the output
+ *      size_t cap: room at bytes
+ * Returns:
+ *      Bytes copied, oldest first; 0 if there is no output
+ * Expects:
+ *      vm to be non-NULL, and bytes to be non-NULL if cap > 0
+ * Notes:
+ *      Output not drained is kept, however much there is
+ ****************************************************************************/
+size_t um_vm_drain(um_vm_t vm, uint8_t *bytes, size_t cap)
+{
+        assert(vm != NULL);
+        return io_drain(vm->um.io, bytes, cap);
+}
+
+/**********um_vm_dispatches***************************************************
+ *
+ * Purpose:
+ *      Tells how many dispatches a machine has run in all
+ * Parameters:
+ *      um_vm_t vm: the machine
+ * Returns:
+ *      The sum of the dispatches of every um_vm_run
+ * Expects:
+ *      vm to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+uint64_t um_vm_dispatches(um_vm_t vm)
+{
+        assert(vm != NULL);
+        return vm->um.dispatches;
+}
+
+/**********free_um_vm*********************************************************
+ *
+ * Purpose:
+ *      Frees a machine, its memory, and any output not drained
+ * Parameters:
+ *      um_vm_t *vm: machine to free; set to NULL
+ * Returns:
+ *      None
+ * Expects:
+ *      vm and *vm to be non-NULL
+ * Notes:
+ *      The machine need not have halted
+ ****************************************************************************/
+void free_um_vm(um_vm_t *vm)
+{
+        assert(vm != NULL && *vm != NULL);
+        um_state_t um = &(*vm)->um;
+        if ((*vm)->loaded) {
+                free_memory(um);
+                free_inst_cache(&um->cache);
+        }
+        free_io(&um->io);
+        free(*vm);
+        *vm = NULL;
+}
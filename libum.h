@@ -0,0 +1,44 @@
+/*****************************************************************************
+ *
+ *                       libum.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: libum header, the UM as a library (make libum.a): any
+ *               number of machines in one process, each run a quota of
+ *               instructions at a time, with input fed and output drained
+ *               by the host rather than through fds 0 and 1. Halt is a
+ *               status, not the end of the process.
+ *
+ *               A host program includes only this header and links with
+ *               libum.a -lm -lpthread.
+ *
+ ****************************************************************************/
+#ifndef LIBUM
+#define LIBUM
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* What um_vm_run stopped at */
+typedef enum um_vm_status {
+        UM_VM_HALTED = 0,       /* the program ran Halt */
+        UM_VM_QUOTA,            /* the quota ran out; run it again */
+        UM_VM_INPUT,            /* at an Input: feed it, or end input */
+        UM_VM_EMPTY             /* no program is loaded */
+} um_vm_status;
+
+typedef struct um_vm *um_vm_t;
+
+um_vm_t new_um_vm(void);
+bool um_vm_load(um_vm_t vm, const uint8_t *bytes, size_t size);
+bool um_vm_load_file(um_vm_t vm, const char *path);
+um_vm_status um_vm_run(um_vm_t vm, uint64_t quota);
+size_t um_vm_feed(um_vm_t vm, const uint8_t *bytes, size_t len);
+void um_vm_end_input(um_vm_t vm);
+size_t um_vm_drain(um_vm_t vm, uint8_t *bytes, size_t cap);
+uint64_t um_vm_dispatches(um_vm_t vm);
+void free_um_vm(um_vm_t *vm);
+#endif
@@ -0,0 +1,180 @@
+/*****************************************************************************
+ *
+ *                       load.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM loader. The .um file is mapped rather than read a byte
+ *               at a time, and its big-endian words are byte-swapped
+ *               straight into segment 0, 32 or 16 bytes per step on x86-64
+ *               (AVX2, or SSSE3, whichever the CPU has) and one word per
+ *               step elsewhere.
+ *
+ ****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "load.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+static void load_words_avx2(uint32_t *words, const uint8_t *bytes,
+                            size_t num_words);
+static void load_words_ssse3(uint32_t *words, const uint8_t *bytes,
+                             size_t num_words);
+#endif
+static void load_words_scalar(uint32_t *words, const uint8_t *bytes,
+                              size_t num_words);
+
+/**********map_program********************************************************
+ *
+ * Purpose:
+ *      Maps a .um file read-only
+ * Parameters:
+ *      const char *path: the file
+ *      program_image *image: filled in with the mapping
+ * Returns:
+ *      true, or false if the file could not be opened or mapped
+ * Expects:
+ *      path and image to be non-NULL
+ * Notes:
+ *      The file's length is not checked here. Must be unmapped with
+ *      unmap_program
+ ****************************************************************************/
+bool map_program(const char *path, program_image *image)
+{
+        assert(path != NULL && image != NULL);
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+                return false;
+        }
+        struct stat file_stats;
+        if (fstat(fd, &file_stats) != 0 || !S_ISREG(file_stats.st_mode)) {
+                close(fd);
+                return false;
+        }
+        image->size = file_stats.st_size;
+        image->bytes = NULL;
+        if (image->size > 0) {
+                void *bytes = mmap(NULL, image->size, PROT_READ,
+                                   MAP_PRIVATE | MAP_POPULATE, fd, 0);
+                if (bytes == MAP_FAILED) {
+                        close(fd);
+                        return false;
+                }
+                image->bytes = bytes;
+        }
+        close(fd);
+        return true;
+}
+
+/**********load_words*********************************************************
+ *
+ * Purpose:
+ *      Copies big-endian words into host order
+ * Parameters:
+ *      uint32_t *words: where the words go, e.g. word [1] of segment 0
+ *      const uint8_t *bytes: 4 * num_words bytes of big-endian words
+ *      size_t num_words: number of words
+ * Returns:
+ *      None
+ * Expects:
+ *      words and bytes not to overlap
+ * Notes:
+ *      Neither needs to be aligned
+ ****************************************************************************/
+void load_words(uint32_t *words, const uint8_t *bytes, size_t num_words)
+{
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("avx2")) {
+                load_words_avx2(words, bytes, num_words);
+                return;
+        }
+        if (__builtin_cpu_supports("ssse3")) {
+                load_words_ssse3(words, bytes, num_words);
+                return;
+        }
+#endif
+        load_words_scalar(words, bytes, num_words);
+}
+
+/**********unmap_program******************************************************
+ *
+ * Purpose:
+ *      Unmaps a file mapped by map_program
+ * Parameters:
+ *      program_image *image: the mapping; left empty
+ * Returns:
+ *      None
+ * Expects:
+ *      image to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+void unmap_program(program_image *image)
+{
+        assert(image != NULL);
+        if (image->bytes != NULL) {
+                munmap((void *) image->bytes, image->size);
+        }
+        image->bytes = NULL;
+        image->size = 0;
+}
+
+#if defined(__x86_64__)
+/* reverses the bytes of each 32-bit lane (pshufb control) */
+#define BSWAP32_LANES 12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3
+
+/* load_words, 8 words per step */
+__attribute__((target("avx2")))
+static void load_words_avx2(uint32_t *words, const uint8_t *bytes,
+                            size_t num_words)
+{
+        const __m256i swap = _mm256_set_epi8(BSWAP32_LANES, BSWAP32_LANES);
+        size_t i = 0;
+        for (; i + 8 <= num_words; i += 8) {
+                __m256i v = _mm256_loadu_si256((const __m256i *)
+                                               (bytes + 4 * i));
+                _mm256_storeu_si256((__m256i *) (words + i),
+                                    _mm256_shuffle_epi8(v, swap));
+        }
+        load_words_scalar(words + i, bytes + 4 * i, num_words - i);
+}
+
+/* load_words, 4 words per step */
+__attribute__((target("ssse3")))
+static void load_words_ssse3(uint32_t *words, const uint8_t *bytes,
+                             size_t num_words)
+{
+        const __m128i swap = _mm_set_epi8(BSWAP32_LANES);
+        size_t i = 0;
+        for (; i + 4 <= num_words; i += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i *)
+                                            (bytes + 4 * i));
+                _mm_storeu_si128((__m128i *) (words + i),
+                                 _mm_shuffle_epi8(v, swap));
+        }
+        load_words_scalar(words + i, bytes + 4 * i, num_words - i);
+}
+#endif
+
+/* load_words, one word per step; also finishes the vector versions */
+static void load_words_scalar(uint32_t *words, const uint8_t *bytes,
+                              size_t num_words)
+{
+        for (size_t i = 0; i < num_words; i++) {
+                uint32_t word;
+                memcpy(&word, bytes + 4 * i, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                word = __builtin_bswap32(word);
+#endif
+                words[i] = word;
+        }
+}
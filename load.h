@@ -0,0 +1,34 @@
+/*****************************************************************************
+ *
+ *                       load.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM loader header, contains declarations for mapping a .um
+ *               file and copying its big-endian words into segment 0.
+ *
+ ****************************************************************************/
+#ifndef LOAD
+#define LOAD
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Program image struct
+ *
+ * Purpose: a .um file mapped read-only
+ * Members:
+ *      - const uint8_t *bytes: the file's bytes, or NULL if it is empty
+ *      - size_t size: length of the file in bytes
+ */
+typedef struct program_image {
+        const uint8_t *bytes;
+        size_t size;
+} program_image;
+
+bool map_program(const char *path, program_image *image);
+void load_words(uint32_t *words, const uint8_t *bytes, size_t num_words);
+void unmap_program(program_image *image);
+#endif
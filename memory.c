@@ -0,0 +1,589 @@
+/*****************************************************************************
+ *
+ *                       memory.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM memory module. Virtual memory is a spine of segment
+ *               references (seg_ref_t, engine.h), um->mem_seq:
+ *
+ *               - mem_seq[0] is metadata: [0] entries allocated in the
+ *                 spine, [1] next id never handed out, [META_SHARED] id
+ *                 whose storage segment 0 shares (see um_ops.h)
+ *               - mem_seq[1] is segment 0
+ *               - mem_seq[id] is segment id, for every other id
+ *
+ *               and um->unmapped is a stack of ids that were unmapped,
+ *               unmapped[0] being its size. Map_segment reuses the most
+ *               recently unmapped id first, so live ids stay packed at the
+ *               bottom of the spine. The spine starts at INITIAL_SPINE_SIZE
+ *               entries and doubles when a fresh id does not fit; the
+ *               unmapped stack can never hold more ids than the spine, so
+ *               it grows with it. In safe mode both are instead reserved
+ *               at SAFE_SPINE_SIZE entries (never grown), untouched pages
+ *               reading as zeros, so every id, however large, reads
+ *               NO_SEG unless it is mapped.
+ *
+ *               Segment storage comes from a per-VM pool (seg_pool_t).
+ *               Small segments are rounded up to a size class and carved
+ *               from zeroed slabs; Unmap_segment pushes the block onto its
+ *               class's free list and the next Map_segment of that class
+ *               pops it, zeroing just the words it asked for. Slabs are
+ *               only given back when the program halts.
+ *
+ *               Segments bigger than a slab get pages of their own, which
+ *               the kernel zeroes lazily: a program that maps a huge
+ *               segment only pays for the pages it touches. Unmapping one
+ *               gives its pages back with madvise(MADV_DONTNEED) but keeps
+ *               the mapping on the free list, so remapping it costs
+ *               nothing up front either.
+ *
+ *               In arena mode (./um -a) slabs and segments of every size
+ *               are carved from one reserved mapping instead of malloc, so
+ *               Halt releases all segment storage with a single munmap
+ *               rather than walking the spine. In safe mode (./um -g)
+ *               every segment is mapped on its own against a guard, as
+ *               described in guard.c. Spill mode (./um -m) is arena mode
+ *               with the arena mapped from a spill file (spill.c), and
+ *               page-backed segments that are unmapped punch their pages
+ *               out of the file so they read back as zeros. In compressed
+ *               mode (./um -z) arena chunks that go idle are compressed
+ *               in memory (compress.c); page-backed segments that are
+ *               unmapped drop any compressed copy of their chunks. In
+ *               checkpointing mode (./um -K) they are marked dirty for the
+ *               next checkpoint (checkpoint.c) before their pages go.
+ *
+ *               A flat build (make MEMORY=flat) is always in arena mode,
+ *               with spine entries that are 32-bit word offsets from the
+ *               arena's start. Offset 0 is an unmapped id, so the first
+ *               slab of the arena is never handed out and is kept
+ *               inaccessible, and the metadata is carved from the arena
+ *               like a segment. Safe mode needs segments outside the
+ *               arena and is not available.
+ *
+ ****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include "memory.h"
+#include "guard.h"
+#include "spill.h"
+#include "compress.h"
+#include "checkpoint.h"
+
+static uint32_t *page_block(seg_pool_t pool, uint64_t words);
+static uint32_t *arena_take(seg_pool_t pool, uint64_t words);
+static void *reserve(size_t bytes);
+
+/**********new_memory*********************************************************
+ *
+ * Purpose:
+ *      Sets up the segment pool and virtual memory holding only segment 0
+ * Parameters:
+ *      um_state_t um: state to set pool, mem_seq, and unmapped of
+ *      uint32_t seg_0_len: words in segment 0
+ *      memory_mode mode: where segment storage comes from
+ * Returns:
+ *      true, or false if the arena or spill file could not be made
+ *      (nothing is set up then)
+ * Expects:
+ *      um to be non-NULL
+ * Notes:
+ *      Segment 0 is all zeros; the caller fills in the program at
+ *      um->mem_seq[1] + 1. Caller must free with free_memory
+ ****************************************************************************/
+bool new_memory(um_state_t um, uint32_t seg_0_len, memory_mode mode)
+{
+        assert(um != NULL);
+        um->pool = calloc(1, sizeof(struct seg_pool));
+        assert(um->pool != NULL);
+#ifdef UM_FLAT
+        /* spine entries are offsets into the arena */
+        assert(mode != MEM_GUARDED);
+        mode = (mode == MEM_SPILL) ? MEM_SPILL : MEM_ARENA;
+#endif
+        um->pool->guarded = (mode == MEM_GUARDED);
+        um->pool->class_limit = um->pool->guarded ? 0 : MAX_CLASS_WORDS;
+        if (mode == MEM_ARENA) {
+                void *arena = mmap(NULL, ARENA_BYTES, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS |
+                                   MAP_NORESERVE, -1, 0);
+                if (arena == MAP_FAILED) {
+                        free(um->pool);
+                        um->pool = NULL;
+                        return false;
+                }
+                um->pool->arena = arena;
+        } else if (mode == MEM_SPILL) {
+                um->pool->spill = new_spill(&um->pool->arena, ARENA_BYTES);
+                if (um->pool->spill == NULL) {
+                        free(um->pool);
+                        um->pool = NULL;
+                        return false;
+                }
+        }
+#ifdef UM_FLAT
+        /* offset 0 is NO_SEG: keep the first slab inaccessible */
+        um->seg_base = (uint32_t *) um->pool->arena;
+        um->pool->arena_used = ARENA_HOLE_BYTES;
+        mprotect(um->pool->arena, um->pool->arena_used, PROT_NONE);
+        uint32_t *metadata = seg_alloc(um->pool, META_WORDS);
+#else
+        uint32_t *metadata = malloc(META_WORDS * sizeof(uint32_t));
+        assert(metadata != NULL);
+#endif
+        uint32_t *seg_0 = seg_alloc(um->pool, seg_0_len + 1);
+        metadata[0] = INITIAL_SPINE_SIZE;
+        metadata[1] = 2;
+        metadata[META_SHARED] = 0;
+
+        if (um->pool->guarded) {
+                metadata[0] = UINT32_MAX;
+                um->mem_seq = reserve(SAFE_SPINE_SIZE * sizeof(seg_ref_t));
+                um->unmapped = reserve(SAFE_SPINE_SIZE * sizeof(uint32_t));
+        } else {
+                um->mem_seq = calloc(INITIAL_SPINE_SIZE, sizeof(seg_ref_t));
+                um->unmapped = malloc(INITIAL_SPINE_SIZE * sizeof(uint32_t));
+        }
+        assert(um->mem_seq != NULL && um->unmapped != NULL);
+        um->mem_seq[0] = SEG_REF(um, metadata);
+        um->mem_seq[1] = SEG_REF(um, seg_0);
+        um->unmapped[0] = 0;
+        return true;
+}
+
+/**********grow_memory********************************************************
+ *
+ * Purpose:
+ *      Doubles the spine and the unmapped stack
+ * Parameters:
+ *      um_state_t um: state whose spine is full
+ * Returns:
+ *      None
+ * Expects:
+ *      mem_seq[0][1] == mem_seq[0][0], i.e. no room for a fresh id
+ * Notes:
+ *      Moves um->mem_seq and um->unmapped, so callers holding either must
+ *      reload them. The spine never goes past UINT32_MAX entries; running
+ *      out of ids beyond that is a checked runtime error.
+ ****************************************************************************/
+void grow_memory(um_state_t um)
+{
+        uint32_t *meta = SEG(um, um->mem_seq[0]);
+        uint32_t old_size = meta[0];
+        assert(old_size != UINT32_MAX);
+        uint32_t new_size = (old_size > UINT32_MAX / 2) ? UINT32_MAX
+                                                        : old_size * 2;
+        um->mem_seq = realloc(um->mem_seq,
+                              ((size_t) new_size) * sizeof(seg_ref_t));
+        um->unmapped = realloc(um->unmapped,
+                               ((size_t) new_size) * sizeof(uint32_t));
+        assert(um->mem_seq != NULL && um->unmapped != NULL);
+        for (uint32_t id = old_size; id < new_size; id++) {
+                um->mem_seq[id] = NO_SEG;
+        }
+        meta[0] = new_size;
+}
+
+/**********free_memory********************************************************
+ *
+ * Purpose:
+ *      Frees every mapped segment, the spine, the unmapped stack, and the
+ *      segment pool
+ * Parameters:
+ *      um_state_t um: state of a halted program
+ * Returns:
+ *      None
+ * Expects:
+ *      um to be non-NULL
+ * Notes:
+ *      Storage segment 0 shares with another segment is freed once. Small
+ *      segments go away with their slabs, so only large ones are freed one
+ *      by one (with page-backed ones left on free lists); in arena mode
+ *      none are, and the spine is not walked. In safe mode every segment
+ *      is unmapped.
+ ****************************************************************************/
+void free_memory(um_state_t um)
+{
+        seg_ref_t *mem_seq = um->mem_seq;
+#ifndef UM_FLAT
+        /* a flat build's metadata and segments all live in the arena */
+        uint32_t *meta = mem_seq[0];
+        uint32_t num_segs = meta[1];
+        if (meta[META_SHARED] != 0) {
+                /* freed through the segment it shares storage with */
+                mem_seq[1] = NULL;
+        }
+        free(meta);
+        if (um->pool->arena != NULL) {
+                /* every segment lives in the arena */
+                num_segs = 0;
+        }
+        for (uint32_t seg = num_segs; seg-- > 1;) {
+                uint32_t *seg_words = mem_seq[seg];
+                if (seg_words != NULL && um->pool->guarded) {
+                        release_guarded(seg_words);
+                        continue;
+                }
+                if (seg_words == NULL || seg_words[0] <= MAX_CLASS_WORDS) {
+                        continue;
+                }
+                if (seg_words[0] > SLAB_WORDS) {
+                        uint32_t cls = size_class(seg_words[0]);
+                        munmap(seg_words, CLASS_WORDS(cls) * sizeof(uint32_t));
+                } else {
+                        free(seg_words);
+                }
+        }
+#endif
+        if (um->pool->zip != NULL) {
+                free_compress(&um->pool->zip);
+        }
+        if (um->pool->checkpoint != NULL) {
+                free_checkpoints(&um->pool->checkpoint);
+        }
+        if (um->pool->spill != NULL) {
+                free_spill(&um->pool->spill);
+        }
+        if (um->pool->arena != NULL) {
+                munmap(um->pool->arena, ARENA_BYTES);
+        }
+        if (um->pool->guarded) {
+                release_guarded_free_lists(um->pool);
+        }
+        for (uint32_t cls = 0; cls < NUM_SIZE_CLASSES &&
+                               um->pool->arena == NULL; cls++) {
+                if (CLASS_WORDS(cls) <= SLAB_WORDS) {
+                        continue;
+                }
+                uint32_t *block = um->pool->free_lists[cls];
+                while (block != NULL) {
+                        uint32_t *next = *(uint32_t **) block;
+                        munmap(block, CLASS_WORDS(cls) * sizeof(uint32_t));
+                        block = next;
+                }
+        }
+        if (um->pool->guarded) {
+                munmap(mem_seq, SAFE_SPINE_SIZE * sizeof(seg_ref_t));
+                munmap(um->unmapped, SAFE_SPINE_SIZE * sizeof(uint32_t));
+        } else {
+                free(mem_seq);
+                free(um->unmapped);
+        }
+        um->mem_seq = NULL;
+        um->unmapped = NULL;
+        um->seg_base = NULL;
+
+        struct slab *slab = um->pool->slabs;
+        while (slab != NULL) {
+                struct slab *next = slab->next;
+                free(slab);
+                slab = next;
+        }
+        free(um->pool);
+        um->pool = NULL;
+}
+
+/**********report_memory******************************************************
+ *
+ * Purpose:
+ *      Prints how segment allocations were served, how much slab memory
+ *      was live, idle on free lists, or lost to rounding at Halt, and how
+ *      often page-backed segments gave their pages back
+ * Parameters:
+ *      FILE *out: stream to print to
+ *      seg_pool_t pool: pool of a halted program
+ * Returns:
+ *      None
+ * Expects:
+ *      out and pool to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+void report_memory(FILE *out, seg_pool_t pool)
+{
+        assert(out != NULL && pool != NULL);
+        uint64_t allocs = pool->recycled + pool->carved + pool->paged +
+                          pool->large;
+        fprintf(out, "segment allocs   %llu (%llu recycled, %llu from slabs, "
+                "%llu paged, %llu large; %.1f%% hit)\n",
+                (unsigned long long) allocs,
+                (unsigned long long) pool->recycled,
+                (unsigned long long) pool->carved,
+                (unsigned long long) pool->paged,
+                (unsigned long long) pool->large,
+                allocs == 0 ? 0.0 : 100.0 * pool->recycled / allocs);
+        uint64_t idle = pool->carved_class_words - pool->live_class_words;
+        uint64_t rounding = pool->live_class_words - pool->live_words;
+        fprintf(out, "slab memory      %llu KB in %llu slabs, %llu KB live, "
+                "%llu KB free, %.1f%% of live lost to rounding\n",
+                (unsigned long long) (pool->num_slabs * sizeof(struct slab)
+                                      / 1024),
+                (unsigned long long) pool->num_slabs,
+                (unsigned long long) (pool->live_class_words * 4 / 1024),
+                (unsigned long long) (idle * 4 / 1024),
+                pool->live_class_words == 0 ? 0.0
+                        : 100.0 * rounding / pool->live_class_words);
+        fprintf(out, "page-backed      %llu released to the OS on unmap\n",
+                (unsigned long long) pool->released);
+        if (pool->arena != NULL) {
+                fprintf(out, "arena            %llu KB used of %llu KB "
+                        "reserved\n",
+                        (unsigned long long) (pool->arena_used / 1024),
+                        (unsigned long long) (ARENA_BYTES / 1024));
+        }
+        if (pool->spill != NULL) {
+                report_spill(out, pool->spill);
+        }
+        if (pool->zip != NULL) {
+                report_compress(out, pool->zip);
+        }
+        if (pool->checkpoint != NULL) {
+                report_checkpoints(out, pool->checkpoint);
+        }
+}
+
+/**********carve_block********************************************************
+ *
+ * Purpose:
+ *      Takes a never used block of class cls, starting a new slab for the
+ *      class if its newest one is used up
+ * Parameters:
+ *      seg_pool_t pool: pool to carve from
+ *      uint32_t cls: size class of the block
+ * Returns:
+ *      The block, all zeros
+ * Expects:
+ *      pool to be non-NULL and cls < NUM_SIZE_CLASSES
+ * Notes:
+ *      Slabs are calloc'd (or fresh arena pages), so fresh blocks are
+ *      zeroed in bulk. Blocks bigger than a slab get pages of their own
+ ****************************************************************************/
+uint32_t *carve_block(seg_pool_t pool, uint32_t cls)
+{
+        uint64_t class_words = CLASS_WORDS(cls);
+        if (class_words > SLAB_WORDS) {
+                pool->paged++;
+                return page_block(pool, class_words);
+        }
+        pool->carved++;
+        pool->carved_class_words += class_words;
+        if (pool->carve[cls] == pool->carve_end[cls]) {
+                uint32_t *words;
+                if (pool->arena != NULL) {
+                        words = arena_take(pool, SLAB_WORDS);
+                } else {
+                        struct slab *slab = calloc(1, sizeof(*slab));
+                        assert(slab != NULL);
+                        slab->next = pool->slabs;
+                        pool->slabs = slab;
+                        words = slab->words;
+                }
+                pool->num_slabs++;
+                pool->carve[cls] = words;
+                pool->carve_end[cls] = words + SLAB_WORDS;
+        }
+        uint32_t *block = pool->carve[cls];
+        pool->carve[cls] += class_words;
+        return block;
+}
+
+/**********large_alloc********************************************************
+ *
+ * Purpose:
+ *      seg_alloc for segments bigger than MAX_CLASS_WORDS, and for every
+ *      segment in safe mode
+ * Parameters:
+ *      seg_pool_t pool: pool to take the storage from
+ *      uint32_t words: length of the segment + 1
+ * Returns:
+ *      The segment, with words in word [0] and every other word 0
+ * Expects:
+ *      pool to be non-NULL and words > pool->class_limit
+ * Notes:
+ *      A recycled page-backed block had its pages dropped when it was
+ *      freed, so only the free list link in it needs zeroing. Page-backed
+ *      segments are left out of the slab memory counts.
+ ****************************************************************************/
+uint32_t *large_alloc(seg_pool_t pool, uint32_t words)
+{
+        if (pool->guarded) {
+                return guarded_alloc(pool, words);
+        }
+        bool paged = words > SLAB_WORDS;
+        if (!paged && pool->arena == NULL) {
+                uint32_t *seg = calloc(words, sizeof(uint32_t));
+                assert(seg != NULL);
+                pool->large++;
+                seg[0] = words;
+                return seg;
+        }
+        uint32_t cls = size_class(words);
+        uint32_t *seg = pool->free_lists[cls];
+        if (seg != NULL) {
+                pool->free_lists[cls] = *(uint32_t **) seg;
+                size_t dirty = paged ? sizeof(uint32_t *)
+                                     : ((size_t) words) * sizeof(uint32_t);
+                memset(seg, 0, dirty);
+                pool->recycled++;
+        } else {
+                seg = carve_block(pool, cls);
+        }
+        if (!paged) {
+                pool->live_words += words;
+                pool->live_class_words += CLASS_WORDS(cls);
+        }
+        seg[0] = words;
+        return seg;
+}
+
+/**********large_free*********************************************************
+ *
+ * Purpose:
+ *      seg_free for segments bigger than MAX_CLASS_WORDS, and for every
+ *      segment in safe mode
+ * Parameters:
+ *      seg_pool_t pool: pool the segment came from
+ *      uint32_t *seg: segment, with its length + 1 in word [0]
+ * Returns:
+ *      None
+ * Expects:
+ *      pool and seg to be non-NULL and seg[0] > pool->class_limit
+ * Notes:
+ *      A page-backed segment keeps its mapping on the free list but gives
+ *      its pages back to the OS, which hands out zero pages if it is
+ *      mapped again
+ ****************************************************************************/
+void large_free(seg_pool_t pool, uint32_t *seg)
+{
+        if (pool->guarded) {
+                guarded_free(pool, seg);
+                return;
+        }
+        uint32_t words = seg[0];
+        bool paged = words > SLAB_WORDS;
+        if (!paged && pool->arena == NULL) {
+                free(seg);
+                return;
+        }
+        uint32_t cls = size_class(words);
+        if (paged) {
+                if (pool->checkpoint != NULL) {
+                        /* zeroing them is a write the MMU will not see */
+                        touch_checkpointed(pool->checkpoint, seg,
+                                           CLASS_WORDS(cls) *
+                                           sizeof(uint32_t));
+                }
+                /* a spill file would keep the old words: punch them out */
+                madvise(seg, CLASS_WORDS(cls) * sizeof(uint32_t),
+                        pool->spill != NULL ? MADV_REMOVE : MADV_DONTNEED);
+                pool->released++;
+                if (pool->zip != NULL) {
+                        /* its old words may sit compressed */
+                        forget_compressed(pool->zip, seg, CLASS_WORDS(cls) *
+                                          sizeof(uint32_t));
+                }
+        } else {
+                pool->live_words -= words;
+                pool->live_class_words -= CLASS_WORDS(cls);
+        }
+        *(uint32_t **) seg = pool->free_lists[cls];
+        pool->free_lists[cls] = seg;
+}
+
+/**********page_block*********************************************************
+ *
+ * Purpose:
+ *      Gets fresh pages for a block bigger than a slab
+ * Parameters:
+ *      seg_pool_t pool: pool to take the pages from
+ *      uint64_t words: words in the block, a power of two
+ * Returns:
+ *      The block, all zeros (the kernel zeroes pages as they are touched)
+ * Expects:
+ *      pool to be non-NULL and words > SLAB_WORDS
+ * Notes:
+ *      Outside arena mode the block is its own mapping. Blocks of at least
+ *      HUGE_PAGE_BYTES are aligned to it in the arena and ask for huge
+ *      pages either way. Running out of address space is a checked runtime
+ *      error.
+ ****************************************************************************/
+static uint32_t *page_block(seg_pool_t pool, uint64_t words)
+{
+        size_t bytes = words * sizeof(uint32_t);
+        uint32_t *block;
+        if (pool->arena != NULL) {
+                if (bytes >= HUGE_PAGE_BYTES) {
+                        size_t align = HUGE_PAGE_BYTES - 1;
+                        __atomic_store_n(&pool->arena_used,
+                                         (pool->arena_used + align) & ~align,
+                                         __ATOMIC_RELAXED);
+                }
+                block = arena_take(pool, words);
+        } else {
+                block = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                             -1, 0);
+                assert(block != MAP_FAILED);
+        }
+#ifdef MADV_HUGEPAGE
+        if (bytes >= HUGE_PAGE_BYTES) {
+                madvise(block, bytes, MADV_HUGEPAGE);
+        }
+#endif
+        return block;
+}
+
+/**********reserve************************************************************
+ *
+ * Purpose:
+ *      Reserves bytes of zeroed memory without committing to them
+ * Parameters:
+ *      size_t bytes: size of the reservation
+ * Returns:
+ *      The reservation, or NULL if it could not be mapped
+ * Expects:
+ *      bytes to be a multiple of the page size
+ * Notes:
+ *      Pages are paid for only as they are first written; must be given
+ *      back with munmap
+ ****************************************************************************/
+static void *reserve(size_t bytes)
+{
+        void *block = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                           -1, 0);
+        return (block == MAP_FAILED) ? NULL : block;
+}
+
+/**********arena_take*********************************************************
+ *
+ * Purpose:
+ *      Hands out the next words words of the arena
+ * Parameters:
+ *      seg_pool_t pool: pool in arena mode
+ *      uint64_t words: words to take, a power of two of at least
+ *      MIN_CLASS_WORDS
+ * Returns:
+ *      The words, all zeros (the kernel zeroes them as they are touched)
+ * Expects:
+ *      pool->arena to be non-NULL
+ * Notes:
+ *      Every request is a whole number of slabs, so blocks bigger than a
+ *      slab start on a page boundary. Running past ARENA_BYTES is a
+ *      checked runtime error
+ ****************************************************************************/
+static uint32_t *arena_take(seg_pool_t pool, uint64_t words)
+{
+        size_t bytes = words * sizeof(uint32_t);
+        assert(pool->arena != NULL && pool->arena_used <= ARENA_BYTES &&
+               bytes <= ARENA_BYTES - pool->arena_used);
+        uint32_t *taken = (uint32_t *) (pool->arena + pool->arena_used);
+        /* stored atomically: the spill thread (spill.h) reads it */
+        __atomic_store_n(&pool->arena_used, pool->arena_used + bytes,
+                         __ATOMIC_RELAXED);
+        return taken;
+}
@@ -0,0 +1,223 @@
+/*****************************************************************************
+ *
+ *                       memory.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM memory header, contains declarations for the functions
+ *               that set up, grow, and tear down virtual memory (the
+ *               segment spine and the stack of unmapped ids), and the
+ *               size-class pool every segment's storage comes from.
+ *
+ ****************************************************************************/
+#ifndef MEMORY
+#define MEMORY
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "engine.h"
+
+/* Where segment storage comes from (see memory.c) */
+typedef enum memory_mode {
+        MEM_HEAP = 0, MEM_ARENA, MEM_GUARDED, MEM_SPILL
+} memory_mode;
+
+/* Spine entries allocated at start; the spine doubles when it fills */
+#define INITIAL_SPINE_SIZE 1024
+
+/* Entries reserved for the spine and unmapped stack in safe mode, one per
+ * possible id, so any id reads as a spine entry
+ */
+#define SAFE_SPINE_SIZE ((size_t) 1 << 32)
+
+/* Segments of up to MAX_CLASS_WORDS words (length + 1) are rounded up to a
+ * power of two no smaller than MIN_CLASS_WORDS and carved from slabs of
+ * SLAB_WORDS words. Segments bigger than a slab are page-backed: rounded
+ * up to a power of two and mapped on their own (or taken from the arena),
+ * so the kernel zeroes their pages as they are first touched. The sizes in
+ * between go straight to calloc and free, except in arena and spill modes,
+ * where every size has a class and all storage is carved from one
+ * reservation of ARENA_BYTES.
+ */
+#define MIN_CLASS_SHIFT 2
+#define MIN_CLASS_WORDS (1u << MIN_CLASS_SHIFT)
+#define MAX_CLASS_WORDS 1024u
+#define NUM_SIZE_CLASSES (33 - MIN_CLASS_SHIFT)
+#define SLAB_WORDS 16384
+#ifdef UM_FLAT
+/* as many bytes as 32-bit word offsets reach */
+#define ARENA_BYTES ((size_t) 1 << 34)
+#else
+#define ARENA_BYTES ((size_t) 1 << 36)
+#endif
+
+/* bytes at the start of the arena that never hold a segment */
+#ifdef UM_FLAT
+#define ARENA_HOLE_BYTES (SLAB_WORDS * sizeof(uint32_t))
+#else
+#define ARENA_HOLE_BYTES ((size_t) 0)
+#endif
+
+/* page-backed segments this big ask for transparent huge pages */
+#define HUGE_PAGE_BYTES ((size_t) 2 << 20)
+
+/* words in a block of class cls */
+#define CLASS_WORDS(cls) ((uint64_t) MIN_CLASS_WORDS << (cls))
+
+/* slabs are chained together so they can all be freed at Halt */
+struct slab {
+        struct slab *next;
+        uint32_t words[SLAB_WORDS];
+};
+
+/* Segment pool struct
+ *
+ * Purpose: hands out and recycles the storage of every segment
+ * Members:
+ *      - uint32_t *free_lists[]: recycled blocks of each class; the first
+ *        bytes of a free block point to the next one
+ *      - uint32_t *carve[], *carve_end[]: unused part of each class's
+ *        newest slab
+ *      - struct slab *slabs: every slab allocated
+ *      - uint64_t recycled, carved, paged, large: allocations served from
+ *        a free list, from a slab, by fresh pages, and by calloc
+ *      - uint64_t released: page-backed segments whose pages were given
+ *        back to the OS on unmap
+ *      - uint64_t num_slabs: slabs allocated
+ *      - uint64_t live_words, live_class_words: words asked for by, and
+ *        words reserved for, small segments that are mapped
+ *      - uint64_t carved_class_words: words ever carved from slabs
+ *      - uint8_t *arena: the reservation in arena mode, else NULL
+ *      - size_t arena_used: bytes of the arena handed out so far
+ *      - struct spill *spill: spill file the arena maps in spill mode
+ *        (spill.h), else NULL
+ *      - struct compress *zip: compression of idle arena chunks in
+ *        compressed mode (compress.h), else NULL
+ *      - struct checkpoint *checkpoint: log of the arena's dirty chunks in
+ *        checkpointing mode (checkpoint.h), else NULL
+ *      - bool guarded: every segment is mapped against a guard (guard.h)
+ *      - uint32_t class_limit: biggest segment (in words) seg_alloc serves
+ *        inline; MAX_CLASS_WORDS, or 0 when guarded
+ */
+typedef struct seg_pool {
+        uint32_t *free_lists[NUM_SIZE_CLASSES];
+        uint32_t *carve[NUM_SIZE_CLASSES];
+        uint32_t *carve_end[NUM_SIZE_CLASSES];
+        struct slab *slabs;
+        uint64_t recycled, carved, paged, large;
+        uint64_t released;
+        uint64_t num_slabs;
+        uint64_t live_words, live_class_words;
+        uint64_t carved_class_words;
+        uint8_t *arena;
+        size_t arena_used;
+        struct spill *spill;
+        struct compress *zip;
+        struct checkpoint *checkpoint;
+        bool guarded;
+        uint32_t class_limit;
+} *seg_pool_t;
+
+bool new_memory(um_state_t um, uint32_t seg_0_len, memory_mode mode);
+void grow_memory(um_state_t um);
+void free_memory(um_state_t um);
+uint32_t *carve_block(seg_pool_t pool, uint32_t cls);
+uint32_t *large_alloc(seg_pool_t pool, uint32_t words);
+void large_free(seg_pool_t pool, uint32_t *seg);
+void report_memory(FILE *out, seg_pool_t pool);
+
+/**********size_class*********************************************************
+ *
+ * Purpose:
+ *      Finds the smallest class holding a segment of words words
+ * Parameters:
+ *      uint32_t words: length of the segment + 1
+ * Returns:
+ *      The class, whose blocks are MIN_CLASS_WORDS << class words
+ * Expects:
+ *      words to be at least 1
+ * Notes:
+ *      None
+ ****************************************************************************/
+static inline uint32_t size_class(uint32_t words)
+{
+        if (words <= MIN_CLASS_WORDS) {
+                return 0;
+        }
+        return 32 - __builtin_clz(words - 1) - MIN_CLASS_SHIFT;
+}
+
+/**********seg_alloc**********************************************************
+ *
+ * Purpose:
+ *      Gets zeroed storage for a segment
+ * Parameters:
+ *      seg_pool_t pool: pool to take the storage from
+ *      uint32_t words: length of the segment + 1
+ * Returns:
+ *      The segment, with words in word [0] and every other word 0
+ * Expects:
+ *      pool to be non-NULL and words to be at least 1
+ * Notes:
+ *      Inline because Map_segment calls it; segments bigger than
+ *      MAX_CLASS_WORDS, and all segments in safe mode, take the out of line
+ *      path. A recycled block is
+ *      zeroed with one memset of the words asked for; words past them in
+ *      the block are never read. Must be freed with seg_free (or
+ *      free_memory)
+ ****************************************************************************/
+static inline uint32_t *seg_alloc(seg_pool_t pool, uint32_t words)
+{
+        if (words > pool->class_limit) {
+                return large_alloc(pool, words);
+        }
+        uint32_t *seg;
+        uint32_t cls = size_class(words);
+        seg = pool->free_lists[cls];
+        if (seg != NULL) {
+                pool->free_lists[cls] = *(uint32_t **) seg;
+                memset(seg, 0, ((size_t) words) * sizeof(uint32_t));
+                pool->recycled++;
+        } else {
+                seg = carve_block(pool, cls);
+        }
+        pool->live_words += words;
+        pool->live_class_words += CLASS_WORDS(cls);
+        seg[0] = words;
+        return seg;
+}
+
+/**********seg_free***********************************************************
+ *
+ * Purpose:
+ *      Gives back the storage of a segment from seg_alloc
+ * Parameters:
+ *      seg_pool_t pool: pool the segment came from
+ *      uint32_t *seg: segment, with its length + 1 in word [0]
+ * Returns:
+ *      None
+ * Expects:
+ *      pool and seg to be non-NULL
+ * Notes:
+ *      Small segments are pushed onto their class's free list, not freed;
+ *      others take the out of line path
+ ****************************************************************************/
+static inline void seg_free(seg_pool_t pool, uint32_t *seg)
+{
+        uint32_t words = seg[0];
+        if (words > pool->class_limit) {
+                large_free(pool, seg);
+                return;
+        }
+        uint32_t cls = size_class(words);
+        *(uint32_t **) seg = pool->free_lists[cls];
+        pool->free_lists[cls] = seg;
+        pool->live_words -= words;
+        pool->live_class_words -= CLASS_WORDS(cls);
+}
+#endif
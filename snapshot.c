@@ -0,0 +1,296 @@
+/*****************************************************************************
+ *
+ *                       snapshot.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM snapshots. A snapshot holds everything a program needs
+ *               to go on running: registers, program counter, the unmapped
+ *               stack, and every mapped segment, segment 0 included (see
+ *               snapshot_header for the layout). It also holds the output
+ *               the program wrote before it, so a restored run prints
+ *               exactly what a cold run would.
+ *
+ *               A snapshot is written at the program's first Input, before
+ *               it reads (./um -S), or at its first Load_program of another
+ *               segment (./um -P), which is where a packed .umz starts the
+ *               program it has unpacked. Either way no input has been read
+ *               yet, so the restored program reads all of its input. The
+ *               engines only look for a request at those two instructions
+ *               (um_ops.h), so the rest of the program runs as fast as
+ *               ever.
+ *
+ *               Restoring (./um -R) maps the file and copies each segment
+ *               into the segment pool, which leaves the pool just as if the
+ *               program had mapped them itself.
+ *
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include "snapshot.h"
+#include "memory.h"
+#include "io.h"
+#include "structs_and_constants.h"
+
+#define BYTE_ORDER_MARK 0x01020304u
+
+/* words copied out of a segment at a time */
+#define BOUNCE_WORDS 16384
+
+/* output is padded so the words after it stay aligned */
+#define PADDED(bytes) (((bytes) + 3) / 4 * 4)
+
+static bool write_snapshot(um_state_t um, FILE *out);
+static bool write_words(FILE *out, const uint32_t *words, size_t num_words);
+
+/**********take_snapshot******************************************************
+ *
+ * Purpose:
+ *      Writes the snapshot um->snapshot asks for, and drops the request
+ * Parameters:
+ *      um_state_t um: state of a program at the request's snapshot point,
+ *                     with um->r and um->prog_counter up to date
+ * Returns:
+ *      None
+ * Expects:
+ *      um->snapshot to be non-NULL, and um->io to be keeping output
+ * Notes:
+ *      Failing to write it, or being asked at a program load after input
+ *      was read, is reported on stderr and the program goes on. The
+ *      request is marked written only if it was
+ ****************************************************************************/
+void take_snapshot(um_state_t um)
+{
+        assert(um != NULL && um->snapshot != NULL);
+        snapshot_request_t request = um->snapshot;
+        um->snapshot = NULL;
+        io_flush(um->io);
+        if (io_read_any(um->io)) {
+                fprintf(stderr, "um: no snapshot written: the program read "
+                        "input before it got to one\n");
+        } else {
+                FILE *out = fopen(request->path, "wb");
+                bool ok = out != NULL && write_snapshot(um, out);
+                if (out != NULL && fclose(out) != 0) {
+                        ok = false;
+                }
+                if (ok) {
+                        request->written = true;
+                } else {
+                        fprintf(stderr, "um: could not write snapshot %s: "
+                                "%s\n", request->path, strerror(errno));
+                }
+        }
+        io_keep(um->io, false);
+}
+
+/**********open_snapshot******************************************************
+ *
+ * Purpose:
+ *      Maps a snapshot file and checks that it is whole
+ * Parameters:
+ *      const char *path: the file
+ *      snapshot *snap: filled in with the mapping
+ * Returns:
+ *      true, or false if the file could not be mapped or is not a
+ *      snapshot this build can restore
+ * Expects:
+ *      path and snap to be non-NULL
+ * Notes:
+ *      Every record is walked, so a truncated file is caught before any
+ *      memory is set up. Must be closed with close_snapshot
+ ****************************************************************************/
+bool open_snapshot(const char *path, snapshot *snap)
+{
+        assert(path != NULL && snap != NULL);
+        if (!map_program(path, &snap->image)) {
+                return false;
+        }
+        const uint8_t *bytes = snap->image.bytes;
+        size_t size = snap->image.size;
+        const snapshot_header *header = (const snapshot_header *) bytes;
+        if (size < sizeof(*header) ||
+            memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) ||
+            header->byte_order != BYTE_ORDER_MARK || header->num_ids < 2 ||
+            header->shared >= header->num_ids ||
+            header->output_bytes > size) {
+                close_snapshot(snap);
+                return false;
+        }
+        size_t words = (size - sizeof(*header)) / sizeof(uint32_t);
+        size_t at = PADDED(header->output_bytes) / sizeof(uint32_t);
+        const uint32_t *body = (const uint32_t *) (header + 1);
+        bool whole = at <= words && header->num_unmapped <= words - at;
+        for (uint32_t i = 0; whole && i < header->num_unmapped; i++) {
+                whole = body[at + i] >= 2 && body[at + i] < header->num_ids;
+        }
+        at += whole ? header->num_unmapped : 0;
+        size_t first_seg = at;
+        for (uint32_t id = 1; whole && id < header->num_ids; id++) {
+                whole = at < words && body[at] <= words - at;
+                if (whole && (id == 1 || id == header->shared)) {
+                        /* segment 0 is a record of its own or shared */
+                        whole = (body[at] == 0) == (header->shared != 0 &&
+                                                    id == 1);
+                }
+                if (whole) {
+                        at += (body[at] == 0) ? 1 : body[at];
+                }
+        }
+        if (!whole || at != words) {
+                close_snapshot(snap);
+                return false;
+        }
+        snap->header = header;
+        snap->output = (const uint8_t *) body;
+        snap->unmapped = body + PADDED(header->output_bytes) /
+                                sizeof(uint32_t);
+        snap->segs = body + first_seg;
+        snap->seg_0_len = (snap->segs[0] == 0) ? 0 : snap->segs[0] - 1;
+        return true;
+}
+
+/**********restore_snapshot***************************************************
+ *
+ * Purpose:
+ *      Puts a program back in the state a snapshot holds
+ * Parameters:
+ *      um_state_t um: state with fresh memory (new_memory) whose segment 0
+ *                     is snap->seg_0_len words long, and fresh I/O
+ *      const snapshot *snap: snapshot from open_snapshot
+ * Returns:
+ *      None
+ * Expects:
+ *      um and snap to be non-NULL
+ * Notes:
+ *      Writes the output the program had written before the snapshot.
+ *      Segment 0 is left to be decoded by the caller
+ ****************************************************************************/
+void restore_snapshot(um_state_t um, const snapshot *snap)
+{
+        assert(um != NULL && snap != NULL);
+        const snapshot_header *header = snap->header;
+        while (SEG(um, um->mem_seq[0])[0] < header->num_ids) {
+                grow_memory(um);
+        }
+        uint32_t *meta = SEG(um, um->mem_seq[0]);
+        const uint32_t *record = snap->segs;
+        for (uint32_t id = 1; id < header->num_ids; id++) {
+                uint32_t words = *record;
+                if (id == 1 && words != 0) {
+                        memcpy(SEG(um, um->mem_seq[1]) + 1, record + 1,
+                               (words - 1) * sizeof(uint32_t));
+                } else if (words != 0) {
+                        uint32_t *seg = seg_alloc(um->pool, words);
+                        memcpy(seg + 1, record + 1,
+                               (words - 1) * sizeof(uint32_t));
+                        um->mem_seq[id] = SEG_REF(um, seg);
+                }
+                record += (words == 0) ? 1 : words;
+        }
+        if (header->shared != 0) {
+                seg_free(um->pool, SEG(um, um->mem_seq[1]));
+                um->mem_seq[1] = um->mem_seq[header->shared];
+        }
+        meta[1] = header->num_ids;
+        meta[META_SHARED] = header->shared;
+        um->unmapped[0] = header->num_unmapped;
+        memcpy(um->unmapped + 1, snap->unmapped,
+               header->num_unmapped * sizeof(uint32_t));
+        memcpy(um->r, header->r, sizeof(um->r));
+        um->prog_counter = header->prog_counter;
+        for (uint64_t i = 0; i < header->output_bytes; i++) {
+                io_put(um->io, snap->output[i]);
+        }
+}
+
+/**********close_snapshot*****************************************************
+ *
+ * Purpose:
+ *      Unmaps a snapshot file
+ * Parameters:
+ *      snapshot *snap: snapshot from open_snapshot
+ * Returns:
+ *      None
+ * Expects:
+ *      snap to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+void close_snapshot(snapshot *snap)
+{
+        assert(snap != NULL);
+        unmap_program(&snap->image);
+}
+
+/**********write_snapshot*****************************************************
+ *
+ * Purpose:
+ *      Writes a program's snapshot to a stream
+ * Parameters:
+ *      um_state_t um: state to write, output kept and flushed
+ *      FILE *out: stream to write to
+ * Returns:
+ *      true, or false if a write failed
+ * Expects:
+ *      um and out to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+static bool write_snapshot(um_state_t um, FILE *out)
+{
+        seg_ref_t *mem_seq = um->mem_seq;
+        uint32_t *meta = SEG(um, mem_seq[0]);
+        snapshot_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.byte_order = BYTE_ORDER_MARK;
+        memcpy(header.r, um->r, sizeof(header.r));
+        header.prog_counter = um->prog_counter;
+        header.num_ids = meta[1];
+        header.shared = meta[META_SHARED];
+        header.num_unmapped = um->unmapped[0];
+        header.output_bytes = um->io->kept_len;
+
+        static const uint8_t padding[4] = { 0 };
+        size_t pad = PADDED(um->io->kept_len) - um->io->kept_len;
+        bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+                  fwrite(um->io->kept, 1, um->io->kept_len, out) ==
+                  um->io->kept_len &&
+                  fwrite(padding, 1, pad, out) == pad &&
+                  write_words(out, um->unmapped + 1, header.num_unmapped);
+        for (uint32_t id = 1; ok && id < header.num_ids; id++) {
+                static const uint32_t unmapped = 0;
+                if (mem_seq[id] == NO_SEG || (id == 1 && header.shared)) {
+                        ok = write_words(out, &unmapped, 1);
+                } else {
+                        uint32_t *seg = SEG(um, mem_seq[id]);
+                        ok = write_words(out, seg, seg[0]);
+                }
+        }
+        return ok;
+}
+
+/* writes num_words words; false if it could not. They are copied out
+ * first: in compressed mode a segment's chunk may be inaccessible until
+ * touched (compress.c), and write(2) would fail on it rather than fault */
+static bool write_words(FILE *out, const uint32_t *words, size_t num_words)
+{
+        static uint32_t buffer[BOUNCE_WORDS];
+        while (num_words > 0) {
+                size_t n = num_words < BOUNCE_WORDS ? num_words
+                                                    : BOUNCE_WORDS;
+                memcpy(buffer, words, n * sizeof(uint32_t));
+                if (fwrite(buffer, sizeof(uint32_t), n, out) != n) {
+                        return false;
+                }
+                words += n;
+                num_words -= n;
+        }
+        return true;
+}
@@ -0,0 +1,99 @@
+/*****************************************************************************
+ *
+ *                       snapshot.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM snapshot header, contains declarations for writing a
+ *               running program's whole state to a file (./um -S, -P) and
+ *               resuming it from there (./um -R).
+ *
+ ****************************************************************************/
+#ifndef SNAPSHOT
+#define SNAPSHOT
+#include <stdint.h>
+#include <stdbool.h>
+#include "engine.h"
+#include "load.h"
+
+/* First 8 bytes of a snapshot file; the last is the format's version */
+#define SNAPSHOT_MAGIC "UMsnap\0\1"
+
+/* Where a requested snapshot is written */
+typedef enum snapshot_point {
+        SNAP_AT_INPUT = 1,      /* first Input, before it reads */
+        SNAP_AT_LOAD            /* first Load_program of another segment */
+} snapshot_point;
+
+/* Snapshot request struct
+ *
+ * Purpose: a snapshot to write while the program runs
+ * Members:
+ *      - const char *path: file to write it to
+ *      - snapshot_point at: when to write it
+ *      - bool written: it has been written
+ */
+typedef struct snapshot_request {
+        const char *path;
+        snapshot_point at;
+        bool written;
+} *snapshot_request_t;
+
+/* Snapshot header struct
+ *
+ * Purpose: the start of a snapshot file, which goes on with
+ *              output_bytes bytes of output, padded to a whole word
+ *              num_unmapped words: the unmapped stack, bottom first
+ *              for each index 1 ... num_ids - 1 of the spine, the words of
+ *              that segment, length + 1 first, or a single 0 if it is
+ *              unmapped, or (index 1) if segment 0 shares storage
+ *          all of it in host byte order, so it can be used mapped in place
+ * Members:
+ *      - char magic[]: SNAPSHOT_MAGIC
+ *      - uint32_t byte_order: 0x01020304, as written by the host
+ *      - uint32_t r[]: registers
+ *      - uint32_t prog_counter: where the program resumes in segment 0
+ *      - uint32_t num_ids: mem_seq[0][1], one past the highest id used
+ *      - uint32_t shared: mem_seq[0][META_SHARED]
+ *      - uint32_t num_unmapped: ids on the unmapped stack
+ *      - uint64_t output_bytes: output the program wrote before the
+ *        snapshot, written again on restore
+ */
+typedef struct snapshot_header {
+        char magic[8];
+        uint32_t byte_order;
+        uint32_t r[NUM_REG];
+        uint32_t prog_counter;
+        uint32_t num_ids;
+        uint32_t shared;
+        uint32_t num_unmapped;
+        uint64_t output_bytes;
+} snapshot_header;
+
+/* Snapshot struct
+ *
+ * Purpose: a snapshot file mapped for restoring
+ * Members:
+ *      - program_image image: the mapping (load.h)
+ *      - const snapshot_header *header: its header
+ *      - const uint8_t *output: the output it replays
+ *      - const uint32_t *unmapped: its unmapped stack
+ *      - const uint32_t *segs: its first segment record, segment 0's
+ *      - uint32_t seg_0_len: length of segment 0, or 0 if it is shared
+ */
+typedef struct snapshot {
+        program_image image;
+        const snapshot_header *header;
+        const uint8_t *output;
+        const uint32_t *unmapped;
+        const uint32_t *segs;
+        uint32_t seg_0_len;
+} snapshot;
+
+void take_snapshot(um_state_t um);
+bool open_snapshot(const char *path, snapshot *snap);
+void restore_snapshot(um_state_t um, const snapshot *snap);
+void close_snapshot(snapshot *snap);
+#endif
@@ -0,0 +1,405 @@
+/*****************************************************************************
+ *
+ *                       spill.c
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM spill mode. The segment arena (memory.c) is a shared
+ *               mapping of a sparse, already unlinked file in $TMPDIR (or
+ *               /var/tmp), so every page of segment storage has a place
+ *               on disk. A background thread reads um's resident set size
+ *               every SPILL_PERIOD_MS; while it is over the cap, the
+ *               thread sweeps the arena a chunk at a time like a clock
+ *               hand, dropping the chunk's pages from um (they are written
+ *               to the file first) and from the page cache. Segment_load
+ *               and Segment_store need no residency check: touching a
+ *               spilled page is an ordinary page fault, which reads it
+ *               back from the file.
+ *
+ *               The sweep has no access information, so it spills in
+ *               arena order rather than strictly coldest first; the hand
+ *               keeps moving, so recently spilled chunks are the last to
+ *               be spilled again.
+ *
+ ****************************************************************************/
+#define _GNU_SOURCE /* sync_file_range */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "spill.h"
+
+/* Spill state struct
+ *
+ * Purpose: the spill file and the thread that pages segments out to it
+ * Members:
+ *      - int fd: the spill file, which the arena maps
+ *      - uint8_t *arena: the arena
+ *      - const size_t *arena_used: bytes of the arena handed out so far
+ *        (the pool's count, read atomically)
+ *      - size_t cap: resident bytes allowed before a pass spills
+ *      - size_t hand: arena offset the next chunk is spilled from
+ *      - int statm: open /proc/self/statm, or -1
+ *      - pthread_t thread, bool running, bool stop: the spill thread
+ *      - uint64_t passes: passes that found um over the cap
+ *      - uint64_t spilled_pages: pages written out and dropped
+ *      - size_t peak_rss: largest resident set the thread saw
+ *      - long major_start, minor_start: page faults before the program
+ *        ran
+ */
+struct spill {
+        int fd;
+        uint8_t *arena;
+        const size_t *arena_used;
+        size_t cap;
+        size_t hand;
+        int statm;
+        pthread_t thread;
+        bool running;
+        bool stop;
+        uint64_t passes;
+        uint64_t spilled_pages;
+        size_t peak_rss;
+        long major_start, minor_start;
+};
+
+static void *spill_thread(void *arg);
+static void spill_pass(spill_t spill, size_t rss);
+static size_t drop_chunk(spill_t spill, size_t offset, size_t bytes);
+static size_t resident_bytes(spill_t spill);
+static void count_faults(long *major, long *minor);
+
+/**********new_spill**********************************************************
+ *
+ * Purpose:
+ *      Creates a spill file and maps an arena from it
+ * Parameters:
+ *      uint8_t **arena: set to the arena, all zeros
+ *      size_t bytes: size of the arena
+ * Returns:
+ *      The spill state, or NULL (with *arena untouched) if the file could
+ *      not be made or mapped
+ * Expects:
+ *      arena to be non-NULL
+ * Notes:
+ *      The file is sparse: it only takes disk space for pages that are
+ *      spilled. It is unlinked at once, so nothing is left behind however
+ *      um exits. Must be freed with free_spill, before the arena is
+ *      unmapped
+ ****************************************************************************/
+spill_t new_spill(uint8_t **arena, size_t bytes)
+{
+        assert(arena != NULL);
+        const char *dir = getenv("TMPDIR");
+        if (dir == NULL || dir[0] == '\0') {
+                dir = "/var/tmp";
+        }
+        char path[4096];
+        if (snprintf(path, sizeof(path), "%s/um-spill-XXXXXX", dir) >=
+            (int) sizeof(path)) {
+                return NULL;
+        }
+        int fd = mkstemp(path);
+        if (fd < 0) {
+                return NULL;
+        }
+        unlink(path);
+        void *map = MAP_FAILED;
+        if (ftruncate(fd, (off_t) bytes) == 0) {
+                map = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_NORESERVE, fd, 0);
+        }
+        if (map == MAP_FAILED) {
+                close(fd);
+                return NULL;
+        }
+        spill_t spill = calloc(1, sizeof(*spill));
+        assert(spill != NULL);
+        spill->fd = fd;
+        spill->arena = map;
+        spill->statm = -1;
+        *arena = map;
+        return spill;
+}
+
+/**********start_spill********************************************************
+ *
+ * Purpose:
+ *      Starts the thread that keeps um's resident memory under a cap
+ * Parameters:
+ *      spill_t spill: state from new_spill
+ *      const size_t *arena_used: the pool's count of arena bytes in use
+ *      size_t cap: resident bytes allowed
+ * Returns:
+ *      None
+ * Expects:
+ *      spill and arena_used to be non-NULL, and start_spill not to have
+ *      been called on spill before
+ * Notes:
+ *      The cap is on all of um's resident memory, so it should leave room
+ *      for what is not segment storage (the spine and decoded segment 0).
+ *      Failing to start the thread is a checked runtime error
+ ****************************************************************************/
+void start_spill(spill_t spill, const size_t *arena_used, size_t cap)
+{
+        assert(spill != NULL && arena_used != NULL && !spill->running);
+        spill->arena_used = arena_used;
+        spill->cap = cap;
+        spill->statm = open("/proc/self/statm", O_RDONLY);
+        count_faults(&spill->major_start, &spill->minor_start);
+        int err = pthread_create(&spill->thread, NULL, spill_thread, spill);
+        assert(err == 0);
+        (void) err;
+        spill->running = true;
+}
+
+/**********free_spill*********************************************************
+ *
+ * Purpose:
+ *      Stops the spill thread and closes the spill file
+ * Parameters:
+ *      spill_t *spill: spill state to free; set to NULL
+ * Returns:
+ *      None
+ * Expects:
+ *      spill and *spill to be non-NULL
+ * Notes:
+ *      The arena stays mapped; the caller unmaps it, which gives the
+ *      file's disk space back
+ ****************************************************************************/
+void free_spill(spill_t *spill)
+{
+        assert(spill != NULL && *spill != NULL);
+        if ((*spill)->running) {
+                __atomic_store_n(&(*spill)->stop, true, __ATOMIC_RELAXED);
+                pthread_join((*spill)->thread, NULL);
+        }
+        if ((*spill)->statm >= 0) {
+                close((*spill)->statm);
+        }
+        close((*spill)->fd);
+        free(*spill);
+        *spill = NULL;
+}
+
+/**********report_spill*******************************************************
+ *
+ * Purpose:
+ *      Prints the cap, how much was spilled, and how often um faulted on
+ *      a page it had to read back
+ * Parameters:
+ *      FILE *out: stream to print to
+ *      spill_t spill: state of a program that ran with start_spill
+ * Returns:
+ *      None
+ * Expects:
+ *      out and spill to be non-NULL
+ * Notes:
+ *      Faults are all of the process's page faults while the program ran:
+ *      major ones read spilled pages back from disk, minor ones include
+ *      pages still in the page cache as well as first touches. One fault
+ *      may map several pages
+ ****************************************************************************/
+void report_spill(FILE *out, spill_t spill)
+{
+        assert(out != NULL && spill != NULL);
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        long major, minor;
+        count_faults(&major, &minor);
+        fprintf(out, "spill            cap %llu KB, peak %llu KB resident, "
+                "%llu KB spilled in %llu passes\n",
+                (unsigned long long) (spill->cap / 1024),
+                (unsigned long long) (spill->peak_rss / 1024),
+                (unsigned long long) (spill->spilled_pages * page / 1024),
+                (unsigned long long) spill->passes);
+        fprintf(out, "spill faults     %ld major, %ld minor\n",
+                major - spill->major_start, minor - spill->minor_start);
+}
+
+/**********spill_thread*******************************************************
+ *
+ * Purpose:
+ *      Checks resident memory every SPILL_PERIOD_MS until told to stop,
+ *      spilling when it is over the cap
+ * Parameters:
+ *      void *arg: the spill state
+ * Returns:
+ *      NULL
+ * Expects:
+ *      arg to be a started spill_t
+ * Notes:
+ *      None
+ ****************************************************************************/
+static void *spill_thread(void *arg)
+{
+        spill_t spill = arg;
+        struct timespec period = { 0, SPILL_PERIOD_MS * 1000000L };
+        while (!__atomic_load_n(&spill->stop, __ATOMIC_RELAXED)) {
+                nanosleep(&period, NULL);
+                size_t rss = resident_bytes(spill);
+                if (rss > spill->peak_rss) {
+                        spill->peak_rss = rss;
+                }
+                if (rss > spill->cap) {
+                        spill_pass(spill, rss);
+                }
+        }
+        return NULL;
+}
+
+/**********spill_pass*********************************************************
+ *
+ * Purpose:
+ *      Spills chunks of the arena, from the hand on, until resident
+ *      memory is down to SPILL_LOW_WATER of the cap: first drops them all
+ *      from um, so its resident set shrinks at once, then writes them out
+ * Parameters:
+ *      spill_t spill: started spill state
+ *      size_t rss: resident bytes at the start of the pass
+ * Returns:
+ *      None
+ * Expects:
+ *      rss > spill->cap
+ * Notes:
+ *      Stops after one lap of the arena in use, even if resident memory
+ *      is still too high (memory that is not in the arena cannot be
+ *      spilled)
+ ****************************************************************************/
+static void spill_pass(spill_t spill, size_t rss)
+{
+        size_t used = __atomic_load_n(spill->arena_used, __ATOMIC_RELAXED);
+        size_t low = SPILL_LOW_WATER(spill->cap);
+        size_t first = spill->hand;
+        size_t chunks = 0;
+        spill->passes++;
+        for (size_t lap = 0; lap < used && rss > low;
+             lap += SPILL_CHUNK_BYTES) {
+                if (spill->hand >= used) {
+                        spill->hand = 0;
+                }
+                size_t bytes = used - spill->hand;
+                if (bytes > SPILL_CHUNK_BYTES) {
+                        bytes = SPILL_CHUNK_BYTES;
+                }
+                size_t dropped = drop_chunk(spill, spill->hand, bytes);
+                spill->hand += bytes;
+                chunks++;
+                rss = (dropped < rss) ? rss - dropped : 0;
+        }
+
+        /* then write them out, which is slow, and free the page cache */
+        size_t offset = first;
+        for (size_t i = 0; i < chunks; i++) {
+                if (offset >= used) {
+                        offset = 0;
+                }
+                size_t bytes = used - offset;
+                if (bytes > SPILL_CHUNK_BYTES) {
+                        bytes = SPILL_CHUNK_BYTES;
+                }
+                sync_file_range(spill->fd, (off_t) offset, (off_t) bytes,
+                                SYNC_FILE_RANGE_WAIT_BEFORE |
+                                SYNC_FILE_RANGE_WRITE |
+                                SYNC_FILE_RANGE_WAIT_AFTER);
+                posix_fadvise(spill->fd, (off_t) offset, (off_t) bytes,
+                              POSIX_FADV_DONTNEED);
+                offset += bytes;
+        }
+}
+
+/**********drop_chunk*********************************************************
+ *
+ * Purpose:
+ *      Drops the pages of one chunk of the arena from um's memory
+ * Parameters:
+ *      spill_t spill: started spill state
+ *      size_t offset: start of the chunk in the arena, page aligned
+ *      size_t bytes: size of the chunk
+ * Returns:
+ *      Bytes of the chunk that were in memory
+ * Expects:
+ *      offset + bytes to be within the arena in use
+ * Notes:
+ *      The pages' contents stay in the page cache, dirty, until
+ *      spill_pass writes them to the file. um may be writing to the chunk
+ *      meanwhile: a page touched after it was dropped faults back in from
+ *      the page cache or the file, and a page dirtied after it was written
+ *      out stays cached, so no write is lost
+ ****************************************************************************/
+static size_t drop_chunk(spill_t spill, size_t offset, size_t bytes)
+{
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        uint8_t *start = spill->arena + offset;
+        unsigned char in_core[SPILL_CHUNK_BYTES / 4096]; /* page >= 4K */
+        size_t pages = (bytes + page - 1) / page;
+        size_t resident = 0;
+        if (page >= 4096 && mincore(start, bytes, in_core) == 0) {
+                for (size_t i = 0; i < pages; i++) {
+                        resident += in_core[i] & 1;
+                }
+        }
+        if (resident == 0) {
+                return 0;
+        }
+        madvise(start, bytes, MADV_DONTNEED);
+        spill->spilled_pages += resident;
+        return resident * page;
+}
+
+/**********resident_bytes*****************************************************
+ *
+ * Purpose:
+ *      Reads um's resident set size
+ * Parameters:
+ *      spill_t spill: started spill state
+ * Returns:
+ *      Resident bytes, or 0 if they could not be read
+ * Expects:
+ *      spill to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+static size_t resident_bytes(spill_t spill)
+{
+        char buf[128];
+        ssize_t len = pread(spill->statm, buf, sizeof(buf) - 1, 0);
+        if (len <= 0) {
+                return 0;
+        }
+        buf[len] = '\0';
+        unsigned long long total, resident;
+        if (sscanf(buf, "%llu %llu", &total, &resident) != 2) {
+                return 0;
+        }
+        return (size_t) resident * (size_t) sysconf(_SC_PAGESIZE);
+}
+
+/**********count_faults*******************************************************
+ *
+ * Purpose:
+ *      Counts the process's page faults so far
+ * Parameters:
+ *      long *major: set to faults that had to read from disk
+ *      long *minor: set to the others
+ * Returns:
+ *      None
+ * Expects:
+ *      major and minor to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+static void count_faults(long *major, long *minor)
+{
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        *major = usage.ru_majflt;
+        *minor = usage.ru_minflt;
+}
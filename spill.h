@@ -0,0 +1,37 @@
+/*****************************************************************************
+ *
+ *                       spill.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: UM spill header, contains declarations for spill mode
+ *               (./um -m): the segment arena is mapped from a spill file,
+ *               and a background thread pages segment storage out to it
+ *               whenever um's resident memory goes over a cap.
+ *
+ ****************************************************************************/
+#ifndef SPILL
+#define SPILL
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* How often the spill thread checks resident memory, in milliseconds */
+#define SPILL_PERIOD_MS 10
+
+/* Bytes of the arena paged out at a time */
+#define SPILL_CHUNK_BYTES ((size_t) 1 << 20)
+
+/* A pass pages out until resident memory is this fraction of the cap */
+#define SPILL_LOW_WATER(cap) ((cap) / 8 * 7)
+
+typedef struct spill *spill_t;
+
+spill_t new_spill(uint8_t **arena, size_t bytes);
+void start_spill(spill_t spill, const size_t *arena_used, size_t cap);
+void free_spill(spill_t *spill);
+void report_spill(FILE *out, spill_t spill);
+#endif
@@ -18,6 +18,12 @@
 #include "set.h"
 #include "atom.h"
 
+/**********opcodes***********************************************************/
+typedef enum um_opcode {
+        CMOV = 0, SLOAD, SSTORE, ADD, MUL, DIV,
+        NAND, HALT, ACTIVATE, INACTIVATE, OUT, IN, LOADP, LV
+} um_opcode;
+
 /**********struct definitions************************************************/
 
 /* three register instruction struct
@@ -42,6 +48,23 @@ typedef struct load_val_instruction {
         uint32_t A, val;
 } inst_loadval_t;
 
+/* decoded instruction struct
+ *
+ * Purpose: stores one pre-decoded word of segment 0 so the main loop never
+ *          has to re-extract fields from the raw 32-bit instruction
+ * Members:
+ *      - uint8_t OP: opcode
+ *      - uint8_t A, B, C: indices of registers A, B, and C (for Load_value,
+ *        A is the register being loaded and B, C are unused)
+ *      - uint32_t val: value to load for a Load_value instruction; for a
+ *        three register instruction, (OP << 9) | (A << 6) | (B << 3) | C,
+ *        its index into the specialized handler table (execute_inst.h)
+ */
+typedef struct decoded_instruction {
+        uint8_t OP, A, B, C;
+        uint32_t val;
+} inst_decoded_t;
+
 typedef struct memory {
         uint32_t **mem_seq;
         uint32_t  *unmapped;
@@ -56,12 +79,19 @@ typedef struct memory {
 #define RB_LSB 3
 #define RC_LSB 0
 #define LOADVAL_OP 13
+#define HANDLER_IDX_LSB 9
 #define LOADVAL_REG_LSB 25
 #define LOADVAL_VAL_LSB 0
 #define LOADVAL_VAL_W 25
 #define WORD_SZ 32
 #define BYTE_W 8
 #define MAX_CHAR 255
+
+/* mem_seq[0] metadata words: spine size, next fresh id, and the id of the
+ * segment whose storage segment 0 shares after a Load_program (0 if none)
+ */
+#define META_WORDS 3
+#define META_SHARED 2
 #define NUM_REG 8
 #define MAX_SIZE 9223372036854775807
 #endif
\ No newline at end of file
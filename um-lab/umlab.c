@@ -17,6 +17,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <assert.h>
+#include <stdbool.h>
 #include <seq.h>
 #include <bitpack.h>
 
@@ -454,6 +455,292 @@ void build_loadprog_noprint_test(Seq_T stream)
 }
 
 
+void build_selfmod_test(Seq_T stream)
+{
+        append(stream, loadval(r1, 'Y'));
+
+        // word for output(r1): (10 * 16777216 * 16) + 1
+        append(stream, loadval(r5, 10));
+        append(stream, loadval(r6, 16777216));
+        append(stream, multiply(r7, r5, r6));
+        append(stream, loadval(r6, 16));
+        append(stream, multiply(r4, r7, r6));
+        append(stream, loadval(r6, 1));
+        append(stream, add(r4, r4, r6));
+
+        // overwrite the first halt below (word 11) with output(r1)
+        append(stream, loadval(r0, 0));
+        append(stream, loadval(r3, 11));
+        append(stream, segstore(r0, r3, r4));
+        append(stream, halt());
+        append(stream, halt());
+}
+
+/* puts any 32-bit word in ra as (word / 65536) * 65536 + word % 65536,
+ * using scratch as a temporary */
+static void load_word(Seq_T stream, Um_register ra, Um_register scratch,
+                      Um_instruction word)
+{
+        append(stream, loadval(ra, word >> 16));
+        append(stream, loadval(scratch, 65536));
+        append(stream, multiply(ra, ra, scratch));
+        append(stream, loadval(scratch, word & 0xffff));
+        append(stream, add(ra, ra, scratch));
+}
+
+void build_cowload_test(Seq_T stream)
+{
+        /* the program loaded from segment r1; r0 = 0, r2 = 4, r3 = 6,
+         * r4 = 'A', r5 = the word for output(r6), r6 = 'B' */
+        Um_instruction prog[] = {
+                output(r4),
+                segstore(r0, r2, r5),   /* seg 0 word 4 := output(r6) */
+                loadprog(r0, r2),
+                halt(),
+                halt(),                 /* 'B' from segment 0 only */
+                loadprog(r1, r3),       /* reload r1, go to word 6 */
+                segload(r7, r0, r2),    /* still halt() if r1 unchanged */
+                unmap(r1),
+                map(r1, r2),
+                loadval(r4, 16777216),
+                divide(r7, r7, r4),     /* halt() / 2^24 == 'p' */
+                output(r7),
+                segload(r7, r0, r2),
+                divide(r7, r7, r4),
+                output(r7),
+                halt()
+        };
+        unsigned prog_len = sizeof(prog) / sizeof(prog[0]);
+
+        append(stream, loadval(r2, prog_len));
+        append(stream, map(r1, r2));
+        for (unsigned i = 0; i < prog_len; i++) {
+                load_word(stream, r5, r7, prog[i]);
+                append(stream, loadval(r3, i));
+                append(stream, segstore(r1, r3, r5));
+        }
+        load_word(stream, r5, r7, output(r6));
+        append(stream, loadval(r2, 4));
+        append(stream, loadval(r3, 6));
+        append(stream, loadval(r4, 'A'));
+        append(stream, loadval(r6, 'B'));
+        append(stream, loadprog(r1, r0));
+}
+
+
+void build_loadreuse_test(Seq_T stream)
+{
+        /* two programs of the same length, in segments r1 and r2, loaded
+         * in turn: the first three times, so its build is saved on the
+         * second load and reused on the third;
+         * r0 = 0, r3 = 2, r5 = 4, r4 = 'A', r6 = 'B' */
+        Um_instruction first[] = {
+                output(r4),
+                loadprog(r2, r0),
+                output(r4),             /* reached by reloading r1 */
+                loadprog(r2, r3),
+                output(r4),             /* reached by reloading r1 again */
+                halt()
+        };
+        Um_instruction second[] = {
+                output(r6),
+                loadprog(r1, r3),
+                output(r6),
+                loadprog(r1, r5),
+                halt(),
+                halt()
+        };
+        unsigned prog_len = sizeof(first) / sizeof(first[0]);
+
+        append(stream, loadval(r3, prog_len));
+        append(stream, map(r1, r3));
+        append(stream, map(r2, r3));
+        for (unsigned i = 0; i < prog_len; i++) {
+                append(stream, loadval(r3, i));
+                load_word(stream, r5, r7, first[i]);
+                append(stream, segstore(r1, r3, r5));
+                load_word(stream, r5, r7, second[i]);
+                append(stream, segstore(r2, r3, r5));
+        }
+        append(stream, loadval(r3, 2));
+        append(stream, loadval(r5, 4));
+        append(stream, loadval(r4, 'A'));
+        append(stream, loadval(r6, 'B'));
+        append(stream, loadprog(r1, r0));
+}
+
+void build_foldloop_test(Seq_T stream)
+{
+        /* a loop taken 49 times, hot enough for ./um -j to compile it */
+        append(stream, loadval(r1, 50));
+
+        // word 1: 0xffffff * 256 wraps to 0xffffff00, NAND makes 255
+        append(stream, loadval(r3, 16777215));
+        append(stream, loadval(r4, 256));
+        append(stream, multiply(r5, r3, r4));
+        append(stream, nand(r5, r5, r5));
+        append(stream, loadval(r6, 3));
+        append(stream, divide(r5, r5, r6));
+        append(stream, loadval(r7, 0));
+        append(stream, cmov(r5, r3, r7));
+
+        // r1 += ~0, through a Load_value that is overwritten unread
+        append(stream, loadval(r4, 9));
+        append(stream, loadval(r4, 0));
+        append(stream, nand(r4, r4, r4));
+        append(stream, add(r1, r1, r4));
+
+        // jump back to word 1 until r1 is 0, then to word 17
+        append(stream, loadval(r6, 1));
+        append(stream, loadval(r7, 17));
+        append(stream, cmov(r7, r6, r1));
+        append(stream, loadprog(r0, r7));
+        append(stream, output(r5));
+        append(stream, halt());
+}
+
+/* codex.umz's copy loop (see idiom.c), copying "HELLO" from words 3 - 7 of
+ * segment r0 to words 0 - 4 of segment r3; with alias, r0 and r3 hold the
+ * same id, so ./um has to interpret the loop instead; with patch, the
+ * loop's step of the destination index is overwritten with 0 before it
+ * runs, so every letter lands in word 0 and only "O" is printed */
+static void build_copy_loop(Seq_T stream, bool alias, bool patch)
+{
+        const unsigned count_word = 2, src_word = 3;
+        const char *text = "HELLO";
+
+        // jump over the two data words
+        append(stream, loadval(r4, 4));
+        append(stream, loadprog(r6, r4));
+        append(stream, 0);
+        append(stream, 0);
+
+        append(stream, loadval(r1, 8));
+        append(stream, map(r0, r1));
+        for (unsigned k = 0; k < 5; k++) {
+                append(stream, loadval(r4, 3 + k));
+                append(stream, loadval(r5, text[k]));
+                append(stream, segstore(r0, r4, r5));
+        }
+        if (alias) {
+                append(stream, add(r3, r0, r6));
+        } else {
+                append(stream, loadval(r1, 5));
+                append(stream, map(r3, r1));
+        }
+        append(stream, loadval(r4, count_word));
+        append(stream, loadval(r5, 5));
+        append(stream, segstore(r6, r4, r5));
+        append(stream, loadval(r2, 0));
+        if (patch) {
+                // segment 0 word start + 19 := loadval(r4, 0)
+                unsigned loop = Seq_length(stream) + 7;
+                load_word(stream, r7, r5, loadval(r4, 0));
+                append(stream, loadval(r4, loop + 19));
+                append(stream, segstore(r2, r4, r7));
+        }
+
+        unsigned start = Seq_length(stream);
+        append(stream, loadval(r1, count_word));
+        append(stream, segload(r1, r6, r1));
+        append(stream, loadval(r4, start + 23));
+        append(stream, loadval(r5, start + 6));
+        append(stream, cmov(r4, r5, r1));
+        append(stream, loadprog(r6, r4));
+        append(stream, nand(r7, r6, r6));
+        append(stream, add(r1, r7, r1));
+        append(stream, loadval(r4, count_word));
+        append(stream, segstore(r6, r4, r1));
+        append(stream, loadval(r5, src_word));
+        append(stream, segload(r1, r6, r5));
+        append(stream, loadval(r4, 1));
+        append(stream, add(r1, r1, r4));
+        append(stream, segstore(r6, r5, r1));
+        append(stream, loadval(r4, 2));
+        append(stream, add(r4, r4, r1));
+        append(stream, segload(r4, r0, r4));
+        append(stream, segstore(r3, r2, r4));
+        append(stream, loadval(r4, 1));
+        append(stream, add(r2, r2, r4));
+        append(stream, loadval(r4, start));
+        append(stream, loadprog(r6, r4));
+
+        for (unsigned k = 0; k < (patch ? 1 : 5); k++) {
+                append(stream, loadval(r4, k));
+                append(stream, segload(r5, r3, r4));
+                append(stream, output(r5));
+        }
+        append(stream, halt());
+}
+
+void build_copyloop_test(Seq_T stream)
+{
+        build_copy_loop(stream, false, false);
+}
+
+void build_copyalias_test(Seq_T stream)
+{
+        build_copy_loop(stream, true, false);
+}
+
+void build_copypatch_test(Seq_T stream)
+{
+        build_copy_loop(stream, false, true);
+}
+
+void build_manymaps_test(Seq_T stream)
+{
+        // map 3000 one word segments, storing the countdown in each
+        append(stream, loadval(r1, 3000));
+        append(stream, loadval(r3, 1));
+        append(stream, nand(r5, r6, r6));
+        append(stream, map(r2, r3));
+        append(stream, segstore(r2, r0, r1));
+        append(stream, add(r1, r1, r5));
+        append(stream, loadval(r4, 3));
+        append(stream, loadval(r7, 10));
+        append(stream, cmov(r7, r4, r1));
+        append(stream, loadprog(r0, r7));
+
+        // last segment holds 1: print 1 + 65
+        append(stream, segload(r4, r2, r0));
+        append(stream, loadval(r7, 65));
+        append(stream, add(r4, r4, r7));
+        append(stream, output(r4));
+
+        // first segment (id 2) holds 3000: print 3000 / 100 + 35
+        append(stream, loadval(r3, 2));
+        append(stream, segload(r4, r3, r0));
+        append(stream, loadval(r7, 100));
+        append(stream, divide(r4, r4, r7));
+        append(stream, loadval(r7, 35));
+        append(stream, add(r4, r4, r7));
+        append(stream, output(r4));
+        append(stream, halt());
+}
+
+void build_sparsemap_test(Seq_T stream)
+{
+        // map a 128 MB segment and use only its last word
+        append(stream, loadval(r3, 33554431));
+        append(stream, map(r2, r3));
+        append(stream, loadval(r4, 33554430));
+        append(stream, loadval(r5, 'O'));
+        append(stream, segstore(r2, r4, r5));
+        append(stream, segload(r6, r2, r4));
+        append(stream, output(r6));
+
+        // map it again: the recycled segment must read back zero
+        append(stream, unmap(r2));
+        append(stream, map(r2, r3));
+        append(stream, segload(r6, r2, r4));
+        append(stream, loadval(r5, 'K'));
+        append(stream, add(r6, r6, r5));
+        append(stream, output(r6));
+        append(stream, halt());
+}
+
+
 /************************ UNIT TESTS for the UM ABOVE ***********************/
 
 Um_instruction three_register(Um_opcode op, int ra, int rb, int rc)
@@ -29,6 +29,15 @@ extern void build_nand_test(Seq_T instructions);
 extern void build_multiply_test(Seq_T instructions);
 extern void build_segstore_test(Seq_T instructions);
 extern void build_map_test(Seq_T instructions);
+extern void build_selfmod_test(Seq_T instructions);
+extern void build_cowload_test(Seq_T instructions);
+extern void build_loadreuse_test(Seq_T instructions);
+extern void build_foldloop_test(Seq_T instructions);
+extern void build_copyloop_test(Seq_T instructions);
+extern void build_copyalias_test(Seq_T instructions);
+extern void build_copypatch_test(Seq_T instructions);
+extern void build_manymaps_test(Seq_T instructions);
+extern void build_sparsemap_test(Seq_T instructions);
 
 /* The array `tests` contains all unit tests for the lab. */
 
@@ -58,7 +67,16 @@ static struct test_info {
         { "unmap_success", NULL, NULL, build_unmap_success_test },
         { "loadprogprint", NULL, NULL, build_loadprog_print_test } ,
         { "loadprognoprint", NULL, NULL, build_loadprog_noprint_test } ,
-        { "long_memory_2", NULL, "abcdefg", build_long_memory_test_2 }
+        { "long_memory_2", NULL, "abcdefg", build_long_memory_test_2 },
+        { "selfmod", NULL, "Y", build_selfmod_test },
+        { "cowload", NULL, "ABpp", build_cowload_test },
+        { "loadreuse", NULL, "ABABA", build_loadreuse_test },
+        { "foldloop", NULL, "U", build_foldloop_test },
+        { "copyloop", NULL, "HELLO", build_copyloop_test },
+        { "copyalias", NULL, "HELLO", build_copyalias_test },
+        { "copypatch", NULL, "O", build_copypatch_test },
+        { "manymaps", NULL, "BA", build_manymaps_test },
+        { "sparsemap", NULL, "OK", build_sparsemap_test }
 };
 
   
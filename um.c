@@ -18,10 +18,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
-#include "execute_inst.h"
+#include <stdbool.h>
+#include <unistd.h>
+#include "engine.h"
+#include "jit.h"
+#include "memory.h"
+#include "guard.h"
+#include "spill.h"
+#include "compress.h"
+#include "io.h"
+#include "load.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "batch.h"
 #include "structs_and_constants.h"
 #include "uarray.h"
-#include "sys/stat.h"
 
 /******************************global macros*********************************/
 #define NUM_REG 8
@@ -29,224 +40,395 @@
 #define INITIAL_MAPPED_SIZE 0
 #define INITIAL_UNMAPPED_SIZE 0
 #define BYTES_PER_WORD 4
-#define SPINE_SIZE 4294967295
 
 /**************************function declarations******************************/
+static void load_program(um_state_t um, const char *path,
+                         memory_mode mode);
+static void load_snapshot(um_state_t um, const char *path,
+                          memory_mode mode);
+static void new_memory_or_exit(um_state_t um, uint32_t seg_0_len,
+                               memory_mode mode);
+static void report_stats(FILE *out, um_state_t um);
+static void free_um(um_state_t um);
+
 int main(int argc, char*argv[])
 {
-        if (argc != 2) {
-                printf("Usage: ./um filename.um\n");
-                exit(1);
+        bool print_stats = false;
+        bool use_jit = false;
+        bool checked = false;
+        memory_mode mode = MEM_HEAP;
+        size_t spill_mb = 0;
+        unsigned zip_ms = 0;
+        struct snapshot_request request = { .path = NULL, .written = false };
+        char *restore_path = NULL;
+        char *checkpoint_path = NULL;
+        unsigned long long interval = CHECKPOINT_DEFAULT_INTERVAL;
+        bool interval_set = false;
+        char *batch_path = NULL;
+        unsigned workers = 0;
+        unsigned long long quota = BATCH_DEFAULT_QUOTA;
+        bool pin = false, batch_flags = false;
+        int opt;
+        while ((opt = getopt(argc, argv, "sjagcm:z:S:P:R:K:k:B:t:q:p"))
+               != -1) {
+                if (opt == 's') {
+                        print_stats = true;
+                } else if (opt == 'j') {
+                        use_jit = true;
+                } else if (opt == 'a' && mode != MEM_GUARDED) {
+                        /* spill mode is arena mode already */
+                        mode = (mode == MEM_SPILL) ? MEM_SPILL : MEM_ARENA;
+                } else if (opt == 'g' && mode == MEM_HEAP) {
+                        mode = MEM_GUARDED;
+                } else if (opt == 'm' && mode != MEM_GUARDED &&
+                           sscanf(optarg, "%zu", &spill_mb) == 1 &&
+                           spill_mb > 0) {
+                        mode = MEM_SPILL;
+                } else if (opt == 'z' && sscanf(optarg, "%u", &zip_ms) == 1 &&
+                           zip_ms > 0) {
+                        /* compressed mode is arena mode too */
+                        mode = (mode == MEM_HEAP) ? MEM_ARENA : mode;
+                } else if (opt == 'c') {
+                        checked = true;
+                } else if ((opt == 'S' || opt == 'P') &&
+                           request.path == NULL) {
+                        request.path = optarg;
+                        request.at = (opt == 'S') ? SNAP_AT_INPUT
+                                                  : SNAP_AT_LOAD;
+                } else if (opt == 'R') {
+                        restore_path = optarg;
+                } else if (opt == 'K') {
+                        /* dirty chunks are tracked in the arena */
+                        checkpoint_path = optarg;
+                        mode = (mode == MEM_HEAP) ? MEM_ARENA : mode;
+                } else if (opt == 'k' &&
+                           sscanf(optarg, "%llu", &interval) == 1 &&
+                           interval > 0) {
+                        interval_set = true;
+                } else if (opt == 'B') {
+                        batch_path = optarg;
+                } else if (opt == 't' && sscanf(optarg, "%u", &workers) == 1 &&
+                           workers > 0) {
+                        batch_flags = true;
+                } else if (opt == 'q' &&
+                           sscanf(optarg, "%llu", &quota) == 1 && quota > 0) {
+                        batch_flags = true;
+                } else if (opt == 'p') {
+                        pin = true;
+                        batch_flags = true;
+                } else {
+                        argc = 0;
+                }
         }
-
-        /* open input file and get number of 32-bit words */
-        FILE *um_fp = fopen(argv[1], "r"); 
-        if (um_fp == NULL) {
-                fprintf(stderr, "Could not open file %s\n", argv[1]);
+        if (batch_path != NULL) {
+                /* batch jobs run on libum, in heap mode, with no options
+                 * of their own */
+                if (optind != argc || print_stats || use_jit || checked ||
+                    mode != MEM_HEAP || zip_ms > 0 || request.path != NULL ||
+                    restore_path != NULL || checkpoint_path != NULL ||
+                    interval_set) {
+                        argc = 0;
+                } else {
+                        return run_batch(batch_path, workers, quota, pin);
+                }
+        } else if (batch_flags) {
+                argc = 0;
+        }
+        if (use_jit + (mode == MEM_GUARDED) + checked > 1) {
+                /* native code is neither guarded nor checked */
+                argc = 0;
+        }
+        if (zip_ms > 0 && mode != MEM_ARENA) {
+                /* chunks are compressed in an arena of anonymous memory */
+                argc = 0;
+        }
+        if (checkpoint_path != NULL &&
+            (use_jit || checked || zip_ms > 0 || request.path != NULL ||
+             (mode != MEM_ARENA && mode != MEM_SPILL))) {
+                /* native code keeps registers the log cannot see, the
+                 * other modes have SIGSEGV handlers of their own, and a
+                 * snapshot would take the output checkpoints keep */
+                argc = 0;
+        }
+        if (interval_set && checkpoint_path == NULL) {
+                argc = 0;
+        }
+#ifdef UM_FLAT
+        if (mode == MEM_GUARDED) {
+                /* guarded segments are mapped outside the arena */
+                argc = 0;
+        }
+#endif
+        if (argc - optind != (restore_path == NULL ? 1 : 0)) {
+                printf("Usage: ./um [-s] [-j | -g | -c] [-a] [-m MB | -z MS] "
+                       "[-S | -P FILE]\n"
+                       "            [-K FILE [-k N]] filename.um | -R FILE\n"
+                       "       ./um -B MANIFEST [-t N] [-q N] [-p]\n");
+                printf("  -s  print execution statistics to stderr on halt\n");
+                printf("  -j  compile hot blocks to native code (x86-64)\n");
+                printf("  -a  keep all segments in one arena, freed at once\n");
+                printf("  -g  safe mode: report out of bounds segment "
+                       "accesses\n");
+                printf("  -c  checked mode: report the first invalid "
+                       "instruction\n");
+                printf("  -m  spill segments to a file in $TMPDIR to keep "
+                       "um under MB resident\n");
+                printf("  -z  compress arena chunks left untouched for MS "
+                       "ms of CPU time\n");
+                printf("  -S  write a snapshot to FILE at the first Input\n");
+                printf("  -P  write a snapshot to FILE at the first load of "
+                       "another program\n");
+                printf("  -K  append a checkpoint to FILE every N dispatches "
+                       "(-k, default %llu)\n",
+                       (unsigned long long) CHECKPOINT_DEFAULT_INTERVAL);
+                printf("  -R  resume the program snapshotted or checkpointed "
+                       "in FILE\n");
+                printf("  -B  run every PROGRAM INPUT OUTPUT line of MANIFEST "
+                       "on a pool of threads\n");
+                printf("  -t  use N threads (default one per core)\n");
+                printf("  -q  run each job N dispatches at a time (default "
+                       "%llu)\n", (unsigned long long) BATCH_DEFAULT_QUOTA);
+                printf("  -p  pin each thread to a core\n");
                 exit(1);
         }
-        struct stat file_stats;
-        assert(stat(argv[1], &file_stats) == 0);
-        long num_words = (file_stats.st_size / BYTES_PER_WORD);
 
-        /* initialize registers and program counter */
-        uint32_t r[NUM_REG] = {0};
-        unsigned *prog_counter = malloc(sizeof(*prog_counter));
-        *prog_counter = 0;
-        
-        /* initialize virtual memory mem_struct */
-        uint32_t **mem_seq = malloc(SPINE_SIZE);
-        uint32_t *metadata = malloc(2 * sizeof(uint32_t));
-        metadata[0] = SPINE_SIZE;
-        metadata[1] = 2;
-        mem_seq[0] = metadata;
+        /* segment 0 comes from the segment pool like every other segment */
+        struct um_state um = { .r = {0}, .prog_counter = 0 };
+        um.io = new_io(false);
+        if (checkpoint_path != NULL) {
+                /* the first checkpoint replays all output, restored too */
+                io_keep(um.io, true);
+        }
+        if (restore_path != NULL) {
+                load_snapshot(&um, restore_path, mode);
+        } else {
+                load_program(&um, argv[optind], mode);
+        }
+        if (request.path != NULL) {
+                um.snapshot = &request;
+                io_keep(um.io, true);
+        }
+        if (mode == MEM_SPILL) {
+                start_spill(um.pool->spill, &um.pool->arena_used,
+                            spill_mb << 20);
+        }
+        if (zip_ms > 0) {
+                um.pool->zip = start_compress(um.pool->arena, ARENA_BYTES,
+                                              ARENA_HOLE_BYTES,
+                                              &um.pool->arena_used, zip_ms);
+                if (um.pool->zip == NULL) {
+                        fprintf(stderr, "Could not reserve the compressed "
+                                "store\n");
+                        exit(1);
+                }
+        }
+        if (checkpoint_path != NULL) {
+                um.pool->checkpoint = start_checkpoints(&um, checkpoint_path,
+                                                        interval);
+                if (um.pool->checkpoint == NULL) {
+                        fprintf(stderr, "Could not write checkpoint log %s\n",
+                                checkpoint_path);
+                        exit(1);
+                }
+        }
 
-        uint32_t *unmapped = malloc(SPINE_SIZE);
-        unmapped[0] = 0;
-        int curr_byte = fgetc(um_fp);
-        uint32_t *m_0 = malloc((num_words + 1) * sizeof(uint32_t));
-        m_0[0] = num_words;
-        int word_idx = 0;
-        while (curr_byte != EOF) {
-                uint32_t curr_word = 0;
-                for (int i = 0; i < BYTES_PER_WORD; i++) {
-                        curr_word = curr_word | (curr_byte << (24 - 8 * i));
-                        curr_byte = fgetc(um_fp);
+        /* decode segment 0 once; engines only ever index its slots */
+        /* in safe and checked modes every dispatch is one instruction, for
+         * the report */
+        bool safe = (mode == MEM_GUARDED);
+        um.cache = new_inst_cache(engine_fuses && !safe && !checked);
+        if (use_jit) {
+                um.jit = new_jit();
+                if (um.jit == NULL) {
+                        fprintf(stderr, "JIT is not available here\n");
+                        exit(1);
                 }
-                m_0[word_idx + 1] = curr_word;
-                word_idx++;
+                um.cache->jit = um.jit;
         }
-        mem_seq[1] = m_0;
-        fclose(um_fp);
+        uint32_t *m_0 = SEG(&um, um.mem_seq[1]);
+        build_inst_cache(um.cache, m_0 + 1, m_0[0] - 1);
+        set_slots(&um);
 
-        while (*prog_counter < ((mem_seq)[0][0])) {
-                uint32_t *seg_0 = (mem_seq)[1];
-                uint32_t inst = seg_0[*prog_counter + 1];
-                if (inst >> 28 == 13) {
-                        uint32_t reg_idx = (inst << 4) >> 29;
-                        uint32_t val = (inst << 7) >> 7;
-                        r[reg_idx] = val;
-                        (*prog_counter)++;
-                } else {
-                        uint32_t OP = inst >> 28;
-                        uint32_t abc = (inst << 23) >> 23;
-                        uint32_t A = abc >> 6;
-                        uint32_t lose_A = (A << 6);
-                        uint32_t B = (abc - lose_A) >> 3;
-                        uint32_t lose_B = B << 3;
-                        uint32_t C = abc - lose_A - lose_B;
-                        if (OP != 13) {
-                                (*prog_counter)++;
-                        }                             
-                        if (OP == 7) {
-                                free(prog_counter);
-                        }
-                        switch (OP) {
-                                case 0: 
-                                {
-                                        if (r[C] != 0) {
-                                                r[A] = r[B];
-                                        }
-                                        break;
-                                }
-                                case 1:
-                                {
-                                        if (r[B] == 0) {
-                                                uint32_t *seg = (mem_seq)[1];
-                                                r[A] = seg[r[C] + 1];
-                                                break;
-                                        }
-                                        uint32_t *seg = (mem_seq)[r[B]];
-                                        r[A] = seg[r[C] + 1];
-                                        break;
-                                }
-                                case 2:
-                                {
-                                        uint32_t *segA = mem_seq[r[A]];
-                                        if (r[A] == 0) {
-                                                uint32_t *seg = (mem_seq)[1];
-                                                seg[r[B] + 1] = r[C];
-                                                break;
-                                        }
-                                        segA[r[B] + 1] = r[C];
-                                        break;
-                                }
-                                case 3:
-                                {
-                                        r[A] = (r[B] + r[C]);
-                                        break;
-                                }
-                                case 4:
-                                {
-                                        r[A] = (r[B] * r[C]);
-                                        break;
-                                }
-                                case 5:
-                                {
-                                        r[A] = (r[B] / r[C]);
-                                        break;
-                                }
-                                case 6:
-                                {
-                                        r[A] = ~(r[B] & r[C]);
-                                        break;
-                                }
-                                case 7:
-                                {
-                                        uint32_t num_segs = (mem_seq[0][1]);
-                                        for (long seg = 0; seg < num_segs; seg++) {
-                                                uint32_t *curr_seg = (mem_seq)[seg];
-                                                if (curr_seg != NULL) {
-                                                        free(curr_seg);
-                                                }
-                                        }
-                                        free(mem_seq);
-                                        free(unmapped);
-                                        exit(0);
-                                        break;
-                                }
-                                case 8:
-                                {
-                                        uint32_t *new_seg = calloc(((size_t) r[C]) + 1, sizeof(uint32_t));
-                                        new_seg[0] = r[C] + 1;
-                                        uint32_t unmapped_size = unmapped[0];
-                                        if (unmapped_size != 0) {
-                                                uint32_t unmapped_id = unmapped[unmapped_size];
-                                                (mem_seq)[unmapped_id] = new_seg;
-                                                r[B] = unmapped_id;
-                                                unmapped[0]--;
-                                        } else {
-                                                uint32_t *meta = mem_seq[0];
-                                                uint32_t seg_id = meta[1];
-                                                (mem_seq)[seg_id] = new_seg;
-                                                r[B] = seg_id;
-                                                meta[1] = seg_id + 1;
-                                        }
-                                        break;
-                                }
-                                case 9:
-                                {
-                                        /* free segment being unmapped */
-                                        uint32_t *seg = (mem_seq)[r[C]];
-                                        free(seg);
+        if (safe) {
+                install_fault_report(&um);
+                run_um_safe(&um);
+        } else if (checked) {
+                run_um_checked(&um);
+        } else if (checkpoint_path != NULL) {
+                run_um_checkpoint(&um);
+        } else {
+                run_um(&um);
+        }
+        io_flush(um.io);
+        if (um.snapshot != NULL) {
+                fprintf(stderr, "um: no snapshot written: the program "
+                        "halted first\n");
+        }
+        if (print_stats) {
+                report_stats(stderr, &um);
+        }
+        free_um(&um);
+        return 0;
+}
 
-                                        /* set pointer in mem_struct to NULL and add id to unmapped sequence */
-                                        mem_seq[r[C]] = NULL;
-                                        unmapped[unmapped[0] + 1] = r[C];
-                                        unmapped[0]++;
-                                        break;
-                                }
-                                case 10:
-                                {
-                                        if (r[C] == (uint32_t) ~0) {
-                                                break;
-                                        }
-                                        /* otherwise, print char of value at r[C] */
-                                        putc(r[C], stdout);
-                                        break;
-                                }
-                                case 11:
-                                {
-                                        int val = getc(stdin);
+/**********load_program*****************************************************
+ *
+ * Purpose:
+ *      Sets up memory for a .um file and loads it into segment 0
+ * Parameters:
+ *      um_state_t um: fresh state
+ *      const char *path: the .um file
+ *      memory_mode mode: memory mode to run in
+ * Returns:
+ *      None (exits with a message if the file cannot be loaded)
+ * Expects:
+ *      um and path to be non-NULL
+ * Notes:
+ *      Segment 0 is left to be decoded by the caller
+ ****************************************************************************/
+static void load_program(um_state_t um, const char *path, memory_mode mode)
+{
+        /* map input file and get number of 32-bit words */
+        program_image image;
+        if (!map_program(path, &image)) {
+                fprintf(stderr, "Could not open file %s\n", path);
+                exit(1);
+        }
+        if (image.size % BYTES_PER_WORD != 0 ||
+            image.size / BYTES_PER_WORD >= UINT32_MAX) {
+                fprintf(stderr, "%s is not a UM program: %zu bytes is not "
+                        "a whole number of words below 2^32\n", path,
+                        image.size);
+                exit(1);
+        }
+        uint32_t num_words = image.size / BYTES_PER_WORD;
+        new_memory_or_exit(um, num_words, mode);
+        uint32_t *m_0 = SEG(um, um->mem_seq[1]);
+        load_words(m_0 + 1, image.bytes, num_words);
+        unmap_program(&image);
+}
 
-                                        /* if input reaches EOF, fill r[C] with all 1's, otherwise just
-                                        * put int value of input char in r[C]
-                                        */
-                                        if (val != EOF) {
-                                                r[C] = (uint32_t) val;
-                                        } else {
-                                                r[C] = (uint32_t) ~0;
-                                        }
-                                        break;
-                                }
-                                case 12:
-                                {
-                                        *prog_counter = r[C];
-                        
-                                        /* if loading progr[a]m from mem[0] just return */
-                                        if (r[B] == 0) {
-                                                break;
-                                        }
-                                        
-                                        /* otherwise, copy segment from r[B] into mem[0] and free the 
-                                        * previous contents of m[0]
-                                        */
-                                        uint32_t *old_prog = (mem_seq)[1];
-                                        uint32_t *prog_seg = (mem_seq)[r[B]];
-                                        size_t prog_bytes = (prog_seg[0] + 1) * 4;
-                                        uint32_t *prog_copy = malloc(prog_bytes);
-                                        unsigned l = prog_seg[0];
-                                        for (unsigned i = 0; i < l; i++) {
-                                                prog_copy[i] = prog_seg[i];
-                                        }
-                                        free(old_prog);
-                                        mem_seq[1] = prog_copy;
-                                        break;
-                                }
-                                default:
-                                        {break;}
-                        }
-                }
-                }
-        return 0;
+/**********load_snapshot******************************************************
+ *
+ * Purpose:
+ *      Sets up memory for a snapshot, or the last checkpoint in a
+ *      checkpoint log, and restores it
+ * Parameters:
+ *      um_state_t um: fresh state, with I/O
+ *      const char *path: the snapshot file or checkpoint log
+ *      memory_mode mode: memory mode to run in
+ * Returns:
+ *      None (exits with a message if the file cannot be restored)
+ * Expects:
+ *      um and path to be non-NULL
+ * Notes:
+ *      Output the program wrote before the snapshot is written again,
+ *      and input it read from a checkpointed run is skipped. Segment 0
+ *      is left to be decoded by the caller
+ ****************************************************************************/
+static void load_snapshot(um_state_t um, const char *path, memory_mode mode)
+{
+        checkpoint_log log;
+        if (open_checkpoint_log(path, &log)) {
+                new_memory_or_exit(um, log.seg_0_len, mode);
+                restore_checkpoint(um, &log);
+                close_checkpoint_log(&log);
+                return;
+        }
+        snapshot snap;
+        if (!open_snapshot(path, &snap)) {
+                fprintf(stderr, "%s is not a snapshot or checkpoint log um "
+                        "can restore\n", path);
+                exit(1);
+        }
+        new_memory_or_exit(um, snap.seg_0_len, mode);
+        restore_snapshot(um, &snap);
+        close_snapshot(&snap);
+}
+
+/**********new_memory_or_exit*************************************************
+ *
+ * Purpose:
+ *      Calls new_memory, exiting with a message if it fails
+ * Parameters:
+ *      um_state_t um: fresh state
+ *      uint32_t seg_0_len: length of segment 0
+ *      memory_mode mode: memory mode to run in
+ * Returns:
+ *      None
+ * Expects:
+ *      um to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+static void new_memory_or_exit(um_state_t um, uint32_t seg_0_len,
+                               memory_mode mode)
+{
+        if (!new_memory(um, seg_0_len, mode)) {
+                fprintf(stderr, "Could not reserve the segment arena%s\n",
+                        mode == MEM_SPILL ? " in a spill file" : "");
+                exit(1);
+        }
+}
+
+/**********report_stats*******************************************************
+ *
+ * Purpose:
+ *      Prints how many UM instructions ran, how many dispatches it took,
+ *      which fused sequences and idioms fired, how often Load_program
+ *      reused a saved build of segment 0, and how the segment pool did
+ * Parameters:
+ *      FILE *out: stream to print to
+ *      um_state_t um: state of a halted program
+ * Returns:
+ *      None
+ * Expects:
+ *      out and um to be non-NULL
+ * Notes:
+ *      Instruction counts are in UM terms: a fused slot counts once per
+ *      instruction it stands for, and instructions run by an idiom or as
+ *      native code count without any dispatch.
+ ****************************************************************************/
+static void report_stats(FILE *out, um_state_t um)
+{
+        uint64_t insts = um->dispatches + fused_insts_saved(um->fused_hits) +
+                         um->idiom_insts + um->jit_insts;
+        fprintf(out, "instructions     %llu\n", (unsigned long long) insts);
+        fprintf(out, "dispatches       %llu (%.3f per instruction)\n",
+                (unsigned long long) um->dispatches,
+                insts == 0 ? 0.0 : (double) um->dispatches / insts);
+        report_fusion(out, um->cache->fused_sites, um->fused_hits);
+        report_idioms(out, um->cache->idiom_sites, um->idiom_hits);
+        fprintf(out, "segment 0 builds %llu reused, %llu decoded, %zu KB "
+                "saved\n", (unsigned long long) um->cache->build_hits,
+                (unsigned long long) um->cache->build_misses,
+                um->cache->saved_bytes >> 10);
+        report_memory(out, um->pool);
+        if (um->jit != NULL) {
+                fprintf(out, "jit instructions %llu\n",
+                        (unsigned long long) um->jit_insts);
+                report_jit(out, um->jit);
+        }
+}
+
+/**********free_um************************************************************
+ *
+ * Purpose:
+ *      Frees all of virtual memory, the instruction cache, the JIT, and
+ *      the I/O buffers after Halt
+ * Parameters:
+ *      um_state_t um: state of a halted program
+ * Returns:
+ *      None
+ * Expects:
+ *      um to be non-NULL
+ * Notes:
+ *      None
+ ****************************************************************************/
+static void free_um(um_state_t um)
+{
+        free_memory(um);
+        free_inst_cache(&um->cache);
+        free_jit(&um->jit);
+        free_io(&um->io);
 }
\ No newline at end of file
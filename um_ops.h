@@ -0,0 +1,329 @@
+/*****************************************************************************
+ *
+ *                       um_ops.h
+ *
+ *      Assignment: Homework 6 -- um
+ *      Authors: Kabir Pamnani (kpamna01), Oliver Uy (ouy01)
+ *      Date: Apr 13th, 2023
+ *
+ *      Summary: Bodies of the 14 UM instructions and of the fused
+ *               sequences from fusion.h, written once as macros so that
+ *               every engine (switch loop, threaded dispatch, handler
+ *               table) runs the exact same code for each opcode.
+ *
+ *               Each macro expects the following locals to be in scope
+ *               (the fused ones also read the slots after the fused one):
+ *                 uint32_t r[]          registers
+ *                 uint32_t prog_counter index of the next instruction
+ *                 seg_ref_t *mem_seq    virtual memory spine (engine.h)
+ *                 uint32_t *unmapped    stack of unmapped segment ids
+ *                 um_state_t um         state the locals were loaded from
+ *                 inst_cache_t cache    decoded form of segment 0
+ *                 inst_decoded_t *slots um->slots
+ *
+ *               Load_program shares storage instead of copying: after
+ *               loading segment b, mem_seq[1] == mem_seq[b] and
+ *               mem_seq[0][META_SHARED] == b until a store into either of
+ *               them, which first gives segment 0 a private copy
+ *               (UNSHARE_SEG_0), or until b is unmapped, which hands the
+ *               storage over to segment 0.
+ *
+ *               In the checked build of the engine (-DUM_CHECKED, check.h)
+ *               the CHECK macros below make each body test its operands
+ *               first and report the instruction if they are invalid; in
+ *               the safe build (-DUM_SAFE, guard.h) only segment ids and
+ *               offsets too big for a guard are tested; in every other
+ *               build they expand
+ *               to nothing. Offsets index as 64-bit, so offset 2^32 - 1
+ *               never wraps around to a segment's length word.
+ *
+ ****************************************************************************/
+#ifndef UM_OPS
+#define UM_OPS
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "inst_cache.h"
+#include "fusion.h"
+#include "memory.h"
+#include "check.h"
+#include "io.h"
+#include "snapshot.h"
+#include "guard.h"
+
+#ifdef UM_CHECKED
+/* fail with the printf-style message unless cond holds */
+#define CHECK(cond, ...)                                                      \
+        (__builtin_expect(!!(cond), 1) ? (void) 0                             \
+                                       : check_failed(um, __VA_ARGS__))
+#else
+#define CHECK(cond, ...) ((void) 0)
+#endif
+
+/* id must be 0 or a mapped segment. Safe mode's spine has an entry for
+ * every id (memory.c), and entry 0 is never NO_SEG, so one compare does */
+#ifdef UM_SAFE
+#define CHECK_MAPPED(id)                                                      \
+        (__builtin_expect(mem_seq[id] != NO_SEG, 1)                           \
+                 ? (void) 0                                                   \
+                 : check_failed(um, "segment %u is not mapped", (id)))
+#else
+#define CHECK_MAPPED(id)                                                      \
+        CHECK((id) == 0 || ((id) < SEG(um, mem_seq[0])[1] &&                  \
+                            mem_seq[id] != NO_SEG),                           \
+              "segment %u is not mapped", (id))
+#endif
+
+/* off must be a word of segment id, whose storage is seg. In safe mode
+ * the guards catch every offset below GUARD_WORDS, so only larger ones are
+ * compared, in a branch an ordinary program never takes */
+#ifdef UM_SAFE
+#define CHECK_OFFSET(id, seg, off)                                            \
+        (__builtin_expect((off) < GUARD_WORDS, 1) || (off) < (seg)[0] - 1     \
+                 ? (void) 0                                                   \
+                 : check_failed(um, "offset %u is out of bounds of segment "  \
+                                "%u (%u words)", (off), (id), (seg)[0] - 1))
+#else
+#define CHECK_OFFSET(id, seg, off)                                            \
+        CHECK((off) < (seg)[0] - 1,                                           \
+              "offset %u is out of bounds of segment %u (%u words)",          \
+              (off), (id), (seg)[0] - 1)
+#endif
+
+/* op is not an instruction (opcodes 14 and 15) */
+#define OP_INVALID(op)                                                        \
+        CHECK(0, "opcode %u is not an instruction", (unsigned) (op))
+
+/* Opcode 0 */
+#define OP_CMOV(A, B, C)                                                      \
+        do {                                                                  \
+                if (r[C] != 0) {                                              \
+                        r[A] = r[B];                                          \
+                }                                                             \
+        } while (0)
+
+/* Opcode 1: segment 0 lives at mem_seq[1], every other id at mem_seq[id] */
+#define OP_SLOAD(A, B, C)                                                     \
+        do {                                                                  \
+                CHECK_MAPPED(r[B]);                                           \
+                seg_ref_t seg = (r[B] == 0) ? mem_seq[1] : mem_seq[r[B]];     \
+                CHECK_OFFSET(r[B], SEG(um, seg), r[C]);                       \
+                r[A] = SEG(um, seg)[(size_t) r[C] + 1];                       \
+        } while (0)
+
+/* copy segment 0 out of the storage it shares since a Load_program */
+#define UNSHARE_SEG_0()                                                       \
+        do {                                                                  \
+                uint32_t *shared = SEG(um, mem_seq[1]);                       \
+                size_t bytes = ((size_t) shared[0]) * sizeof(uint32_t);       \
+                uint32_t *copy = seg_alloc(um->pool, shared[0]);              \
+                memcpy(copy, shared, bytes);                                  \
+                mem_seq[1] = SEG_REF(um, copy);                               \
+                SEG(um, mem_seq[0])[META_SHARED] = 0;                         \
+        } while (0)
+
+/* Opcode 2: a store into segment 0 also re-decodes the overwritten slot;
+ * a store into either side of a shared segment 0 unshares it first
+ */
+#define OP_SSTORE(A, B, C)                                                    \
+        do {                                                                  \
+                CHECK_MAPPED(r[A]);                                           \
+                CHECK_OFFSET(r[A], SEG(um, mem_seq[r[A] == 0 ? 1 : r[A]]),    \
+                             r[B]);                                           \
+                uint32_t shared_id = SEG(um, mem_seq[0])[META_SHARED];        \
+                if (shared_id != 0 && (r[A] == 0 || r[A] == shared_id)) {     \
+                        UNSHARE_SEG_0();                                      \
+                }                                                             \
+                if (r[A] == 0) {                                              \
+                        SEG(um, mem_seq[1])[(size_t) r[B] + 1] = r[C];        \
+                        refresh_inst(cache, r[B], r[C]);                      \
+                } else {                                                      \
+                        SEG(um, mem_seq[r[A]])[(size_t) r[B] + 1] = r[C];     \
+                }                                                             \
+        } while (0)
+
+/* Opcodes 3 - 6 */
+#define OP_ADD(A, B, C)  (r[A] = r[B] + r[C])
+#define OP_MUL(A, B, C)  (r[A] = r[B] * r[C])
+#define OP_DIV(A, B, C)  (CHECK(r[C] != 0, "division by zero"),              \
+                          r[A] = r[B] / r[C])
+#define OP_NAND(A, B, C) (r[A] = ~(r[B] & r[C]))
+
+/* Opcode 7 (Halt) has no body: each engine leaves its loop and returns */
+
+/* Opcode 8: reuse an unmapped id if there is one, else take the next id,
+ * growing the spine (and reloading mem_seq and unmapped) if it is full
+ */
+#define OP_MAP(B, C)                                                          \
+        do {                                                                  \
+                CHECK(r[C] != UINT32_MAX, "cannot map %u words", r[C]);       \
+                uint32_t *new_seg = seg_alloc(um->pool, r[C] + 1);            \
+                uint32_t unmapped_size = unmapped[0];                         \
+                if (unmapped_size != 0) {                                     \
+                        uint32_t unmapped_id = unmapped[unmapped_size];       \
+                        mem_seq[unmapped_id] = SEG_REF(um, new_seg);          \
+                        r[B] = unmapped_id;                                   \
+                        unmapped[0]--;                                        \
+                } else {                                                      \
+                        uint32_t *meta = SEG(um, mem_seq[0]);                 \
+                        uint32_t seg_id = meta[1];                            \
+                        if (seg_id == meta[0]) {                              \
+                                grow_memory(um);                              \
+                                mem_seq = um->mem_seq;                        \
+                                unmapped = um->unmapped;                      \
+                        }                                                     \
+                        mem_seq[seg_id] = SEG_REF(um, new_seg);               \
+                        r[B] = seg_id;                                        \
+                        meta[1] = seg_id + 1;                                 \
+                }                                                             \
+        } while (0)
+
+/* Opcode 9: free the segment and push its id onto the unmapped stack;
+ * storage shared with segment 0 is kept and now belongs to segment 0
+ */
+#define OP_UNMAP(C)                                                           \
+        do {                                                                  \
+                CHECK(r[C] != 0, "segment 0 cannot be unmapped");             \
+                CHECK_MAPPED(r[C]);                                           \
+                uint32_t *meta = SEG(um, mem_seq[0]);                         \
+                if (r[C] == meta[META_SHARED]) {                              \
+                        meta[META_SHARED] = 0;                                \
+                } else {                                                      \
+                        seg_free(um->pool, SEG(um, mem_seq[r[C]]));           \
+                }                                                             \
+                mem_seq[r[C]] = NO_SEG;                                       \
+                unmapped[unmapped[0] + 1] = r[C];                             \
+                unmapped[0]++;                                                \
+        } while (0)
+
+/* Write a requested snapshot if it is due at this point, with the
+ * engine's registers published to um first; pc is where the restored
+ * program resumes. Only Input and program loads have one
+ */
+#define SNAPSHOT_POINT(point, pc)                                             \
+        do {                                                                  \
+                if (um->snapshot != NULL && um->snapshot->at == (point)) {    \
+                        memmove(um->r, r, sizeof(um->r));                     \
+                        um->prog_counter = (pc);                              \
+                        take_snapshot(um);                                    \
+                }                                                             \
+        } while (0)
+
+/* Where run_um_quota (engine.c) may stop before an Input; nowhere else */
+#ifndef INPUT_POINT
+#define INPUT_POINT() ((void) 0)
+#endif
+
+/* Opcode 10 */
+#define OP_OUT(C)                                                             \
+        do {                                                                  \
+                CHECK(r[C] <= 255, "output %u is not a byte", r[C]);          \
+                if (r[C] != (uint32_t) ~0) {                                  \
+                        io_put(um->io, r[C]);                                 \
+                }                                                             \
+        } while (0)
+
+/* Opcode 11: EOF fills r[C] with all 1's; a restored program runs this
+ * Input again
+ */
+#define OP_IN(C)                                                              \
+        do {                                                                  \
+                INPUT_POINT();                                                \
+                SNAPSHOT_POINT(SNAP_AT_INPUT, prog_counter - 1);              \
+                r[C] = io_get(um->io);                                        \
+        } while (0)
+
+/* Opcode 12: a jump within segment 0 only moves the program counter;
+ * otherwise segment 0 shares segment r[B]'s storage (no copy) and is
+ * re-decoded. Loading the segment it already shares is just a jump.
+ */
+#define OP_LOADP(B, C)                                                        \
+        do {                                                                  \
+                CHECK_MAPPED(r[B]);                                           \
+                prog_counter = r[C];                                          \
+                seg_ref_t prog_ref = mem_seq[r[B]];                           \
+                if (r[B] != 0 && prog_ref != mem_seq[1]) {                    \
+                        uint32_t *meta = SEG(um, mem_seq[0]);                 \
+                        uint32_t *prog_seg = SEG(um, prog_ref);               \
+                        if (meta[META_SHARED] == 0) {                         \
+                                seg_free(um->pool, SEG(um, mem_seq[1]));      \
+                        }                                                     \
+                        mem_seq[1] = prog_ref;                                \
+                        meta[META_SHARED] = r[B];                             \
+                        build_inst_cache(cache, prog_seg + 1,                 \
+                                         prog_seg[0] - 1);                    \
+                        set_slots(um);                                        \
+                        slots = um->slots;                                    \
+                        SNAPSHOT_POINT(SNAP_AT_LOAD, prog_counter);           \
+                }                                                             \
+        } while (0)
+
+/* Opcode 13 */
+#define OP_LOADVAL(A, val) (r[A] = (val))
+
+/* Fused opcodes (fusion.h). The fused slot inst keeps the fields of the
+ * first instruction; the others are read from the slots that follow it,
+ * and prog_counter is moved past them before any body runs.
+ */
+#define FUSED_NEXT(name) inst_decoded_t name = slots[prog_counter++]
+
+#define OP_LV_LV(inst)                                                        \
+        do {                                                                  \
+                FUSED_NEXT(second);                                           \
+                OP_LOADVAL((inst).A, (inst).val);                             \
+                OP_LOADVAL(second.A, second.val);                             \
+        } while (0)
+
+#define OP_LV_ADD(inst)                                                       \
+        do {                                                                  \
+                FUSED_NEXT(second);                                           \
+                OP_LOADVAL((inst).A, (inst).val);                             \
+                OP_ADD(second.A, second.B, second.C);                         \
+        } while (0)
+
+#define OP_LV_MUL(inst)                                                       \
+        do {                                                                  \
+                FUSED_NEXT(second);                                           \
+                OP_LOADVAL((inst).A, (inst).val);                             \
+                OP_MUL(second.A, second.B, second.C);                         \
+        } while (0)
+
+#define OP_LV_SLOAD(inst)                                                     \
+        do {                                                                  \
+                FUSED_NEXT(second);                                           \
+                OP_LOADVAL((inst).A, (inst).val);                             \
+                OP_SLOAD(second.A, second.B, second.C);                       \
+        } while (0)
+
+#define OP_LV_SSTORE(inst)                                                    \
+        do {                                                                  \
+                FUSED_NEXT(second);                                           \
+                OP_LOADVAL((inst).A, (inst).val);                             \
+                OP_SSTORE(second.A, second.B, second.C);                      \
+        } while (0)
+
+#define OP_NAND_NAND(inst)                                                    \
+        do {                                                                  \
+                FUSED_NEXT(second);                                           \
+                OP_NAND((inst).A, (inst).B, (inst).C);                        \
+                OP_NAND(second.A, second.B, second.C);                        \
+        } while (0)
+
+#define OP_SLOAD_SSTORE(inst)                                                 \
+        do {                                                                  \
+                FUSED_NEXT(second);                                           \
+                OP_SLOAD((inst).A, (inst).B, (inst).C);                       \
+                OP_SSTORE(second.A, second.B, second.C);                      \
+        } while (0)
+
+#define OP_LV_LV_SSTORE(inst)                                                 \
+        do {                                                                  \
+                FUSED_NEXT(second);                                           \
+                FUSED_NEXT(third);                                            \
+                OP_LOADVAL((inst).A, (inst).val);                             \
+                OP_LOADVAL(second.A, second.val);                             \
+                OP_SSTORE(third.A, third.B, third.C);                         \
+        } while (0)
+
+#endif